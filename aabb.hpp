@@ -0,0 +1,92 @@
+#pragma once
+
+#include "interval.hpp"
+#include "ray.hpp"
+
+//Axis aligned bounding box, stored as one interval per axis.
+class AABB {
+public:
+	Interval x, y, z;
+
+	AABB() : x(Interval::empty), y(Interval::empty), z(Interval::empty) {}
+
+	AABB(const Interval& x, const Interval& y, const Interval& z) : x(x), y(y), z(z) {
+		pad_to_minimums();
+	}
+
+	//treat the two points as the extrema of the box, in any order.
+	AABB(const Point3D& a, const Point3D& b) {
+		x = (a.x() <= b.x()) ? Interval(a.x(), b.x()) : Interval(b.x(), a.x());
+		y = (a.y() <= b.y()) ? Interval(a.y(), b.y()) : Interval(b.y(), a.y());
+		z = (a.z() <= b.z()) ? Interval(a.z(), b.z()) : Interval(b.z(), a.z());
+		pad_to_minimums();
+	}
+
+	AABB(const AABB& a, const AABB& b) : x(a.x, b.x), y(a.y, b.y), z(a.z, b.z) {}
+
+	const Interval& axis_interval(int n) const {
+		if (n == 1) return y;
+		if (n == 2) return z;
+		return x;
+	}
+
+	bool hit(const Ray& r, Interval ray_t) const {
+		const Vec3& d = r.direction();
+		return hit(r.origin(), Vec3(1.0 / d.x(), 1.0 / d.y(), 1.0 / d.z()), ray_t);
+	}
+
+	//slab test against a precomputed reciprocal direction, used by the traversal loops.
+	bool hit(const Point3D& origin, const Vec3& inv_dir, Interval ray_t) const {
+		for (int axis = 0; axis < 3; axis++) {
+			const Interval& ax = axis_interval(axis);
+			auto t0 = (ax.low - origin.e[axis]) * inv_dir.e[axis];
+			auto t1 = (ax.high - origin.e[axis]) * inv_dir.e[axis];
+			if (t0 > t1) std::swap(t0, t1);
+
+			if (t0 > ray_t.low) ray_t.low = t0;
+			if (t1 < ray_t.high) ray_t.high = t1;
+			if (ray_t.high < ray_t.low) return false;
+		}
+		return true;
+	}
+
+	int longest_axis() const {
+		if (x.size() > y.size())
+			return x.size() > z.size() ? 0 : 2;
+		return y.size() > z.size() ? 1 : 2;
+	}
+
+	Point3D centroid() const {
+		return Point3D(0.5 * (x.low + x.high), 0.5 * (y.low + y.high), 0.5 * (z.low + z.high));
+	}
+
+	double surface_area() const {
+		if (x.size() < 0 || y.size() < 0 || z.size() < 0) return 0.0;
+		return 2.0 * (x.size() * y.size() + y.size() * z.size() + z.size() * x.size());
+	}
+
+	bool is_empty() const {
+		return x.size() < 0 || y.size() < 0 || z.size() < 0;
+	}
+
+	//infinite primitives (planes) report a universe box. -ffast-math lets the compiler fold
+	//isinf/isfinite away, so compare against a large finite extent instead.
+	bool is_bounded() const {
+		constexpr double max_extent = 1e30;
+		return x.size() < max_extent && y.size() < max_extent && z.size() < max_extent;
+	}
+
+	static const AABB empty, universe;
+
+private:
+	//flat primitives (axis aligned triangles) would otherwise produce a zero width slab.
+	void pad_to_minimums() {
+		double delta = 0.0001;
+		if (x.size() < delta) x = x.expand(delta);
+		if (y.size() < delta) y = y.expand(delta);
+		if (z.size() < delta) z = z.expand(delta);
+	}
+};
+
+inline const AABB AABB::empty = AABB(Interval::empty, Interval::empty, Interval::empty);
+inline const AABB AABB::universe = AABB(Interval::universe, Interval::universe, Interval::universe);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include "hittable.hpp"
+#include "material.hpp"
+#include "random.hpp"
+#include "vec.hpp"
+
+//Arbitrary output variables: per pixel passes written next to the beauty image, one file
+//each. normal, depth and albedo are averaged over the first hits of the pixel's samples,
+//prim_id names the primitive the first sample hit, samples counts the samples taken and
+//cost the intersection tests per sample (see ray_stats.hpp).
+enum class Aov {
+	normal,
+	depth,
+	albedo,
+	prim_id,
+	samples,
+	cost
+};
+
+constexpr size_t aov_count = 6;
+
+inline std::optional<Aov> parse_aov(std::string_view name) {
+	if (name == "normal") return Aov::normal;
+	if (name == "depth") return Aov::depth;
+	if (name == "albedo") return Aov::albedo;
+	if (name == "prim_id") return Aov::prim_id;
+	if (name == "samples") return Aov::samples;
+	if (name == "cost") return Aov::cost;
+	return std::nullopt;
+}
+
+inline std::string_view aov_name(Aov aov) {
+	switch (aov) {
+	case Aov::normal: return "normal";
+	case Aov::depth: return "depth";
+	case Aov::albedo: return "albedo";
+	case Aov::prim_id: return "prim_id";
+	case Aov::samples: return "samples";
+	case Aov::cost: return "cost";
+	}
+	return "normal";
+}
+
+//Hash of the primitive behind a hit, 0 for misses: the object's place in the flattened
+//scene and the sub-primitive, so the same scene gives the same ids in every run.
+inline uint32_t primitive_id(const HitRecord& rec) {
+	return rng::hash32(rng::hash32(rec.object->scene_index()) ^ rec.prim) | 1u;
+}
+
+//Stable random color of an id, black for 0.
+inline Vec3 id_color(uint32_t id) {
+	if (id == 0) return Vec3(0, 0, 0);
+	const uint32_t h = rng::hash32(id);
+	return Vec3((h & 0xFF) / 255.0, ((h >> 8) & 0xFF) / 255.0, ((h >> 16) & 0xFF) / 255.0);
+}
+
+//Running sums of the first hit features of one pixel, feeding the AOVs and the denoiser
+//guides. Misses take the background as albedo and leave normal and depth at zero.
+struct AovSum {
+	Vec3 albedo = Vec3(0, 0, 0);
+	Vec3 normal = Vec3(0, 0, 0);
+	Real depth = 0;
+	uint32_t id = 0; //of the first sample only, ids do not average
+	bool has_id = false;
+	Real cost = 0; //intersection tests, summed over the samples
+
+	void add_hit(const Ray& r, const HitRecord& rec) {
+		albedo += rec.mat->surface_albedo(rec);
+		normal += rec.normal;
+		depth += (rec.p - r.origin()).length();
+		if (!has_id) id = primitive_id(rec);
+		has_id = true;
+	}
+
+	void add_miss(const Vec3& background) {
+		albedo += background;
+		has_id = true;
+	}
+};
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <vector>
+#include "aabb.hpp"
+#include "hittable.hpp"
+#include "hittable_list.hpp"
+#include "simd_pack.hpp"
+
+//Flattened binary BVH node. Nodes are laid out depth first, so the left child of an
+//inner node always sits right after it and only the right child index is stored.
+struct BvhNode {
+	AABB bbox;
+	uint32_t offset; //inner: index of the right child, leaf: first primitive
+	uint16_t count; //number of primitives, 0 for inner nodes
+	uint8_t axis; //split axis, used to visit the nearer child first
+};
+
+namespace bvh {
+
+constexpr int sah_bins = 16;
+//Traversal keeps one stack entry per level, so no leaf may sit deeper than this. Past
+//median_depth the build splits at the median, which halves the range on every level and
+//reaches single primitives within 32 more levels for any uint32_t count.
+constexpr int max_depth = 64;
+constexpr int median_depth = max_depth - 32;
+constexpr double traversal_cost = 1.0;
+constexpr double intersection_cost = 1.0;
+
+struct BuildItem {
+	AABB bbox;
+	Point3D centroid;
+};
+
+inline void build_recursive(std::vector<BvhNode>& nodes, std::vector<BuildItem>& items, std::vector<uint32_t>& order, uint32_t begin, uint32_t end, int max_leaf_size, int depth) {
+	const uint32_t node_index = static_cast<uint32_t>(nodes.size());
+	nodes.push_back(BvhNode{});
+
+	AABB bounds;
+	AABB centroid_bounds;
+	for (uint32_t i = begin; i < end; i++) {
+		bounds = AABB(bounds, items[order[i]].bbox);
+		const auto& c = items[order[i]].centroid;
+		centroid_bounds = AABB(centroid_bounds, AABB(c, c));
+	}
+
+	const uint32_t count = end - begin;
+	auto make_leaf = [&] {
+		nodes[node_index] = BvhNode{ bounds, begin, static_cast<uint16_t>(count), 0 };
+	};
+
+	if (count == 1) {
+		make_leaf();
+		return;
+	}
+
+	//clustered or exponentially spaced centroids can make the SAH peel off one primitive
+	//per level; deep down, fall back to the median of the widest centroid axis.
+	if (depth >= median_depth) {
+		if (count <= static_cast<uint32_t>(max_leaf_size)) {
+			make_leaf();
+			return;
+		}
+		const int axis = centroid_bounds.longest_axis();
+		const uint32_t mid = begin + count / 2;
+		std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](uint32_t a, uint32_t b) {
+			return items[a].centroid.e[axis] < items[b].centroid.e[axis];
+		});
+		build_recursive(nodes, items, order, begin, mid, max_leaf_size, depth + 1);
+		const uint32_t right = static_cast<uint32_t>(nodes.size());
+		build_recursive(nodes, items, order, mid, end, max_leaf_size, depth + 1);
+		nodes[node_index] = BvhNode{ bounds, right, 0, static_cast<uint8_t>(axis) };
+		return;
+	}
+
+	//binned SAH: bucket the centroids along every axis and pick the cheapest plane.
+	int best_axis = -1;
+	int best_split = 0;
+	double best_cost = infinity;
+	for (int axis = 0; axis < 3; axis++) {
+		const Interval& extent = centroid_bounds.axis_interval(axis);
+		if (extent.size() <= 1e-12) continue;
+
+		AABB bin_bounds[sah_bins];
+		uint32_t bin_counts[sah_bins] = {};
+		const double scale = sah_bins / extent.size();
+		for (uint32_t i = begin; i < end; i++) {
+			const auto& item = items[order[i]];
+			int b = std::min(sah_bins - 1, static_cast<int>((item.centroid.e[axis] - extent.low) * scale));
+			bin_counts[b]++;
+			bin_bounds[b] = AABB(bin_bounds[b], item.bbox);
+		}
+
+		//sweep from the right to get the suffix areas, then from the left to evaluate each plane.
+		double right_area[sah_bins];
+		uint32_t right_count[sah_bins];
+		AABB acc;
+		uint32_t acc_count = 0;
+		for (int b = sah_bins - 1; b > 0; b--) {
+			acc = AABB(acc, bin_bounds[b]);
+			acc_count += bin_counts[b];
+			right_area[b] = acc.surface_area();
+			right_count[b] = acc_count;
+		}
+
+		acc = AABB();
+		acc_count = 0;
+		for (int b = 0; b < sah_bins - 1; b++) {
+			acc = AABB(acc, bin_bounds[b]);
+			acc_count += bin_counts[b];
+			if (acc_count == 0 || right_count[b + 1] == 0) continue;
+
+			double cost = acc.surface_area() * acc_count + right_area[b + 1] * right_count[b + 1];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_split = b;
+			}
+		}
+	}
+
+	const double parent_area = bounds.surface_area();
+	const double leaf_cost = intersection_cost * count;
+	const double split_cost = parent_area > 0.0 ? traversal_cost + intersection_cost * best_cost / parent_area : infinity;
+
+	if (count <= static_cast<uint32_t>(max_leaf_size) && leaf_cost <= split_cost) {
+		make_leaf();
+		return;
+	}
+
+	uint32_t mid;
+	if (best_axis < 0) {
+		//every centroid is in the same spot, just split the range in half.
+		best_axis = bounds.longest_axis();
+		mid = begin + count / 2;
+	} else {
+		const Interval& extent = centroid_bounds.axis_interval(best_axis);
+		const double scale = sah_bins / extent.size();
+		auto it = std::partition(order.begin() + begin, order.begin() + end, [&](uint32_t index) {
+			int b = std::min(sah_bins - 1, static_cast<int>((items[index].centroid.e[best_axis] - extent.low) * scale));
+			return b <= best_split;
+		});
+		mid = static_cast<uint32_t>(it - order.begin());
+	}
+
+	build_recursive(nodes, items, order, begin, mid, max_leaf_size, depth + 1);
+	const uint32_t right = static_cast<uint32_t>(nodes.size());
+	build_recursive(nodes, items, order, mid, end, max_leaf_size, depth + 1);
+
+	nodes[node_index] = BvhNode{ bounds, right, 0, static_cast<uint8_t>(best_axis) };
+}
+
+//Builds a SAH tree over the given boxes. On return, order holds the primitive indices in
+//leaf order, so callers can permute their primitives to match BvhNode::offset. No leaf is
+//more than max_depth levels below the root.
+inline std::vector<BvhNode> build(const std::vector<AABB>& boxes, std::vector<uint32_t>& order, int max_leaf_size) {
+	std::vector<BvhNode> nodes;
+	order.resize(boxes.size());
+	std::iota(order.begin(), order.end(), 0);
+	if (boxes.empty()) return nodes;
+
+	std::vector<BuildItem> items;
+	items.reserve(boxes.size());
+	for (const auto& box : boxes) items.push_back(BuildItem{ box, box.centroid() });
+
+	nodes.reserve(2 * boxes.size());
+	build_recursive(nodes, items, order, 0, static_cast<uint32_t>(boxes.size()), max_leaf_size, 0);
+	return nodes;
+}
+
+}
+
+//Top level acceleration structure over a HittableList. Primitives without a finite
+//bounding box (planes) are kept in a small side list and tested on every ray. Building
+//it completes the scene: the primitives are numbered in list order, nested lists included.
+class Bvh : public Hittable {
+public:
+	explicit Bvh(const HittableList& list, int max_leaf_size = 4) {
+		uint32_t next = 0;
+		for (const auto& object : list.objects) object->assign_scene_indices(next);
+
+		std::vector<AABB> boxes;
+		std::vector<std::shared_ptr<Hittable>> bounded;
+		for (const auto& object : list.objects) {
+			auto box = object->bounding_box();
+			//nothing to hit, e.g. an empty SphereSet; its inverted box would break the SAH bins.
+			if (box.is_empty()) continue;
+			if (box.is_bounded()) {
+				boxes.push_back(box);
+				bounded.push_back(object);
+			} else {
+				unbounded_.push_back(object);
+			}
+		}
+
+		std::vector<uint32_t> order;
+		nodes_ = bvh::build(boxes, order, max_leaf_size);
+
+		objects_.reserve(bounded.size());
+		for (auto index : order) objects_.push_back(bounded[index]);
+
+		bbox_ = list.bounding_box();
+	}
+
+	bool hit(const Ray &r, Interval ray_t, HitRecord &rec) const override {
+		HitRecord temp_rec;
+		bool hit_anything = false;
+
+		for (const auto& object : unbounded_) {
+			if (object->hit(r, ray_t, temp_rec)) {
+				hit_anything = true;
+				ray_t.high = temp_rec.t;
+				rec = temp_rec;
+			}
+		}
+
+		if (nodes_.empty()) return hit_anything;
+
+		const Vec3& d = r.direction();
+		const Vec3 inv_dir(1.0 / d.x(), 1.0 / d.y(), 1.0 / d.z());
+		const bool dir_neg[3] = { d.x() < 0, d.y() < 0, d.z() < 0 };
+
+		uint32_t stack[bvh::max_depth];
+		int stack_size = 0;
+		uint32_t current = 0;
+		for (;;) {
+			const BvhNode& node = nodes_[current];
+			ray_stats::count_tests(1);
+			if (node.bbox.hit(r.origin(), inv_dir, ray_t)) {
+				if (node.count > 0) {
+					for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+						if (objects_[i]->hit(r, ray_t, temp_rec)) {
+							hit_anything = true;
+							ray_t.high = temp_rec.t;
+							rec = temp_rec;
+						}
+					}
+					if (stack_size == 0) break;
+					current = stack[--stack_size];
+				} else if (dir_neg[node.axis]) {
+					stack[stack_size++] = current + 1;
+					current = node.offset;
+				} else {
+					stack[stack_size++] = node.offset;
+					current = current + 1;
+				}
+			} else {
+				if (stack_size == 0) break;
+				current = stack[--stack_size];
+			}
+		}
+
+		return hit_anything;
+	}
+
+	bool occluded(const Ray& r, Interval ray_t) const override {
+		return occluder(r, ray_t) != nullptr;
+	}
+
+	//Same walk as hit(), but returns the first primitive that blocks the ray.
+	const Hittable* occluder(const Ray& r, Interval ray_t) const override {
+		for (const auto& object : unbounded_)
+			if (object->occluded(r, ray_t)) return object.get();
+
+		if (nodes_.empty()) return nullptr;
+
+		const Vec3& d = r.direction();
+		const Vec3 inv_dir(1.0 / d.x(), 1.0 / d.y(), 1.0 / d.z());
+
+		uint32_t stack[bvh::max_depth];
+		int stack_size = 0;
+		uint32_t current = 0;
+		for (;;) {
+			const BvhNode& node = nodes_[current];
+			ray_stats::count_tests(1);
+			if (node.bbox.hit(r.origin(), inv_dir, ray_t)) {
+				if (node.count > 0) {
+					for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+						if (objects_[i]->occluded(r, ray_t)) return objects_[i].get();
+					if (stack_size == 0) break;
+					current = stack[--stack_size];
+				} else {
+					stack[stack_size++] = node.offset;
+					current = current + 1;
+				}
+			} else {
+				if (stack_size == 0) break;
+				current = stack[--stack_size];
+			}
+		}
+		return nullptr;
+	}
+
+	//Packet traversal: a node is entered with the lanes that reached it and split further by
+	//the slab test, the visiting order follows the first active lane.
+	void hit_packet(const RayPacket& packet, unsigned lanes, PacketHit& hits) const override {
+		for (const auto& object : unbounded_)
+			object->hit_packet(packet, lanes, hits);
+
+		if (nodes_.empty() || lanes == 0) return;
+
+		struct Entry {
+			uint32_t node;
+			unsigned lanes;
+		};
+
+		Entry stack[bvh::max_depth];
+		int stack_size = 0;
+		Entry current{ 0, lanes };
+		for (;;) {
+			const BvhNode& node = nodes_[current.node];
+			ray_stats::count_tests(std::popcount(current.lanes));
+			const unsigned active = intersect_box(node.bbox, packet, current.lanes, hits.t_max);
+			if (active) {
+				if (node.count > 0) {
+					for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+						objects_[i]->hit_packet(packet, active, hits);
+					if (stack_size == 0) break;
+					current = stack[--stack_size];
+				} else if (packet.dir[node.axis][std::countr_zero(active)] < 0) {
+					stack[stack_size++] = Entry{ current.node + 1, active };
+					current = Entry{ node.offset, active };
+				} else {
+					stack[stack_size++] = Entry{ node.offset, active };
+					current = Entry{ current.node + 1, active };
+				}
+			} else {
+				if (stack_size == 0) break;
+				current = stack[--stack_size];
+			}
+		}
+	}
+
+	void assign_scene_indices(uint32_t& next) override {
+		for (const auto& object : objects_) object->assign_scene_indices(next);
+		for (const auto& object : unbounded_) object->assign_scene_indices(next);
+	}
+
+	AABB bounding_box() const override { return bbox_; }
+
+private:
+	std::vector<BvhNode> nodes_;
+	std::vector<std::shared_ptr<Hittable>> objects_; //bounded primitives, in leaf order
+	std::vector<std::shared_ptr<Hittable>> unbounded_;
+	AABB bbox_;
+
+	//slab test of one box against the selected lanes of a packet, returns the lanes that hit.
+	static unsigned intersect_box(const AABB& box, const RayPacket& packet, unsigned lanes, const Real* t_max) {
+#if HAVE_AVX2
+		using Pack = RealPack;
+		constexpr unsigned group_mask = (1u << Pack::width) - 1;
+		unsigned result = 0;
+		for (int base = 0; base < packet_width; base += Pack::width) {
+			if (((lanes >> base) & group_mask) == 0) continue;
+
+			Pack t_near = Pack::broadcast(packet.t_min);
+			Pack t_far = Pack::loadu(&t_max[base]);
+			for (int axis = 0; axis < 3; axis++) {
+				const Interval& extent = box.axis_interval(axis);
+				const Pack origin = Pack::load(&packet.origin[axis][base]);
+				const Pack inv_dir = Pack::load(&packet.inv_dir[axis][base]);
+				const Pack t0 = (Pack::broadcast(extent.low) - origin) * inv_dir;
+				const Pack t1 = (Pack::broadcast(extent.high) - origin) * inv_dir;
+				t_near = max(min(t0, t1), t_near);
+				t_far = min(max(t0, t1), t_far);
+			}
+			result |= ((t_near <= t_far).movemask() << base) & lanes;
+		}
+		return result;
+#else
+		unsigned result = 0;
+		for (unsigned m = lanes; m; m &= m - 1) {
+			int lane = std::countr_zero(m);
+			const Vec3 inv_dir(packet.inv_dir[0][lane], packet.inv_dir[1][lane], packet.inv_dir[2][lane]);
+			if (box.hit(packet.rays[lane].origin(), inv_dir, Interval(packet.t_min, t_max[lane])))
+				result |= 1u << lane;
+		}
+		return result;
+#endif
+	}
+};
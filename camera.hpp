@@ -1,28 +1,56 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <bit>
 #include <cmath>
 #include <print>
 #include <vector>
 #include <cassert>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include "ray.hpp"
+#include "ray_packet.hpp"
 #include "hittable.hpp"
 #include "constants.hpp"
 #include "material.hpp"
 #include "vec.hpp"
 #include "thread_pool.hpp"
+#include "tile_scheduler.hpp"
 #include "lib/tui/tui.hpp"
+#include "aov.hpp"
 #include "color.hpp"
+#include "denoiser.hpp"
+#include "image_writer.hpp"
+#include "pixel_stats.hpp"
+#include "sampler.hpp"
+#include "wavefront.hpp"
 
 
 
 
+//A rectangle of the image with its own pixel buffer; render_tile writes into one.
 struct Kernel {
 	int width = 0;
 	int height = 0;
 	int startW = 0;
 	int startH = 0;
 	std::vector<Vec3> colors;
+	std::vector<uint32_t> samples; //samples taken per pixel, only filled for the heatmap and the samples AOV
+	//first hit averages, AOVs and the luminance variance that guides the denoiser, only
+	//filled when denoising or writing AOVs
+	std::vector<Vec3> albedo;
+	std::vector<Vec3> normal;
+	std::vector<Real> depth;
+	std::vector<Real> variance;
+	std::vector<uint32_t> prim_id;
+	std::vector<Real> cost;
+
+	size_t index(int x, int y) const { return static_cast<size_t>(y - startH) * width + (x - startW); }
+	Vec3& at(int x, int y) { return colors[index(x, y)]; }
 };
 
 
@@ -32,6 +60,7 @@ public:
 	int image_width = 400;
 	int samples_per_pixel = 10;	
 	int max_depth = 10;
+	int rr_min_depth = 3; // Bounces every path takes before Russian roulette may end it
 	double vfov = 90.0;
 
 	Point3D lookfrom = Point3D(0.0, 0.0, 0.0); // Point camera is looking from
@@ -40,7 +69,20 @@ public:
 	
 	double defocus_angle = 0; // Variaton angle of rays through each pixel.
 	double focus_dist = 10; // Distance from camera lookfrom point to plane of perfect focus
-	
+
+	int tile_size = 0; // Tile edge in pixels, 0 picks one from the resolution and thread count
+	ImageFormat output_format = ImageFormat::ppm;
+	bool stream_output = false; // Write bands of finished rows during the render instead of keeping the whole image
+
+	double adaptive_threshold = 0.0; // A pixel stops sampling once its standard error, in display units, drops below this. 0 turns it off
+	int min_samples = 16; // Samples every pixel takes before it may stop early
+	std::ostream* sample_heatmap = nullptr; // When set, receives a P6 image of the samples spent per pixel
+	Integrator integrator = Integrator::recursive;
+	SamplerType sampler = SamplerType::random; // Source of the pixel, lens and bounce samples, see sampler.hpp
+	bool denoise = false; // Filter the finished image with denoiser before writing it. Renders it as one band
+	Denoiser denoiser;
+	std::array<std::ostream*, aov_count> aov_outputs{}; // Indexed by Aov, a set stream receives that pass in output_format. Renders the image as one band
+	ThreadPool* thread_pool = nullptr; // Pool to render on, e.g. the one the scene was loaded with. nullptr creates one on the first render
 
 	Camera() {}
 	explicit Camera(std::vector<Vec3> lights) : light_sources(lights) {  }
@@ -50,42 +92,65 @@ public:
 	{
 		initialize();
 
-		out << "P3" << '\n'; 
-		out << image_width << " " << image_height << '\n';
-		out << 255 << '\n'; 
 		std::println("Generating image of width: {}, height: {}", image_width, image_height);	
 
 
-		const int tiles_x = 16;
-		const int tiles_y = 16;
-
-		const int tile_w = (image_width + tiles_x - 1) / tiles_x;
-		const int tile_h = (image_height + tiles_y - 1) / tiles_y;
-		//break the image into 16 by 16 sections.
-
+		const int tile_size = this->tile_size > 0 ? this->tile_size : TileScheduler::auto_tile_size(image_width, image_height, pool().size());
+		//a streamed band is one row of tiles, otherwise the whole image is a single band. The
+		//denoiser needs the neighbours of every pixel and the AOVs are scaled by their image
+		//maximum, so both get the whole image.
+		const bool aovs = std::ranges::any_of(aov_outputs, [](const std::ostream* o) { return o != nullptr; });
+		if (stream_output && (denoise || aovs)) std::println("Denoising and AOVs render the image as one band, not streaming");
+		const bool stream = stream_output && !denoise && !aovs;
+		TileScheduler scheduler(image_width, image_height, tile_size, pool().size(), stream ? 1 : 0);
+		auto writer = make_image_writer(output_format);
+		writer->begin(out, image_width, image_height);
+		std::unique_ptr<ImageWriter> heatmap;
+		if (sample_heatmap) {
+			heatmap = make_image_writer(ImageFormat::ppm);
+			heatmap->begin(*sample_heatmap, image_width, image_height);
+		}
+		std::array<std::unique_ptr<ImageWriter>, aov_count> aov_writers;
+		for (size_t i = 0; i < aov_count; i++) {
+			if (!aov_outputs[i]) continue;
+			if (static_cast<Aov>(i) == Aov::cost && !ray_stats::enabled)
+				std::println("The cost AOV needs a build with COUNT_TESTS=1, it will be black");
+			aov_writers[i] = make_image_writer(output_format);
+			aov_writers[i]->begin(*aov_outputs[i], image_width, image_height);
+		}
 
-		std::println("Spawning {} workers", tiles_x * tiles_y);
-		std::vector<Vec3> framebuffer(image_width * image_height);
+		//bands past the window are only queued once an earlier band has been written, which
+		//bounds the pixel memory to window * band_height rows.
+		const int window = stream ? static_cast<int>(std::max<size_t>(2, 2 * pool().size())) : 1;
+		std::println("Rendering {} tiles of {}px on {} threads", scheduler.tiles().size(), scheduler.tile_size(), pool().size());
+		if (stream)
+			std::println("Streaming {} bands of {} rows, at most {} in flight", scheduler.band_count(), scheduler.band_height(), window);
 
-		tui::LoadingIndicator loader(tiles_x * tiles_y);
+		tui::LoadingIndicator loader(static_cast<int64_t>(image_width) * image_height);
 		auto start = std::chrono::steady_clock::now();
+		uint64_t samples_taken = 0;
 
 		{
-			ThreadPool pool;
-			for(int ty = 0; ty < tiles_y; ty++)
+			TaskGroup tiles(pool());
+			Frame frame{ .world = world, .tiles = tiles, .scheduler = scheduler, .loader = loader, .out = out, .writer = *writer, .heatmap = heatmap.get() };
+			for (size_t i = 0; i < aov_count; i++) frame.aovs[i] = aov_writers[i].get();
+			frame.bands = std::make_unique<Band[]>(scheduler.band_count());
+
 			{
-				for (int tx = 0; tx < tiles_x; tx++)
-				{
-					const int x0 = tx*tile_w;
-					const int x1 = std::min(x0 + tile_w, image_width);
-					const int y0 = ty*tile_h;
-					const int y1 = std::min(y0 + tile_h, image_height);
-					
-					pool.execute([&, x0, x1, y0, y1] {
-						render_tile(world, x0, y0, x1, y1, framebuffer);
-						++loader;
-					});
-				}
+				std::lock_guard lk(frame.output_mutex);
+				while (frame.next_submit < std::min(window, scheduler.band_count()))
+					submit_band(frame, frame.next_submit++);
+			}
+			tiles.wait();
+			samples_taken = frame.samples_taken.load();
+
+			//the band is the whole image here and every tile is done, so the pool is free
+			//for the filter.
+			if (denoise) {
+				Band& band = frame.bands[0];
+				const DenoiseGuides guides{ band.kernel.albedo.data(), band.kernel.normal.data(), band.kernel.depth.data(), band.kernel.variance.data() };
+				denoiser.run(pool(), band.kernel.width, band.kernel.height, band.kernel.colors.data(), guides);
+				write_band(frame, band);
 			}
 		}
 		auto end = std::chrono::steady_clock::now();
@@ -94,17 +159,12 @@ public:
 		std::cout.flush();
 		
 		std::println("\nWork completed in {} seconds!", elapsed_seconds.count());
+		std::println("Average samples per pixel: {:.2f}", static_cast<double>(samples_taken) / (static_cast<double>(image_width) * image_height));
 
-		for(int y = 0; y < image_height; ++y)
-		{
-			for(int x = 0; x < image_width; ++x)
-			{
-				write_color(out, framebuffer[y * image_width + x]);
-			}
-		}
-
-		out.flush();
-
+		writer->end(out);
+		if (heatmap) heatmap->end(*sample_heatmap);
+		for (size_t i = 0; i < aov_count; i++)
+			if (aov_writers[i]) aov_writers[i]->end(*aov_outputs[i]);
 	}
 private:
 	int image_height;
@@ -115,9 +175,144 @@ private:
 	double pixel_samples_scale;
 
 	Vec3 u, v, w; //Camera frame basis vectors.
-//	Vec3 defocus_disk_u;   	//Defocus disk horizontal radius
-//	Vec3 defocus_disk_v;	//Defocus disk vertical radius
+	Vec3 defocus_disk_u;   	//Defocus disk horizontal radius
+	Vec3 defocus_disk_v;	//Defocus disk vertical radius
 	std::vector<Vec3> light_sources;
+	std::unique_ptr<ThreadPool> pool_; //created on the first render without a thread_pool and reused after that
+
+	ThreadPool& pool() {
+		if (thread_pool) return *thread_pool;
+		if (!pool_) pool_ = std::make_unique<ThreadPool>();
+		return *pool_;
+	}
+
+	struct Band {
+		Kernel kernel;
+		std::atomic<int> tiles_left = 0;
+		bool done = false;
+	};
+
+	//State shared by the tile jobs of one render.
+	struct Frame {
+		const Hittable& world;
+		TaskGroup& tiles;
+		TileScheduler& scheduler;
+		tui::LoadingIndicator& loader;
+		std::ostream& out;
+		ImageWriter& writer;
+		ImageWriter* heatmap;
+		std::array<ImageWriter*, aov_count> aovs{};
+		std::atomic<uint64_t> samples_taken = 0;
+
+		std::unique_ptr<Band[]> bands{};
+		std::mutex output_mutex{}; //guards out, the writer and the band bookkeeping below
+		int next_submit = 0;
+		int next_write = 0;
+	};
+
+	//Allocates the pixels of a band and queues its tiles. Called with output_mutex held.
+	void submit_band(Frame& frame, int index)
+	{
+		const auto tiles = frame.scheduler.band(index);
+		Band& band = frame.bands[index];
+		band.kernel.startW = 0;
+		band.kernel.startH = index * frame.scheduler.band_height();
+		band.kernel.width = image_width;
+		band.kernel.height = std::min(frame.scheduler.band_height(), image_height - band.kernel.startH);
+		band.kernel.colors.resize(static_cast<size_t>(band.kernel.width) * band.kernel.height);
+		if (frame.heatmap || frame.aovs[static_cast<size_t>(Aov::samples)]) band.kernel.samples.resize(band.kernel.colors.size());
+		if (collects_aovs()) {
+			band.kernel.albedo.resize(band.kernel.colors.size());
+			band.kernel.normal.resize(band.kernel.colors.size());
+			band.kernel.depth.resize(band.kernel.colors.size());
+			band.kernel.variance.resize(band.kernel.colors.size());
+			band.kernel.prim_id.resize(band.kernel.colors.size());
+			band.kernel.cost.resize(band.kernel.colors.size());
+		}
+		band.tiles_left = static_cast<int>(tiles.size());
+
+		//workers pop their newest job first, so queueing the Morton ordered tiles back to
+		//front makes every worker walk the curve forwards.
+		for (auto it = tiles.rbegin(); it != tiles.rend(); ++it)
+			frame.tiles.run([this, &frame, tile = *it] { run_tile(frame, tile); });
+	}
+
+	//Writes every band the format allows to write now, frees their pixels and queues the
+	//next bands in their place. Sequential formats have to wait for the bands above.
+	void finish_band(Frame& frame, int index)
+	{
+		std::lock_guard lk(frame.output_mutex);
+		frame.bands[index].done = true;
+		//the denoiser runs on the pool this tile job is part of, so render() filters and
+		//writes the single band once every tile is done and no lock is held.
+		if (denoise) return;
+
+		if (frame.writer.random_access()) {
+			write_band(frame, frame.bands[index]);
+			return;
+		}
+		while (frame.next_write < frame.scheduler.band_count() && frame.bands[frame.next_write].done)
+			write_band(frame, frame.bands[frame.next_write++]);
+	}
+
+	//Writes a finished band to every output, frees its pixels and queues the next band.
+	//Called with output_mutex held, or by render() once the tile jobs are done.
+	void write_band(Frame& frame, Band& band)
+	{
+		for (size_t i = 0; i < aov_count; i++) {
+			if (!frame.aovs[i]) continue;
+			const std::vector<Vec3> pass = aov_pixels(static_cast<Aov>(i), band.kernel);
+			frame.aovs[i]->write_rows(*aov_outputs[i], band.kernel.startH, band.kernel.height, pass.data());
+		}
+		band.kernel.albedo = std::vector<Vec3>();
+		band.kernel.normal = std::vector<Vec3>();
+		band.kernel.depth = std::vector<Real>();
+		band.kernel.variance = std::vector<Real>();
+		band.kernel.prim_id = std::vector<uint32_t>();
+		band.kernel.cost = std::vector<Real>();
+		frame.writer.write_rows(frame.out, band.kernel.startH, band.kernel.height, band.kernel.colors.data());
+		if (frame.heatmap) {
+			//reuse the color buffer: blue took few samples, red took samples_per_pixel.
+			for (size_t i = 0; i < band.kernel.samples.size(); i++) {
+				const double t = static_cast<double>(band.kernel.samples[i]) / samples_per_pixel;
+				band.kernel.colors[i] = Vec3(t * t, 0.0, (1.0 - t) * (1.0 - t));
+			}
+			frame.heatmap->write_rows(*sample_heatmap, band.kernel.startH, band.kernel.height, band.kernel.colors.data());
+			band.kernel.samples = std::vector<uint32_t>();
+		}
+		band.kernel.colors = std::vector<Vec3>();
+		if (frame.next_submit < frame.scheduler.band_count())
+			submit_band(frame, frame.next_submit++);
+	}
+
+	//Either renders the tile and reports its cost, or splits it and queues the quarters
+	//on the same group when the scheduler expects it to hold up the end of the frame.
+	void run_tile(Frame& frame, const Tile& tile)
+	{
+		const int band = frame.scheduler.band_of(tile);
+		if (frame.scheduler.should_split(tile)) {
+			const auto quarters = TileScheduler::split(tile);
+			frame.bands[band].tiles_left += static_cast<int>(quarters.size()) - 1;
+			for (const Tile& sub : quarters)
+				frame.tiles.run([this, &frame, sub] { run_tile(frame, sub); });
+			return;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		Kernel& target = frame.bands[band].kernel;
+		//the choice is made once per tile, the sample loops are compiled with and without
+		//the AOV collection.
+		const bool aovs = !target.albedo.empty();
+		if (integrator == Integrator::wavefront)
+			frame.samples_taken += aovs ? render_tile_wavefront<true>(frame.world, tile, target) : render_tile_wavefront<false>(frame.world, tile, target);
+		else
+			frame.samples_taken += aovs ? render_tile<true>(frame.world, tile, target) : render_tile<false>(frame.world, tile, target);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		frame.scheduler.record(tile, elapsed.count());
+		frame.loader += tile.area();
+		if (--frame.bands[band].tiles_left == 0) finish_band(frame, band);
+	}
 
 	void initialize() {
 		image_height = int(image_width / aspect_ratio);
@@ -125,11 +320,12 @@ private:
 		pixel_samples_scale = 1.0 / samples_per_pixel;
 		center = lookfrom; 
 
-		auto focal_length = (lookfrom - lookat).length();
+		//the viewport sits on the plane of perfect focus; vfov keeps the framing the same
+		//whatever focus_dist is.
 		auto theta = degrees_to_radians(vfov);
 		auto h = std::tan(theta/2);
 
-		auto viewport_height = 2 * h * focal_length;		
+		auto viewport_height = 2 * h * focus_dist;		
 		auto viewport_width = viewport_height * (double(image_width)/image_height);
 
 		w = unit_vector(lookfrom - lookat); //Vector from look-at to lookfrom
@@ -143,12 +339,12 @@ private:
 		pixel_delta_u = viewport_u / image_width;
 		pixel_delta_v = viewport_v / image_height;
 
-		auto viewport_upper_left = center - (focal_length * w) - viewport_u/2 - viewport_v/2;
+		auto viewport_upper_left = center - (focus_dist * w) - viewport_u/2 - viewport_v/2;
 		pixel00_loc = viewport_upper_left + 0.5 * (pixel_delta_u + pixel_delta_v);
 
-//		auto defocus_radius = focus_dist * std::tan(degrees_to_radians(defocus_angle / 2.0));
-//		defocus_disk_u = u * defocus_radius;
-//		defocus_disk_v = v * defocus_radius;
+		auto defocus_radius = focus_dist * std::tan(degrees_to_radians(defocus_angle / 2.0));
+		defocus_disk_u = u * defocus_radius;
+		defocus_disk_v = v * defocus_radius;
 
 		std::println("Viewport U: {}", viewport_u);
 		std::println("Viewport V: {}", viewport_v);
@@ -161,97 +357,453 @@ private:
 	}
 
 
-	void render_tile(const Hittable& world, int startWidth, int startHeight, int width, int height, std::vector<Vec3>& fb)
+	//Pixels are visited in 8x8 blocks along a Morton curve, so consecutive packets stay
+	//close together on screen. Each block row is one primary ray packet; every bounce after
+	//the first uses single rays. Returns the number of samples taken. CollectAovs also fills
+	//the first hit buffers of target.
+	template<bool CollectAovs>
+	uint64_t render_tile(const Hittable& world, const Tile& tile, Kernel& target)
 	{
-		for(int y = startHeight; y < height; y++) {
-			for(int x = startWidth; x < width; x++)
-			{
-				Vec3 pixel_color(0, 0, 0);
-				for (int sample = 0; sample < samples_per_pixel; sample++)
-				{
-					Ray r = get_ray(x, y);
-					pixel_color += ray_color(r, max_depth, world);
+		uint64_t samples = 0;
+		OccluderCache occluders;
+		occluders.reset(light_sources.size());
+		constexpr int block = packet_width;
+		const uint32_t blocks_x = (tile.width() + block - 1) / block;
+		const uint32_t blocks_y = (tile.height() + block - 1) / block;
+		const uint32_t side = std::bit_ceil(std::max(blocks_x, blocks_y));
+
+		for (uint32_t code = 0; code < side * side; code++) {
+			uint32_t bx, by;
+			morton_decode(code, bx, by);
+			if (bx >= blocks_x || by >= blocks_y) continue;
+
+			const int x = tile.x0 + static_cast<int>(bx) * block;
+			const int y0 = tile.y0 + static_cast<int>(by) * block;
+			const int count = std::min(block, tile.x1 - x);
+			for (int y = y0; y < std::min(y0 + block, tile.y1); y++)
+				samples += render_packet<CollectAovs>(world, x, y, count, target, occluders);
+		}
+		return samples;
+	}
+
+	//Samples the pixels [x, x + count) of row y until each one has converged or taken
+	//samples_per_pixel samples. Converged lanes drop out of the packet.
+	template<bool CollectAovs>
+	uint64_t render_packet(const Hittable& world, int x, int y, int count, Kernel& target, OccluderCache& occluders)
+	{
+		const bool adaptive = adaptive_threshold > 0.0;
+		unsigned active = (1u << count) - 1;
+		uint64_t taken = 0;
+
+		Vec3 pixel_color[packet_width];
+		PixelStats stats[packet_width];
+		AovSum aovs[packet_width];
+		for (int lane = 0; lane < count; lane++) pixel_color[lane] = Vec3(0, 0, 0);
+
+		const uint32_t first_pixel = static_cast<uint32_t>(y) * image_width + x;
+		for (int sample = 0; sample < samples_per_pixel && active; sample++)
+		{
+			uint32_t pixel_ids[packet_width];
+			Vec2 jitter[packet_width], lens[packet_width];
+			for (int lane = 0; lane < count; lane++) pixel_ids[lane] = first_pixel + lane;
+			camera_samples(pixel_ids, count, sample, jitter, lens);
+
+			RayPacket packet;
+			PacketHit hits;
+			for (unsigned m = active; m; m &= m - 1) {
+				const int lane = std::countr_zero(m);
+				packet.set(lane, get_ray(x + lane, y, jitter[lane], lens[lane]));
+				hits.t_max[lane] = infinity;
+			}
+
+			[[maybe_unused]] uint64_t tests = CollectAovs ? ray_stats::test_count() : 0;
+			world.hit_packet(packet, active, hits);
+			if constexpr (CollectAovs) {
+				//the packet's tests are shared evenly by its lanes.
+				const Real share = static_cast<Real>(ray_stats::test_count() - tests) / std::popcount(active);
+				for (unsigned m = active; m; m &= m - 1) aovs[std::countr_zero(m)].cost += share;
+			}
+
+			for (unsigned m = active; m; m &= m - 1) {
+				const int lane = std::countr_zero(m);
+				const Ray& r = packet.rays[lane];
+				Vec3 color;
+				if (hits.mask & (1u << lane)) {
+					hits.rec[lane].finalize(r);
+					if constexpr (CollectAovs) {
+						aovs[lane].add_hit(r, hits.rec[lane]);
+						tests = ray_stats::test_count();
+					}
+					color = trace_path(r, hits.rec[lane], world, PathId{ first_pixel + lane, static_cast<uint32_t>(sample) }, occluders);
+					if constexpr (CollectAovs) aovs[lane].cost += static_cast<Real>(ray_stats::test_count() - tests);
+				} else {
+					color = background(r);
+					if constexpr (CollectAovs) aovs[lane].add_miss(color);
+				}
+				pixel_color[lane] += color;
+				stats[lane].add(luminance(color));
+			}
+			taken += std::popcount(active);
+
+			if (adaptive && sample + 1 >= min_samples) {
+				for (unsigned m = active; m; m &= m - 1) {
+					const int lane = std::countr_zero(m);
+					if (stats[lane].converged(adaptive_threshold)) active &= ~(1u << lane);
 				}
+			}
+		}
+
+		for (int lane = 0; lane < count; lane++) {
+			const int n = stats[lane].count;
+			target.at(x + lane, y) = (n == samples_per_pixel ? pixel_samples_scale : 1.0 / n) * pixel_color[lane];
+			if (!target.samples.empty()) target.samples[target.index(x + lane, y)] = static_cast<uint32_t>(n);
+			if constexpr (CollectAovs) store_aovs(target, x + lane, y, aovs[lane], stats[lane]);
+		}
+		return taken;
+	}
+
+	//Writes the AOVs and denoiser guides of a pixel, averaged over the samples counted in stats.
+	static void store_aovs(Kernel& target, int x, int y, const AovSum& aov, const PixelStats& stats)
+	{
+		const size_t i = target.index(x, y);
+		target.albedo[i] = aov.albedo / stats.count;
+		target.normal[i] = aov.normal / stats.count;
+		target.depth[i] = aov.depth / stats.count;
+		target.variance[i] = static_cast<Real>(stats.mean_variance());
+		target.prim_id[i] = aov.id;
+		target.cost[i] = aov.cost / stats.count;
+	}
 
-				fb[y * image_width + x] = pixel_samples_scale * pixel_color;
+	//first hits are collected for the denoiser and every AOV but samples.
+	bool collects_aovs() const
+	{
+		if (denoise) return true;
+		for (size_t i = 0; i < aov_count; i++)
+			if (aov_outputs[i] && static_cast<Aov>(i) != Aov::samples) return true;
+		return false;
+	}
 
+	//One AOV of a finished band as colors. Float formats get the raw values, ids as colors;
+	//the 8 bit formats get them mapped into [0, 1] and squared against the writer's gamma,
+	//depth and cost relative to their maximum.
+	std::vector<Vec3> aov_pixels(Aov aov, const Kernel& kernel) const
+	{
+		const bool floats = stores_floats(output_format);
+		const size_t count = kernel.colors.size();
+		std::vector<Vec3> pixels(count);
+		auto scalar = [&](const std::vector<Real>& values) {
+			Real scale = 1;
+			if (!floats) {
+				const Real top = *std::max_element(values.begin(), values.end());
+				scale = top > 0 ? 1 / top : 1;
 			}
+			for (size_t i = 0; i < count; i++) pixels[i] = Vec3(values[i], values[i], values[i]) * scale;
+		};
+
+		switch (aov) {
+		case Aov::normal:
+			for (size_t i = 0; i < count; i++) pixels[i] = floats ? kernel.normal[i] : 0.5 * (kernel.normal[i] + Vec3(1, 1, 1));
+			break;
+		case Aov::depth: scalar(kernel.depth); break;
+		case Aov::albedo: pixels = kernel.albedo; break;
+		case Aov::prim_id:
+			for (size_t i = 0; i < count; i++) pixels[i] = id_color(kernel.prim_id[i]);
+			break;
+		case Aov::samples:
+			for (size_t i = 0; i < count; i++) {
+				const Real n = floats ? kernel.samples[i] : static_cast<Real>(kernel.samples[i]) / samples_per_pixel;
+				pixels[i] = Vec3(n, n, n);
+			}
+			break;
+		case Aov::cost: scalar(kernel.cost); break;
 		}
+		if (!floats)
+			for (Vec3& p : pixels) p = p * p;
+		return pixels;
 	}
 
-	Vec3 ray_color(const Ray& r, int depth, const Hittable& world) 
+	//Wavefront version of render_tile. Every sample pass generates one camera ray per active
+	//pixel of the tile, then advances all paths a bounce at a time: intersect, shade sorted
+	//by material, shadow. Gives the same estimate as trace_path, path for path.
+	template<bool CollectAovs>
+	uint64_t render_tile_wavefront(const Hittable& world, const Tile& tile, Kernel& target)
 	{
-		if (depth <= 0)
+		static thread_local WavefrontState state;
+		const int width = tile.width();
+		const size_t pixels = tile.area();
+		const bool adaptive = adaptive_threshold > 0.0;
+		uint64_t taken = 0;
+
+		state.pixel_ids.resize(pixels);
+		for (uint32_t i = 0; i < pixels; i++)
+			state.pixel_ids[i] = static_cast<uint32_t>(tile.y0 + static_cast<int>(i) / width) * image_width + tile.x0 + static_cast<int>(i) % width;
+		state.radiance.resize(pixels);
+		state.pixel_color.assign(pixels, Vec3(0, 0, 0));
+		state.stats.assign(pixels, PixelStats{});
+		state.active.resize(pixels);
+		for (uint32_t i = 0; i < pixels; i++) state.active[i] = i;
+		state.occluders.reset(light_sources.size());
+		if constexpr (CollectAovs) state.aovs.assign(pixels, AovSum{});
+
+		for (int sample = 0; sample < samples_per_pixel && !state.active.empty(); sample++)
 		{
-			return Vec3(0, 0, 0);
+			//generate
+			const size_t active = state.active.size();
+			state.sample_pixels.resize(active);
+			state.jitter.resize(active);
+			state.lens.resize(active);
+			for (size_t k = 0; k < active; k++) state.sample_pixels[k] = state.pixel_ids[state.active[k]];
+			camera_samples(state.sample_pixels.data(), active, sample, state.jitter.data(), state.lens.data());
+
+			state.paths.clear();
+			for (size_t k = 0; k < active; k++) {
+				const uint32_t i = state.active[k];
+				state.radiance[i] = Vec3(0, 0, 0);
+				state.paths.push(get_ray(tile.x0 + static_cast<int>(i) % width, tile.y0 + static_cast<int>(i) / width, state.jitter[k], state.lens[k]), Vec3(1, 1, 1), i);
+			}
+
+			//paths still alive after max_depth bounces contribute nothing, as in trace_path.
+			for (int bounce = 0; bounce < max_depth && state.paths.size() > 0; bounce++) {
+				intersect_stage<CollectAovs>(world, state, bounce == 0);
+				shade_stage(state, static_cast<uint32_t>(sample), static_cast<uint32_t>(bounce));
+				shadow_stage<CollectAovs>(world, state);
+				std::swap(state.paths, state.next);
+			}
+
+			for (uint32_t i : state.active) {
+				state.pixel_color[i] += state.radiance[i];
+				state.stats[i].add(luminance(state.radiance[i]));
+			}
+			taken += state.active.size();
+
+			if (adaptive && sample + 1 >= min_samples)
+				std::erase_if(state.active, [&](uint32_t i) { return state.stats[i].converged(adaptive_threshold); });
 		}
 
-		HitRecord rec;
-		if (world.hit(r, Interval(0.001, infinity), rec))
-		{
-			//We've hit something in the world
-			Vec3 output(0.0, 0.0, 0.0);
-			Ray scattered;
-			Vec3 attenuation;
-			if (rec.mat->scatter(r, rec, attenuation, scattered))
-				output = attenuation * ray_color(scattered, depth-1, world);
-					
-			//We need to now attenuate the reflected light if there exists a shadow on this point.
-			//First, we should create a ray that points to a light source whose origin is the hit point.
-			for(auto& light_center : light_sources) {
-				//we need to get the Direction vector, i.e. a normal from the point to the light center
-				auto difference_vector = light_center - rec.p; //the vector from point P to light
-				Vec3 dir = unit_vector(difference_vector); 
-				Ray ray(rec.p, dir);
-				//Ok, we need to now check if this shadow ray intersects with anything in the world!
-				HitRecord shadow_hit;
-				if (world.hit(ray, Interval(0.001, infinity), shadow_hit)) {
-					//we hit something! we should dampen the output color now I guess?
-					output *= 0.4;
+		for (uint32_t i = 0; i < pixels; i++) {
+			const int x = tile.x0 + static_cast<int>(i) % width, y = tile.y0 + static_cast<int>(i) / width;
+			const int n = state.stats[i].count;
+			target.at(x, y) = (n == samples_per_pixel ? pixel_samples_scale : 1.0 / n) * state.pixel_color[i];
+			if (!target.samples.empty()) target.samples[target.index(x, y)] = static_cast<uint32_t>(n);
+			if constexpr (CollectAovs) store_aovs(target, x, y, state.aovs[i], state.stats[i]);
+		}
+		return taken;
+	}
+
+	//Finds the closest hit of every path. Misses pick up the background right away; hits are
+	//finalized and listed in hit_paths. Camera rays are coherent enough to go as packets.
+	//With CollectAovs, camera rays also feed the first hit AOVs and every ray its cost.
+	template<bool CollectAovs>
+	void intersect_stage(const Hittable& world, WavefrontState& state, bool coherent)
+	{
+		PathQueue& paths = state.paths;
+		state.hits.resize(paths.size());
+		state.hit_paths.clear();
+
+		auto miss = [&](size_t i, const Ray& r) {
+			const Vec3 color = background(r);
+			state.radiance[paths.pixel[i]] += paths.throughput[i] * color;
+			if constexpr (CollectAovs)
+				if (coherent) state.aovs[paths.pixel[i]].add_miss(color);
+		};
+
+		if (coherent) {
+			for (size_t base = 0; base < paths.size(); base += packet_width) {
+				const int count = static_cast<int>(std::min<size_t>(packet_width, paths.size() - base));
+				RayPacket packet;
+				PacketHit hits;
+				for (int lane = 0; lane < count; lane++) {
+					packet.set(lane, paths.ray(base + lane));
+					hits.t_max[lane] = infinity;
+				}
+				[[maybe_unused]] const uint64_t tests = CollectAovs ? ray_stats::test_count() : 0;
+				world.hit_packet(packet, (1u << count) - 1, hits);
+				if constexpr (CollectAovs) {
+					const Real share = static_cast<Real>(ray_stats::test_count() - tests) / count;
+					for (int lane = 0; lane < count; lane++) state.aovs[paths.pixel[base + lane]].cost += share;
+				}
+
+				for (int lane = 0; lane < count; lane++) {
+					const size_t i = base + lane;
+					if (!(hits.mask & (1u << lane))) {
+						miss(i, packet.rays[lane]);
+						continue;
+					}
+					state.hits[i] = hits.rec[lane];
+					state.hits[i].finalize(packet.rays[lane]);
+					if constexpr (CollectAovs) state.aovs[paths.pixel[i]].add_hit(packet.rays[lane], state.hits[i]);
+					state.hit_paths.push_back(ShadeItem{ state.hits[i].mat, static_cast<uint32_t>(i) });
 				}
 			}
+			return;
+		}
+
+		for (size_t i = 0; i < paths.size(); i++) {
+			const Ray r = paths.ray(i);
+			[[maybe_unused]] const uint64_t tests = CollectAovs ? ray_stats::test_count() : 0;
+			const bool hit = world.hit(r, Interval(0.001, infinity), state.hits[i]);
+			if constexpr (CollectAovs) state.aovs[paths.pixel[i]].cost += static_cast<Real>(ray_stats::test_count() - tests);
+			if (!hit) {
+				miss(i, r);
+				continue;
+			}
+			state.hits[i].finalize(r);
+			state.hit_paths.push_back(ShadeItem{ state.hits[i].mat, static_cast<uint32_t>(i) });
+		}
+	}
+
+	//Scatters every hit, one material after the other, and compacts the paths that go on
+	//into next. Each path restarts the sampler as trace_path does, so both integrators
+	//draw the same numbers for the same path.
+	void shade_stage(WavefrontState& state, uint32_t sample, uint32_t bounce)
+	{
+		std::sort(state.hit_paths.begin(), state.hit_paths.end(), [](const ShadeItem& a, const ShadeItem& b) {
+			return std::less<const Material*>()(a.mat, b.mat);
+		});
+
+		state.next.clear();
+		state.vertices.clear();
+		for (const ShadeItem& item : state.hit_paths) {
+			const uint32_t i = item.path;
+			const HitRecord& rec = state.hits[i];
+			Ray scattered;
+			Vec3 attenuation;
+			thread_sampler().begin_bounce(sampler, state.pixel_ids[state.paths.pixel[i]], image_width, sample, bounce);
+			if (!rec.mat->scatter(state.paths.ray(i), rec, attenuation, scattered)) continue;
+			if (static_cast<int>(bounce) + 1 >= max_depth) continue;
+
+			Vec3 throughput = state.paths.throughput[i] * attenuation;
+			if (!survives_roulette(throughput, static_cast<int>(bounce))) continue;
+
+			state.next.push(scattered, throughput, state.paths.pixel[i]);
+			state.vertices.push_back(rec.p);
+		}
+	}
+
+	//Darkens the paths in next whose vertex is hidden from a light, like trace_path does.
+	template<bool CollectAovs>
+	void shadow_stage(const Hittable& world, WavefrontState& state)
+	{
+		if (light_sources.empty()) return;
 
-			return output;
+		for (size_t i = 0; i < state.next.size(); i++) {
+			[[maybe_unused]] const uint64_t tests = CollectAovs ? ray_stats::test_count() : 0;
+			for (size_t light = 0; light < light_sources.size(); light++)
+				if (in_shadow(world, state.vertices[i], light, state.occluders)) state.next.throughput[i] *= 0.4;
+			if constexpr (CollectAovs) state.aovs[state.next.pixel[i]].cost += static_cast<Real>(ray_stats::test_count() - tests);
 		}
+	}
+
+	//Image pixel index and sample number of the path being traced, they seed its random
+	//stream.
+	struct PathId {
+		uint32_t pixel;
+		uint32_t sample;
+	};
+
+	//Follows a path from its first hit rec along r until it escapes, is absorbed, runs out of
+	//bounces or loses the roulette. The path's throughput is carried along instead of
+	//multiplied in on the way back up, so the depth costs no stack.
+	Vec3 trace_path(Ray r, HitRecord rec, const Hittable& world, PathId path, OccluderCache& occluders)
+	{
+		Vec3 throughput(1.0, 1.0, 1.0);
+		for (int bounce = 0; ; bounce++) {
+			//every bounce draws from its own dimensions, independent of the tile and thread.
+			thread_sampler().begin_bounce(sampler, path.pixel, image_width, path.sample, bounce);
+
+			Ray scattered;
+			Vec3 attenuation;
+			if (!rec.mat->scatter(r, rec, attenuation, scattered)) return Vec3(0, 0, 0);
+			//the path would leave with no bounces left.
+			if (bounce + 1 >= max_depth) return Vec3(0, 0, 0);
+
+			throughput = throughput * attenuation;
+			if (!survives_roulette(throughput, bounce)) return Vec3(0, 0, 0);
+
+			//Darken the path for every light source the hit point is hidden from.
+			for (size_t light = 0; light < light_sources.size(); light++)
+				if (in_shadow(world, rec.p, light, occluders)) throughput *= 0.4;
+
+			r = scattered;
+			if (!world.hit(r, Interval(0.001, infinity), rec)) return throughput * background(r);
+			rec.finalize(r);
+		}
+	}
+
+	//Is the light hidden from p? Only what lies between the two counts.
+	bool in_shadow(const Hittable& world, const Point3D& p, size_t light, OccluderCache& occluders) const
+	{
+		const Vec3 to_light = light_sources[light] - p;
+		const Real distance = to_light.length();
+		return occluders.occluded(world, Ray(p, to_light / distance), Interval(0.001, distance), light);
+	}
+
+	//Russian roulette after bounce: from rr_min_depth on, a path goes on with the probability
+	//of its brightest throughput channel, at most 0.95, and is weighted up by the inverse so
+	//the estimate stays unbiased. Dark paths mostly end here instead of at max_depth.
+	bool survives_roulette(Vec3& throughput, int bounce) const
+	{
+		if (bounce < rr_min_depth) return true;
 
+		const double p = std::min<double>(0.95, std::max({ throughput.x(), throughput.y(), throughput.z() }));
+		if (sample_1d() >= p) return false;
+		throughput /= p;
+		return true;
+	}
+
+	Vec3 background(const Ray& r) const
+	{
 		auto unit_direction = unit_vector(r.direction());
 		auto a = 0.5 * (unit_direction.y() + 1.0);
 		//lerp - from 0 to a, from value to value. 
 		return (1.0 - a)*Vec3(1.0, 1.0, 1.0) + a *Vec3(0.5, 0.7, 1.0);	
 	}
 
-	Ray get_ray(int i, int j) {
-		//generates a ray for pixel i, and j
-		//generate a random jitter - small random offset within the pixel
-		double jitter_i = random_double(-0.5, 0.5);
-		double jitter_j = random_double(-0.5, 0.5);
+	//Pixel jitter (dimension pair 0) and lens position (pair 1) of one sample for count
+	//image pixels. The random sampler hashes them 8 pixels at a time.
+	void camera_samples(const uint32_t* pixels, size_t count, uint32_t sample, Vec2* jitter, Vec2* lens) const
+	{
+		const bool defocus = defocus_angle > 0;
+		if (sampler == SamplerType::random) {
+			for (size_t base = 0; base < count; base += 8) {
+				const size_t n = std::min<size_t>(8, count - base);
+				uint32_t keys[8]{};
+				float values[4][8];
+				for (size_t k = 0; k < n; k++) keys[k] = rng::sample_key(pixels[base + k], sample);
+				for (uint32_t dim = 0; dim < (defocus ? 4u : 2u); dim++) rng::uniform_batch(keys, n, dim, values[dim]);
+				for (size_t k = 0; k < n; k++) {
+					jitter[base + k] = Vec2(values[0][k], values[1][k]);
+					lens[base + k] = defocus ? Vec2(values[2][k], values[3][k]) : Vec2(0.5, 0.5);
+				}
+			}
+			return;
+		}
+
+		for (size_t k = 0; k < count; k++) {
+			const uint32_t x = pixels[k] % image_width, y = pixels[k] / image_width;
+			jitter[k] = sample_pair(sampler, pixels[k], x, y, sample, 0);
+			lens[k] = defocus ? sample_pair(sampler, pixels[k], x, y, sample, 1) : Vec2(0.5, 0.5);
+		}
+	}
+
+	//generates a ray for pixel i, and j. jitter in [0, 1)^2 places it inside the pixel, lens
+	//on the defocus disk.
+	Ray get_ray(int i, int j, const Vec2& jitter, const Vec2& lens) {
+		//jitter - small offset within the pixel
+		double jitter_i = jitter.x() - 0.5;
+		double jitter_j = jitter.y() - 0.5;
 		auto pixel_center = pixel00_loc + ((i + jitter_i) * pixel_delta_u) + ((j + jitter_j) * pixel_delta_v);
 
-		//auto ray_origin = (defocus_angle <= 0.1) ? center : defocus_disk_sample();
-		auto ray_origin = center;
+		auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample(lens);
 		auto ray_direction = pixel_center - ray_origin; 
 		Ray r(ray_origin, ray_direction);
 
 		return r;
 	}
 
-	//
-	// Point3D defocus_disk_sample() const {
-	// 	auto p = random_in_unit_disk();
-	// 	return center + (p.x() * defocus_disk_u) + (p.y() * defocus_disk_v);
-	// }
-	
-	void write_color(std::ostream& out, const Vec3& color)
-	{
-		Color c(color);
-		out << c << ' ' << std::endl;
-	}
-	
-	void write_kernel(std::ostream& out, const Kernel& kernel)
-	{
-		for(const auto& color : kernel.colors) {
-			write_color(out, color);
-		}	
+	Point3D defocus_disk_sample(const Vec2& lens) const {
+		auto p = square_to_unit_disk(lens);
+		return center + (p.x() * defocus_disk_u) + (p.y() * defocus_disk_v);
 	}
 }; 
 
@@ -2,7 +2,7 @@
 
 #include <cmath>
 #include <limits>
-#include <random>
+#include "random.hpp"
 
 const double infinity = std::numeric_limits<double>::infinity();
 const double pi = 3.14159265;
@@ -11,11 +11,10 @@ inline double degrees_to_radians(double degrees) {
 	return degrees * pi / 180.0;
 }
 
-//generates a random double between 0 and 1.0, [0.0, 1.0)
+//generates a random double between 0 and 1.0, [0.0, 1.0), from this thread's stream.
+//The camera reseeds the stream for every bounce of every path, see rng::path_seed.
 inline double random_double() {
-	thread_local std::mt19937 generator;
-	static thread_local std::uniform_real_distribution<double> distribution(0.0, 1.0);
-	return distribution(generator);
+	return thread_rng().next_double();
 }
 
 //generates a random double between [min, max)
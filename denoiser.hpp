@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "pixel_stats.hpp"
+#include "thread_pool.hpp"
+#include "vec.hpp"
+
+//Per pixel inputs of the denoiser besides the image, each width x height values.
+struct DenoiseGuides {
+	const Vec3* albedo;
+	const Vec3* normal;
+	const Real* depth;
+	const Real* variance; //of the pixel's mean luminance, see PixelStats::mean_variance
+};
+
+//Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with the variance steered
+//luminance weight of SVGF (Schied et al. 2017). Every pass applies a 5x5 B3 spline kernel
+//whose taps lie 2^i pixels apart, so four passes cover a 61 pixel footprint with 25 taps
+//each. A tap is weighted down where its albedo, normal or depth differ from the center
+//pixel, and where its luminance differs by more than the center's noise explains. The
+//variance is filtered along with the image, so later passes trust the colors more.
+class Denoiser {
+public:
+	int iterations = 4;
+	Real sigma_luminance = 4; // Luminance difference tolerated, in standard errors of the center pixel
+	Real sigma_albedo = 0.1;
+	Real sigma_normal = 0.3; // Length of the normal difference, 0.3 is about 17 degrees
+	Real sigma_depth = 0.05; // Depth difference per pixel of tap distance, relative to the center depth
+
+	//Filters the width x height image in colors in place. The image is cut into
+	//tile x tile blocks for the pool.
+	void run(ThreadPool& pool, int width, int height, Vec3* colors, const DenoiseGuides& guides) const
+	{
+		constexpr int tile = 32;
+		const size_t count = static_cast<size_t>(width) * height;
+		std::vector<Vec3> buffer(count);
+		std::vector<Real> variance[2] = { std::vector<Real>(guides.variance, guides.variance + count), std::vector<Real>(count) };
+		const int tiles_x = (width + tile - 1) / tile;
+		const int tiles_y = (height + tile - 1) / tile;
+
+		//ping-pong between the image and the buffer, the image is free after the first pass.
+		Vec3* src = colors;
+		Vec3* dst = buffer.data();
+		for (int pass = 0; pass < iterations; pass++) {
+			const Pass p{ 1 << pass, width, height, src, variance[pass & 1].data(), dst, variance[(pass + 1) & 1].data() };
+			pool.parallel_for(0, static_cast<size_t>(tiles_x) * tiles_y, 1, [&](size_t t) {
+				const int x0 = static_cast<int>(t % tiles_x) * tile, y0 = static_cast<int>(t / tiles_x) * tile;
+				for (int y = y0; y < std::min(y0 + tile, height); y++)
+					for (int x = x0; x < std::min(x0 + tile, width); x++)
+						filter_pixel(p, guides, x, y);
+			});
+			std::swap(src, dst);
+		}
+		if (src != colors) std::copy(src, src + count, colors);
+	}
+
+private:
+	struct Pass {
+		int step;
+		int width, height;
+		const Vec3* src;
+		const Real* src_variance;
+		Vec3* dst;
+		Real* dst_variance;
+	};
+
+	//3x3 Gaussian of the variance around a pixel. A few samples can all agree by chance, so
+	//a pixel's own variance is too unreliable to steer the luminance weight alone.
+	static Real local_variance(const Pass& pass, int x, int y)
+	{
+		static constexpr Real gauss[2] = { Real(1) / 2, Real(1) / 4 };
+		Real sum = 0, weight_sum = 0;
+		for (int dy = -1; dy <= 1; dy++) {
+			const int qy = y + dy;
+			if (qy < 0 || qy >= pass.height) continue;
+			for (int dx = -1; dx <= 1; dx++) {
+				const int qx = x + dx;
+				if (qx < 0 || qx >= pass.width) continue;
+				const Real w = gauss[std::abs(dx)] * gauss[std::abs(dy)];
+				sum += w * pass.src_variance[static_cast<size_t>(qy) * pass.width + qx];
+				weight_sum += w;
+			}
+		}
+		return sum / weight_sum;
+	}
+
+	void filter_pixel(const Pass& pass, const DenoiseGuides& guides, int x, int y) const
+	{
+		static constexpr Real spline[3] = { Real(3) / 8, Real(1) / 4, Real(1) / 16 };
+		const Real inv_albedo = 1 / (sigma_albedo * sigma_albedo);
+		const Real inv_normal = 1 / (sigma_normal * sigma_normal);
+
+		const size_t p = static_cast<size_t>(y) * pass.width + x;
+		const Real luminance_p = static_cast<Real>(luminance(pass.src[p]));
+		const Real luminance_scale = 1 / (sigma_luminance * std::sqrt(local_variance(pass, x, y)) + Real(1e-4));
+		const Real depth_scale = 1 / (sigma_depth * pass.step * guides.depth[p] + Real(1e-4));
+
+		Vec3 sum(0, 0, 0);
+		Real weight_sum = 0, variance_sum = 0;
+		for (int dy = -2; dy <= 2; dy++) {
+			const int qy = y + dy * pass.step;
+			if (qy < 0 || qy >= pass.height) continue;
+			for (int dx = -2; dx <= 2; dx++) {
+				const int qx = x + dx * pass.step;
+				if (qx < 0 || qx >= pass.width) continue;
+
+				const size_t q = static_cast<size_t>(qy) * pass.width + qx;
+				const Vec3 da = guides.albedo[q] - guides.albedo[p];
+				const Vec3 dn = guides.normal[q] - guides.normal[p];
+				const Real exponent = std::abs(static_cast<Real>(luminance(pass.src[q])) - luminance_p) * luminance_scale
+					+ dot(da, da) * inv_albedo + dot(dn, dn) * inv_normal
+					+ std::abs(guides.depth[q] - guides.depth[p]) * depth_scale;
+				const Real w = spline[std::abs(dx)] * spline[std::abs(dy)] * std::exp(-exponent);
+				sum += w * pass.src[q];
+				weight_sum += w;
+				variance_sum += w * w * pass.src_variance[q];
+			}
+		}
+		//the center tap always has weight spline[0]^2, so weight_sum is never zero.
+		pass.dst[p] = sum / weight_sum;
+		pass.dst_variance[p] = variance_sum / (weight_sum * weight_sum);
+	}
+};
@@ -1,18 +1,33 @@
 #pragma once
 
+#include <bit>
+#include <cstdint>
 #include <memory>
+#include <type_traits>
+#include <vector>
+#include "aabb.hpp"
 #include "interval.hpp"
 #include "ray.hpp"
+#include "ray_packet.hpp"
+#include "ray_stats.hpp"
 
+class Hittable;
 class Material;
 
+//Hittable::hit() only fills t, object and prim (plus whatever the object needs to finish
+//the record, e.g. barycentrics in uv). finalize() computes the rest for the closest hit.
 struct HitRecord {
 	Point3D p; //point of contact
 	Vec3 normal; //surface normal
-	std::shared_ptr<Material> mat; //hit material
-	double t; //the t value that solved the hit equation.
+	const Material* mat; //hit material, owned by the scene's MaterialRegistry
+	Real t; //the t value that solved the hit equation.
 	bool front_face; //are we facing the front?
 	Vec2 uv;
+	const Hittable* object; //primitive that owns the hit
+	uint32_t prim; //sub-primitive of object, e.g. the face of a mesh
+
+	//fills p, normal, front_face, uv and mat for the ray r that produced the hit.
+	void finalize(const Ray& r);
 
 
 	void set_face_normal(const Ray& r, const Vec3& outward_normal) {
@@ -23,9 +38,82 @@ struct HitRecord {
 	}
 };
 
+//records are copied on every closer hit, keep them free of refcounts.
+static_assert(std::is_trivially_copyable_v<HitRecord>);
+
+//Closest hits of a RayPacket. t_max holds the current upper bound of every lane and
+//mask the lanes that have found a hit so far.
+struct PacketHit {
+	HitRecord rec[packet_width];
+	Real t_max[packet_width];
+	unsigned mask = 0;
+};
+
 class Hittable {
 public:
 	virtual ~Hittable() = default;
 
+	//Closest hit query, cheap enough to run for every candidate: sets t, object and prim.
 	virtual bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const = 0;
+
+	//Completes a record that hit() filled in with object == this.
+	virtual void finalize(const Ray&, HitRecord&) const {}
+
+	//Any hit query for shadow rays: is there a hit in ray_t at all? Stops at the first one
+	//found instead of searching for the closest.
+	virtual bool occluded(const Ray& r, Interval ray_t) const {
+		HitRecord rec;
+		return hit(r, ray_t, rec);
+	}
+
+	//occluded() that also names the primitive it stopped at, nullptr when nothing is in the
+	//way. Aggregates return the child, so a caller can test that one first next time.
+	virtual const Hittable* occluder(const Ray& r, Interval ray_t) const {
+		return occluded(r, ray_t) ? this : nullptr;
+	}
+
+	//Intersects the lanes of a packet selected by the lanes bit mask. The default traces
+	//each lane on its own; primitives and acceleration structures override it with SIMD.
+	virtual void hit_packet(const RayPacket& packet, unsigned lanes, PacketHit& hits) const {
+		while (lanes) {
+			int lane = std::countr_zero(lanes);
+			lanes &= lanes - 1;
+			if (hit(packet.rays[lane], Interval(packet.t_min, hits.t_max[lane]), hits.rec[lane])) {
+				hits.t_max[lane] = hits.rec[lane].t;
+				hits.mask |= 1u << lane;
+			}
+		}
+	}
+
+	virtual AABB bounding_box() const = 0;
+
+	//Position of the object in the flattened scene, set once the scene is complete (Bvh
+	//numbers the list it is built over). Unlike the object's address it is the same from
+	//run to run and unique over nested lists, so ids derived from it (the prim_id AOV) are.
+	uint32_t scene_index() const { return scene_index_; }
+
+	//Numbers the object, or the objects it is made of, from next on.
+	virtual void assign_scene_indices(uint32_t& next) { scene_index_ = next++; }
+
+private:
+	uint32_t scene_index_ = 0;
+};
+
+//Per light, the occluder() that blocked the last shadow ray towards it. Shadow rays from
+//nearby points are usually blocked by the same primitive, so it is tried before the scene.
+//Keep one per thread and scene, e.g. for the span of a tile.
+struct OccluderCache {
+	std::vector<const Hittable*> last;
+
+	void reset(size_t lights) { last.assign(lights, nullptr); }
+
+	bool occluded(const Hittable& world, const Ray& r, Interval ray_t, size_t light) {
+		if (last[light] && last[light]->occluded(r, ray_t)) return true;
+		last[light] = world.occluder(r, ray_t);
+		return last[light] != nullptr;
+	}
 };
+
+inline void HitRecord::finalize(const Ray& r) {
+	object->finalize(r, *this);
+}
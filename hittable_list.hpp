@@ -13,9 +13,13 @@ public:
 	HittableList() {}
 	HittableList(std::shared_ptr<Hittable> object) { add(object); }
 
-	void clear() { objects.clear(); }
+	void clear() {
+		objects.clear();
+		bbox = AABB();
+	}
 
 	void add(std::shared_ptr<Hittable> object) {
+		bbox = AABB(bbox, object->bounding_box());
 		objects.push_back(object);
 	}
 
@@ -35,4 +39,27 @@ public:
 		return hit_anything;
 	}
 
+	bool occluded(const Ray& r, Interval ray_t) const override {
+		return occluder(r, ray_t) != nullptr;
+	}
+
+	const Hittable* occluder(const Ray& r, Interval ray_t) const override {
+		for (const auto& object : objects)
+			if (object->occluded(r, ray_t)) return object.get();
+		return nullptr;
+	}
+
+	void hit_packet(const RayPacket& packet, unsigned lanes, PacketHit& hits) const override {
+		for (const auto& object : objects)
+			object->hit_packet(packet, lanes, hits);
+	}
+
+	void assign_scene_indices(uint32_t& next) override {
+		for (const auto& object : objects) object->assign_scene_indices(next);
+	}
+
+	AABB bounding_box() const override { return bbox; }
+
+private:
+	AABB bbox;
 };
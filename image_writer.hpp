@@ -0,0 +1,465 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "color.hpp"
+#include "simd_pack.hpp"
+#include "vec.hpp"
+
+enum class ImageFormat {
+	ppm_ascii, //P3
+	ppm,       //P6
+	png,
+	pfm,
+	exr,
+};
+
+inline std::optional<ImageFormat> parse_image_format(std::string_view name) {
+	if (name == "ppm_ascii") return ImageFormat::ppm_ascii;
+	if (name == "ppm") return ImageFormat::ppm;
+	if (name == "png") return ImageFormat::png;
+	if (name == "pfm") return ImageFormat::pfm;
+	if (name == "exr") return ImageFormat::exr;
+	return std::nullopt;
+}
+
+inline std::string_view file_extension(ImageFormat format) {
+	switch (format) {
+	case ImageFormat::ppm_ascii:
+	case ImageFormat::ppm: return "ppm";
+	case ImageFormat::png: return "png";
+	case ImageFormat::pfm: return "pfm";
+	case ImageFormat::exr: return "exr";
+	}
+	return "ppm";
+}
+
+//Formats that keep linear float values instead of gamma corrected bytes.
+inline bool stores_floats(ImageFormat format) {
+	return format == ImageFormat::pfm || format == ImageFormat::exr;
+}
+
+#if HAVE_AVX2
+//truncates every lane to an integer in [0, 255] and stores it as one byte.
+inline void store_truncated_bytes(SimdPack<float> c, uint8_t* out) {
+	const __m256i q = _mm256_cvttps_epi32(c.v);
+	const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(words, words));
+}
+
+inline void store_truncated_bytes(SimdPack<double> c, uint8_t* out) {
+	__m128i q = _mm256_cvttpd_epi32(c.v);
+	q = _mm_packus_epi32(q, q);
+	q = _mm_packus_epi16(q, q);
+	const uint32_t bytes = static_cast<uint32_t>(_mm_cvtsi128_si32(q));
+	std::memcpy(out, &bytes, 4);
+}
+#endif
+
+//Gamma 2 and 8 bit quantization of count pixels into interleaved RGB bytes, with the same
+//rounding as Color(const Vec3&). Vec3 is three packed scalars, so the pixels are treated as
+//one flat array of channels and converted a RealPack at a time.
+inline void quantize_gamma(const Vec3* pixels, size_t count, uint8_t* out) {
+	static_assert(sizeof(Vec3) == 3 * sizeof(Real), "Vec3 must be three packed scalars");
+	const Real* channels = pixels[0].e;
+	const size_t n = count * 3;
+	size_t i = 0;
+
+#if HAVE_AVX2
+	using Pack = RealPack;
+	const Pack zero = Pack::zero();
+	const Pack top = Pack::broadcast(0.999);
+	const Pack scale = Pack::broadcast(256.0);
+	for (; i + Pack::width <= n; i += Pack::width) {
+		//max returns the second operand for NaN, so NaN channels become black like in Color.
+		const Pack c = min(sqrt(max(Pack::loadu(channels + i), zero)), top) * scale;
+		store_truncated_bytes(c, out + i);
+	}
+#endif
+	static const Interval intensity(0.000, 0.999);
+	for (; i < n; i++)
+		out[i] = static_cast<uint8_t>(256 * intensity.clamp(linear_to_gamma(channels[i])));
+}
+
+//Writes an image as consecutive bands of rows. begin() is called once, then write_rows()
+//top to bottom, then end(). Only the rows of the current band have to be in memory.
+//Formats with a fixed size per row are random access: their bands may arrive in any order
+//and are placed with seekp, which needs a file stream.
+class ImageWriter {
+public:
+	virtual ~ImageWriter() = default;
+
+	virtual bool random_access() const { return false; }
+
+	virtual void begin(std::ostream& out, int width, int height) {
+		width_ = width;
+		height_ = height;
+		write_header(out);
+	}
+
+	//pixels holds rows [y, y + rows) of linear color.
+	virtual void write_rows(std::ostream& out, int y, int rows, const Vec3* pixels) = 0;
+
+	virtual void end(std::ostream& out) { out.flush(); }
+
+protected:
+	int width_ = 0;
+	int height_ = 0;
+
+	virtual void write_header(std::ostream& out) = 0;
+
+	template<typename T>
+	static void write_le(std::ostream& out, T value) {
+		unsigned char bytes[sizeof(T)];
+		std::memcpy(bytes, &value, sizeof(T));
+		if constexpr (std::endian::native == std::endian::big) std::reverse(std::begin(bytes), std::end(bytes));
+		out.write(reinterpret_cast<const char*>(bytes), sizeof(T));
+	}
+
+	static void write_le(std::ostream& out, const std::vector<float>& values) {
+		if constexpr (std::endian::native == std::endian::little) {
+			out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(float)));
+		} else {
+			for (float f : values) write_le(out, f);
+		}
+	}
+};
+
+class PpmAsciiWriter : public ImageWriter {
+public:
+	void write_rows(std::ostream& out, int, int rows, const Vec3* pixels) override {
+		const size_t count = static_cast<size_t>(rows) * width_;
+		bytes_.resize(count * 3);
+		quantize_gamma(pixels, count, bytes_.data());
+
+		std::string text;
+		text.reserve(count * 12);
+		for (size_t i = 0; i < count; i++) {
+			text += std::to_string(bytes_[3 * i]) + ' ' + std::to_string(bytes_[3 * i + 1]) + ' ' + std::to_string(bytes_[3 * i + 2]) + " \n";
+		}
+		out.write(text.data(), static_cast<std::streamsize>(text.size()));
+	}
+
+private:
+	std::vector<uint8_t> bytes_;
+
+	void write_header(std::ostream& out) override {
+		out << "P3\n" << width_ << ' ' << height_ << "\n255\n";
+	}
+};
+
+class PpmWriter : public ImageWriter {
+public:
+	bool random_access() const override { return true; }
+
+	void write_rows(std::ostream& out, int y, int rows, const Vec3* pixels) override {
+		const size_t count = static_cast<size_t>(rows) * width_;
+		bytes_.resize(count * 3);
+		quantize_gamma(pixels, count, bytes_.data());
+
+		out.seekp(data_start_ + static_cast<std::streamoff>(y) * width_ * 3);
+		out.write(reinterpret_cast<const char*>(bytes_.data()), static_cast<std::streamsize>(bytes_.size()));
+	}
+
+	void end(std::ostream& out) override {
+		out.seekp(0, std::ios::end);
+		out.flush();
+	}
+
+private:
+	std::vector<uint8_t> bytes_;
+	std::streamoff data_start_ = 0;
+
+	void write_header(std::ostream& out) override {
+		out << "P6\n" << width_ << ' ' << height_ << "\n255\n";
+		data_start_ = out.tellp();
+	}
+};
+
+namespace png {
+
+inline uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+	static const auto table = [] {
+		std::array<uint32_t, 256> t{};
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			t[n] = c;
+		}
+		return t;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+inline uint32_t adler32(uint32_t adler, const uint8_t* data, size_t size) {
+	uint32_t a = adler & 0xFFFF, b = adler >> 16;
+	//5552 is the longest run before b can overflow 32 bits.
+	while (size > 0) {
+		const size_t run = std::min<size_t>(size, 5552);
+		for (size_t i = 0; i < run; i++) {
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += run;
+		size -= run;
+	}
+	return (b << 16) | a;
+}
+
+}
+
+//8 bit RGB PNG. The zlib stream uses stored (uncompressed) deflate blocks, one per IDAT
+//chunk, so rows can be written as they arrive without buffering the image.
+class PngWriter : public ImageWriter {
+public:
+	void write_rows(std::ostream& out, int, int rows, const Vec3* pixels) override {
+		const size_t row_bytes = static_cast<size_t>(width_) * 3;
+		row_.resize(row_bytes);
+		for (int r = 0; r < rows; r++) {
+			quantize_gamma(pixels + static_cast<size_t>(r) * width_, width_, row_.data());
+			const uint8_t filter = 0;
+			append(out, &filter, 1);
+			append(out, row_.data(), row_bytes);
+		}
+	}
+
+	void end(std::ostream& out) override {
+		if (!block_.empty()) flush_block(out);
+		write_chunk(out, "IEND", nullptr, 0);
+		out.flush();
+	}
+
+private:
+	static constexpr size_t max_block = 65535;
+
+	std::vector<uint8_t> row_;
+	std::vector<uint8_t> block_;
+	uint64_t remaining_ = 0; //raw bytes not yet handed to a deflate block
+	uint32_t adler_ = 1;
+	bool first_block_ = true;
+
+	void write_header(std::ostream& out) override {
+		static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		out.write(reinterpret_cast<const char*>(signature), 8);
+
+		uint8_t ihdr[13];
+		put_be(ihdr, static_cast<uint32_t>(width_));
+		put_be(ihdr + 4, static_cast<uint32_t>(height_));
+		ihdr[8] = 8;  //bit depth
+		ihdr[9] = 2;  //truecolor RGB
+		ihdr[10] = 0; //deflate
+		ihdr[11] = 0; //adaptive filtering, every row uses filter 0
+		ihdr[12] = 0; //not interlaced
+		write_chunk(out, "IHDR", ihdr, sizeof(ihdr));
+
+		remaining_ = static_cast<uint64_t>(height_) * (1 + static_cast<uint64_t>(width_) * 3);
+		adler_ = 1;
+		first_block_ = true;
+		block_.clear();
+		block_.reserve(max_block);
+	}
+
+	void append(std::ostream& out, const uint8_t* data, size_t size) {
+		while (size > 0) {
+			const size_t take = std::min(size, max_block - block_.size());
+			block_.insert(block_.end(), data, data + take);
+			data += take;
+			size -= take;
+			if (block_.size() == max_block) flush_block(out);
+		}
+	}
+
+	void flush_block(std::ostream& out) {
+		remaining_ -= block_.size();
+		const bool last = remaining_ == 0;
+		adler_ = png::adler32(adler_, block_.data(), block_.size());
+
+		std::vector<uint8_t> chunk;
+		chunk.reserve(block_.size() + 11);
+		if (first_block_) {
+			chunk.push_back(0x78); //deflate, 32K window
+			chunk.push_back(0x01); //no preset dictionary, fastest; 0x7801 is a multiple of 31
+			first_block_ = false;
+		}
+		const uint16_t len = static_cast<uint16_t>(block_.size());
+		chunk.push_back(last ? 1 : 0);
+		chunk.push_back(static_cast<uint8_t>(len & 0xFF));
+		chunk.push_back(static_cast<uint8_t>(len >> 8));
+		chunk.push_back(static_cast<uint8_t>(~len & 0xFF));
+		chunk.push_back(static_cast<uint8_t>((~len >> 8) & 0xFF));
+		chunk.insert(chunk.end(), block_.begin(), block_.end());
+		if (last) {
+			uint8_t adler[4];
+			put_be(adler, adler_);
+			chunk.insert(chunk.end(), adler, adler + 4);
+		}
+		write_chunk(out, "IDAT", chunk.data(), chunk.size());
+		block_.clear();
+	}
+
+	static void put_be(uint8_t* dst, uint32_t v) {
+		dst[0] = static_cast<uint8_t>(v >> 24);
+		dst[1] = static_cast<uint8_t>(v >> 16);
+		dst[2] = static_cast<uint8_t>(v >> 8);
+		dst[3] = static_cast<uint8_t>(v);
+	}
+
+	static void write_chunk(std::ostream& out, const char* type, const uint8_t* data, size_t size) {
+		uint8_t header[8];
+		put_be(header, static_cast<uint32_t>(size));
+		std::memcpy(header + 4, type, 4);
+		uint32_t crc = png::crc32(0, header + 4, 4);
+		if (size > 0) crc = png::crc32(crc, data, size);
+		uint8_t footer[4];
+		put_be(footer, crc);
+
+		out.write(reinterpret_cast<const char*>(header), 8);
+		if (size > 0) out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+		out.write(reinterpret_cast<const char*>(footer), 4);
+	}
+};
+
+//Portable float map: linear RGB floats, little endian, stored bottom row first.
+class PfmWriter : public ImageWriter {
+public:
+	bool random_access() const override { return true; }
+
+	void write_rows(std::ostream& out, int y, int rows, const Vec3* pixels) override {
+		const std::streamoff row_bytes = static_cast<std::streamoff>(width_) * 3 * sizeof(float);
+		row_.resize(static_cast<size_t>(width_) * 3);
+		for (int r = 0; r < rows; r++) {
+			const Vec3* src = pixels + static_cast<size_t>(r) * width_;
+			for (int x = 0; x < width_; x++)
+				for (int c = 0; c < 3; c++) row_[3 * x + c] = static_cast<float>(src[x].e[c]);
+
+			out.seekp(data_start_ + static_cast<std::streamoff>(height_ - 1 - (y + r)) * row_bytes);
+			write_le(out, row_);
+		}
+	}
+
+	void end(std::ostream& out) override {
+		out.seekp(0, std::ios::end);
+		out.flush();
+	}
+
+private:
+	std::vector<float> row_;
+	std::streamoff data_start_ = 0;
+
+	void write_header(std::ostream& out) override {
+		//a negative scale marks little endian data.
+		out << "PF\n" << width_ << ' ' << height_ << "\n-1.0\n";
+		data_start_ = out.tellp();
+	}
+};
+
+//OpenEXR scanline image, uncompressed 32 bit float R, G, B with one scanline per block.
+//Every block has the same size, so the offset table is known before any pixel is written.
+class ExrWriter : public ImageWriter {
+public:
+	bool random_access() const override { return true; }
+
+	void write_rows(std::ostream& out, int y, int rows, const Vec3* pixels) override {
+		row_.resize(static_cast<size_t>(width_) * 3);
+		out.seekp(first_block_ + static_cast<std::streamoff>(y) * block_bytes());
+		for (int r = 0; r < rows; r++) {
+			const Vec3* src = pixels + static_cast<size_t>(r) * width_;
+			//channels are stored one after another in alphabetical order: B, G, R.
+			for (int c = 0; c < 3; c++)
+				for (int x = 0; x < width_; x++) row_[static_cast<size_t>(c) * width_ + x] = static_cast<float>(src[x].e[2 - c]);
+
+			write_le(out, static_cast<int32_t>(y + r));
+			write_le(out, static_cast<int32_t>(row_.size() * sizeof(float)));
+			write_le(out, row_);
+		}
+	}
+
+	void end(std::ostream& out) override {
+		out.seekp(0, std::ios::end);
+		out.flush();
+	}
+
+private:
+	std::vector<float> row_;
+	std::streamoff first_block_ = 0;
+
+	std::streamoff block_bytes() const { return 8 + static_cast<std::streamoff>(width_) * 3 * sizeof(float); }
+
+	void write_header(std::ostream& out) override {
+		write_le(out, static_cast<uint32_t>(20000630)); //magic
+		write_le(out, static_cast<uint32_t>(2));        //version 2, single part scanline
+
+		auto attribute = [&](std::string_view name, std::string_view type, uint32_t size) {
+			out.write(name.data(), static_cast<std::streamsize>(name.size()));
+			out.put('\0');
+			out.write(type.data(), static_cast<std::streamsize>(type.size()));
+			out.put('\0');
+			write_le(out, size);
+		};
+
+		attribute("channels", "chlist", 3 * 18 + 1);
+		for (const char* channel : { "B", "G", "R" }) {
+			out.write(channel, 2);                   //name and terminator
+			write_le(out, static_cast<int32_t>(2)); //FLOAT
+			write_le(out, static_cast<uint32_t>(0)); //pLinear and reserved
+			write_le(out, static_cast<int32_t>(1));  //x sampling
+			write_le(out, static_cast<int32_t>(1));  //y sampling
+		}
+		out.put('\0');
+
+		attribute("compression", "compression", 1);
+		out.put('\0'); //NO_COMPRESSION
+
+		for (std::string_view window : { "dataWindow", "displayWindow" }) {
+			attribute(window, "box2i", 16);
+			write_le(out, static_cast<int32_t>(0));
+			write_le(out, static_cast<int32_t>(0));
+			write_le(out, static_cast<int32_t>(width_ - 1));
+			write_le(out, static_cast<int32_t>(height_ - 1));
+		}
+
+		attribute("lineOrder", "lineOrder", 1);
+		out.put('\0'); //INCREASING_Y
+
+		attribute("pixelAspectRatio", "float", 4);
+		write_le(out, 1.0f);
+
+		attribute("screenWindowCenter", "v2f", 8);
+		write_le(out, 0.0f);
+		write_le(out, 0.0f);
+
+		attribute("screenWindowWidth", "float", 4);
+		write_le(out, 1.0f);
+
+		out.put('\0'); //end of header
+
+		first_block_ = static_cast<std::streamoff>(out.tellp()) + static_cast<std::streamoff>(height_) * 8;
+		for (int y = 0; y < height_; y++)
+			write_le(out, static_cast<uint64_t>(first_block_ + y * block_bytes()));
+	}
+};
+
+inline std::unique_ptr<ImageWriter> make_image_writer(ImageFormat format) {
+	switch (format) {
+	case ImageFormat::ppm_ascii: return std::make_unique<PpmAsciiWriter>();
+	case ImageFormat::ppm: return std::make_unique<PpmWriter>();
+	case ImageFormat::png: return std::make_unique<PngWriter>();
+	case ImageFormat::pfm: return std::make_unique<PfmWriter>();
+	case ImageFormat::exr: return std::make_unique<ExrWriter>();
+	}
+	return std::make_unique<PpmWriter>();
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <bit>
+#include <memory>
+#include "hittable.hpp"
+#include "transform.hpp"
+
+//A shared object placed in the scene by an affine transform. Rays are carried into the
+//object's space and intersected there; an affine map keeps the ray parameter, so t needs
+//no conversion. Only finalize() maps the point and normal back. Any number of instances
+//can share one object, so scenes cost memory per unique mesh rather than per copy.
+//
+//The object has to report itself as rec.object from hit(), as Object, Sphere, SphereSet,
+//Plane and Instance do; group several primitives into one Object before instancing them.
+class Instance : public Hittable {
+public:
+	//mat, when given, replaces the object's material on this instance.
+	Instance(std::shared_ptr<const Hittable> object, const Transform& to_world, const Material* mat = nullptr)
+		: object_(std::move(object)), to_world_(to_world), to_object_(to_world.inverse()), mat_(mat) {
+		const AABB box = object_->bounding_box();
+		if (!box.is_bounded()) {
+			bbox_ = AABB::universe;
+			return;
+		}
+		for (int corner = 0; corner < 8; corner++) {
+			const Point3D p(corner & 1 ? box.x.high : box.x.low, corner & 2 ? box.y.high : box.y.low, corner & 4 ? box.z.high : box.z.low);
+			const Point3D q = to_world_.point(p);
+			bbox_ = AABB(bbox_, AABB(q, q));
+		}
+	}
+
+	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+		if (!object_->hit(to_object(r), ray_t, rec)) return false;
+		rec.object = this;
+		return true;
+	}
+
+	bool occluded(const Ray& r, Interval ray_t) const override {
+		return object_->occluded(to_object(r), ray_t);
+	}
+
+	//moves the lanes into object space and lets the object trace them as a packet. Lanes
+	//whose bound shrank were hit by this instance.
+	void hit_packet(const RayPacket& packet, unsigned lanes, PacketHit& hits) const override {
+		RayPacket local;
+		local.t_min = packet.t_min;
+		Real t_max[packet_width];
+		for (unsigned m = lanes; m; m &= m - 1) {
+			const int lane = std::countr_zero(m);
+			local.set(lane, to_object(packet.rays[lane]));
+			t_max[lane] = hits.t_max[lane];
+		}
+
+		object_->hit_packet(local, lanes, hits);
+		for (unsigned m = lanes; m; m &= m - 1) {
+			const int lane = std::countr_zero(m);
+			if (hits.t_max[lane] < t_max[lane]) hits.rec[lane].object = this;
+		}
+	}
+
+	//the object finishes the record in its own space; the normal goes back through the
+	//inverse transpose. front_face carries over, dot(d, n) is the same in both spaces.
+	void finalize(const Ray& r, HitRecord& rec) const override {
+		rec.object = object_.get();
+		object_->finalize(to_object(r), rec);
+		rec.object = this;
+		rec.p = r.at(rec.t);
+		rec.normal = unit_vector(to_object_.transposed_vector(rec.normal));
+		if (mat_) rec.mat = mat_;
+	}
+
+	AABB bounding_box() const override { return bbox_; }
+
+	const Hittable& object() const { return *object_; }
+	const Transform& to_world() const { return to_world_; }
+
+private:
+	Ray to_object(const Ray& r) const {
+		return Ray(to_object_.point(r.origin()), to_object_.vector(r.direction()));
+	}
+
+	std::shared_ptr<const Hittable> object_;
+	Transform to_world_;
+	Transform to_object_;
+	const Material* mat_;
+	AABB bbox_;
+};
@@ -1,35 +1,49 @@
 #pragma once
 
 #include "constants.hpp"
+#include "real.hpp"
 
-class Interval {
+template<typename T>
+class IntervalT {
 public:
-	double low, high;
+	T low, high;
 
-	Interval() : low(-infinity), high(infinity) {}
-	Interval(double low, double high) : low(low), high(high) {}
+	IntervalT() : low(-infinity), high(infinity) {}
+	IntervalT(T low, T high) : low(low), high(high) {}
 
-	bool contains(double val) const {
+	//the tightest interval enclosing both a and b
+	IntervalT(const IntervalT& a, const IntervalT& b) : low(a.low <= b.low ? a.low : b.low), high(a.high >= b.high ? a.high : b.high) {}
+
+	bool contains(T val) const {
 		return (val >= low && val <= high);
 	}
 	
-	double size() const {
+	T size() const {
 		return high - low;
 	}
 	
-	bool surrounds(double x) const {
+	bool surrounds(T x) const {
 		return x > low && x < high;
 	}
 
-	double clamp(double x) const {
+	T clamp(T x) const {
 		if (x < low) return low;
 		if (x > high) return high;
 		return x;
 	}
+
+	IntervalT expand(T delta) const {
+		auto padding = delta / 2;
+		return IntervalT(low - padding, high + padding);
+	}
 	
-	static const Interval empty, universe;
+	static const IntervalT empty, universe;
 	
 };
 
-const Interval Interval::empty = Interval(+infinity, -infinity);
-const Interval Interval::universe = Interval();
+template<typename T>
+inline const IntervalT<T> IntervalT<T>::empty = IntervalT<T>(+infinity, -infinity);
+template<typename T>
+inline const IntervalT<T> IntervalT<T>::universe = IntervalT<T>();
+
+using Interval = IntervalT<Real>;
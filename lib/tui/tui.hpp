@@ -1,7 +1,9 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <mutex>
 
 namespace tui {
 
@@ -14,14 +16,20 @@ inline constexpr std::string reset = "\033[0m";
 class LoadingIndicator {
 public:
 
-	explicit LoadingIndicator(int work_units) : _work_units(work_units) {}
+	explicit LoadingIndicator(int64_t work_units) : _work_units(work_units) {}
 
+	//Safe to call from several threads: the redraws are serialized, and the progress is
+	//read under the lock, so the bar never goes backwards. Unchanged percentages are not
+	//redrawn.
 	void render() {
+		std::lock_guard lk(_render_mutex);
 		const double progress = _work_progress.load(std::memory_order_relaxed) / static_cast<double>(_work_units);
+		int percentage = static_cast<int>(progress * 100.0 + 0.5);
+		if (percentage == _drawn_percentage) return;
+		_drawn_percentage = percentage;
 		int filled = static_cast<int>(progress * _width + 0.5);
 		std::string bar(filled, '=');
 		bar.resize(_width, ' ');
-		int percentage = static_cast<int>(progress * 100.0 + 0.5);
 
 		//|r here tells the cursor to go to the beginning of the line, allows us to rewrite existing
 		//text from the buffer
@@ -34,9 +42,18 @@ public:
 		render();
 		return *this;
 	}
+
+	LoadingIndicator& operator+=(int64_t units) {
+		_work_progress.fetch_add(units, std::memory_order_relaxed);
+		render();
+		return *this;
+	}
 private:
-	std::atomic_int _work_progress = 0;
-	int _work_units;
+	//64 bit, a frame of pixels can pass INT_MAX.
+	std::atomic<int64_t> _work_progress = 0;
+	int64_t _work_units;
+	std::mutex _render_mutex;
+	int _drawn_percentage = -1; //guarded by _render_mutex
 
 	const int _width = 50;
 };
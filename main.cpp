@@ -1,7 +1,9 @@
+#include <array>
 #include <memory>
 #include <optional>
 #include <print>
 #include <random>
+#include <ranges>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -10,10 +12,14 @@
 #include "constants.hpp"
 #include "material.hpp"
 #include "hittable_list.hpp"
+#include "bvh.hpp"
+#include "instance.hpp"
 #include "object.hpp"
 #include "sphere.hpp"
+#include "sphere_set.hpp"
 #include "plane.hpp"
 #include "camera.hpp"
+#include "image_writer.hpp"
 #include "lib/cfg/config.hpp"
 #include "texture.hpp"
 
@@ -24,8 +30,21 @@ struct Config {
 	int image_width = 600;
 	double vfov = 90.0;
 	double focus_dist = 2.0;
-	double defocus_angle = 10.0;
+	double defocus_angle = 0.0;
 	int maximum_depth = 10;
+	int rr_min_depth = 3;
+	int tile_size = 0;
+	std::string output_format = "ppm";
+	bool stream_output = true;
+	double adaptive_threshold = 0.0; // 0 samples every pixel fully; e.g. 0.005 opts in to adaptive sampling
+	int min_samples = 16;
+	bool sample_heatmap = false;
+	std::string scene = "test";
+	std::string integrator = "recursive";
+	std::string sampler = "random"; // random, or opt in to sobol or blue_noise, see sampler.hpp
+	bool denoise = false;
+	std::string aovs = ""; // Comma separated AOV names, see aov.hpp
+	std::string mesh_vertices = "full"; // full, float or quantized, see vertex_buffer.hpp
 };
 
 Config parse_args(int arg_count, char *args[])
@@ -53,8 +72,21 @@ Config parse_ini(const std::string path) {
 		config.image_width = t_cfg->get_value_or("image_width", config.image_width);
 		config.vfov = t_cfg->get_value_or("vfov", config.vfov);
 		config.focus_dist = t_cfg->get_value_or("focus_dst", config.focus_dist);
-		config.defocus_angle = t_cfg->get_value_or("defoucs_angle", config.defocus_angle);
+		config.defocus_angle = t_cfg->get_value_or("defocus_angle", config.defocus_angle);
 		config.maximum_depth = t_cfg->get_value_or("maximum_depth", config.maximum_depth);
+		config.rr_min_depth = t_cfg->get_value_or("rr_min_depth", config.rr_min_depth);
+		config.tile_size = t_cfg->get_value_or("tile_size", config.tile_size);
+		config.output_format = t_cfg->get_value_or("output_format", config.output_format);
+		config.stream_output = t_cfg->get_value_or("stream_output", config.stream_output);
+		config.adaptive_threshold = t_cfg->get_value_or("adaptive_threshold", config.adaptive_threshold);
+		config.min_samples = t_cfg->get_value_or("min_samples", config.min_samples);
+		config.sample_heatmap = t_cfg->get_value_or("sample_heatmap", config.sample_heatmap);
+		config.scene = t_cfg->get_value_or("scene", config.scene);
+		config.integrator = t_cfg->get_value_or("integrator", config.integrator);
+		config.sampler = t_cfg->get_value_or("sampler", config.sampler);
+		config.denoise = t_cfg->get_value_or("denoise", config.denoise);
+		config.aovs = t_cfg->get_value_or("aovs", config.aovs);
+		config.mesh_vertices = t_cfg->get_value_or("mesh_vertices", config.mesh_vertices);
 	} else {
 		std::string err_str = t_cfg.error();
 		std::println("{}", err_str);
@@ -63,12 +95,14 @@ Config parse_ini(const std::string path) {
 	return config;
 }
 
-HittableList gen_world(int objCount = 10) {
+HittableList gen_world(MaterialRegistry& materials, int objCount = 10) {
 	HittableList world;
 
-	auto ground_material = std::make_shared<Lambertian>(Vec3(0.5, 0.5, 0.5)); 
+	auto ground_material = materials.add<Lambertian>(Vec3(0.5, 0.5, 0.5)); 
 	world.add(std::make_shared<Sphere>(Vec3(0, -1000, 0), 1000, ground_material));
 
+	//the small spheres go into one SphereSet instead of a Sphere object each.
+	auto field = std::make_shared<SphereSet>();
 	for (int a = -objCount; a < objCount; a++)
 	{
 		for (int b = -objCount; b < objCount; b++) {
@@ -76,32 +110,35 @@ HittableList gen_world(int objCount = 10) {
 			Point3D center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
 
 			if ((center - Point3D(4, 0.2, 0)).length() > 0.9) {
-				std::shared_ptr<Material> sphere_material;
+				const Material* sphere_material;
 
 				if (choose_mat < 0.8) {
 					//diffuse
 					auto albedo = Vec3::random() * Vec3::random();
-					sphere_material = std::make_shared<Lambertian>(albedo);
-					world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
+					sphere_material = materials.add<Lambertian>(albedo);
+					field->add(center, 0.2, sphere_material);
 				} else if (choose_mat < 0.95) {
 					//metal
 					auto albedo = Vec3::random(0.5, 1);
 					auto fuzz = random_double(0, 0.5);
 
-					sphere_material = std::make_shared<Metal>(albedo, fuzz);
-					world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
+					sphere_material = materials.add<Metal>(albedo, fuzz);
+					field->add(center, 0.2, sphere_material);
 				} else {
 					//glass
-					sphere_material = std::make_shared<Dielectric>(1.5);
-					world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
+					sphere_material = materials.add<Dielectric>(1.5);
+					field->add(center, 0.2, sphere_material);
 				}
 			}
 		}
 	}
 
-	auto glass_mat = std::make_shared<Dielectric>(1.5);
-	auto diffuse_mat = std::make_shared<Lambertian>(Vec3(0.4, 0.2, 0.1));
-	auto metal_mat = std::make_shared<Metal>(Vec3(0.7, 0.6, 0.5), 0.0);
+	field->build();
+	world.add(field);
+
+	auto glass_mat = materials.add<Dielectric>(1.5);
+	auto diffuse_mat = materials.add<Lambertian>(Vec3(0.4, 0.2, 0.1));
+	auto metal_mat = materials.add<Metal>(Vec3(0.7, 0.6, 0.5), 0.0);
 	
 	world.add(std::make_shared<Sphere>(Vec3(0, 1, 0), 1.0, glass_mat));
 	world.add(std::make_shared<Sphere>(Vec3(-4, 1, 0), 1.0, diffuse_mat));
@@ -109,21 +146,19 @@ HittableList gen_world(int objCount = 10) {
 	return world;
 }
 
-HittableList gen_test_scene() {
+HittableList gen_test_scene(MaterialRegistry& materials, VertexFormat mesh_format, ThreadPool& pool) {
 	HittableList world;
 
 	
 	auto test_texture = std::make_shared<TestTexture>(Color(6, 250, 6), 2);
 	auto test_texture_two = std::make_shared<TestTexture>(Color(250, 6, 6), 12);
 
-	auto material_ground = std::make_shared<LambertianTexture>(test_texture);
-	auto material_test = std::make_shared<LambertianTexture>(test_texture_two);
+	auto material_ground = materials.add<LambertianTexture>(test_texture);
+	auto material_test = materials.add<LambertianTexture>(test_texture_two);
 
-	auto material_center = std::make_shared<Lambertian>(Vec3(0.1, 0.2, 0.5));
-	auto material_red = std::make_shared<Lambertian>(Vec3(1.0, 0.0, 0.0));
-	auto material_left = std::make_shared<Metal>(Vec3(0.8, 0.8, 0.8), 0.0);
-	auto material_right = std::make_shared<Metal>(Vec3(0.8, 0.6, 0.2), 0.5);
-	auto material_glass = std::make_shared<Dielectric>(1.50);	
+	auto material_left = materials.add<Metal>(Vec3(0.8, 0.8, 0.8), 0.0);
+	auto material_right = materials.add<Metal>(Vec3(0.8, 0.6, 0.2), 0.5);
+	auto material_glass = materials.add<Dielectric>(1.50);	
 
 	
 	world.add(std::make_shared<Plane>(Point3D(0, -1.0, 0), Vec3(0.0, 1.0, 0.0), material_ground));
@@ -134,8 +169,9 @@ HittableList gen_test_scene() {
 	//world.add(std::make_shared<Sphere>(Point3D(-2, 2, 3), 0.5, material_red));
 	//
 
-	auto obj = parse_obj("objs/teapot.obj", material_right,Point3D(0, 0, -5.0));
-	world.add(obj);
+	//the mesh stays at its own origin, the instance places it.
+	auto teapot = parse_obj("objs/teapot.obj", material_right, Point3D(0, 0, 0), pool, mesh_format);
+	world.add(std::make_shared<Instance>(teapot, Transform::translate(Vec3(0, 0, -5.0))));
 	return world;
 }
 
@@ -144,28 +180,86 @@ int main() {
 	//if we want to parse by args.
 //	auto config = parse_args(argc, argv);	
 	auto config = parse_ini("init.ini");
+	auto format = parse_image_format(config.output_format);
+	if (!format) {
+		std::println("Unknown output_format '{}', writing ppm", config.output_format);
+		format = ImageFormat::ppm;
+	}
+	auto integrator = parse_integrator(config.integrator);
+	if (!integrator) {
+		std::println("Unknown integrator '{}', using recursive", config.integrator);
+		integrator = Integrator::recursive;
+	}
+	auto sampler = parse_sampler(config.sampler);
+	if (!sampler) {
+		std::println("Unknown sampler '{}', using random", config.sampler);
+		sampler = SamplerType::random;
+	}
+
+	auto mesh_format = parse_vertex_format(config.mesh_vertices);
+	if (!mesh_format) {
+		std::println("Unknown mesh_vertices '{}', using full", config.mesh_vertices);
+		mesh_format = VertexFormat::full;
+	}
+
 	std::ofstream file;
-	file.open("example.ppm", std::ios::trunc);
+	file.open(std::format("example.{}", file_extension(*format)), std::ios::trunc | std::ios::binary);
 
 
-	HittableList world = gen_test_scene(); 
+	//the scene loads on it, then the camera renders on it.
+	ThreadPool pool;
+	//declared before the scene, primitives point into it.
+	MaterialRegistry materials;
+	const bool sphere_field = config.scene == "spheres";
+	HittableList scene = sphere_field ? gen_world(materials, 11) : gen_test_scene(materials, *mesh_format, pool);
+	Bvh world(scene);
 
 	//HittableList lights;
-	//auto material_light = std::make_shared<Light>();
+	//auto material_light = materials.add<Light>();
 	//lights.add(std::make_shared<Sphere>(Point3D(1.0, 2.0, 1.0), 0.5, material_light));
 	//std::vector<Vec3> lights{ };
 	Camera camera;
+	camera.thread_pool = &pool;
 
 	camera.aspect_ratio = aspect_ratio;
 	camera.image_width = config.image_width;
 	camera.samples_per_pixel = config.samples_per_pixel;
 	camera.vfov = config.vfov;
 	camera.max_depth = config.maximum_depth;
-	camera.lookfrom = Point3D(0.0, 3.0, 4.0);
-	camera.lookat = Point3D(0, 0.5, 0);
+	camera.rr_min_depth = config.rr_min_depth;
+	camera.tile_size = config.tile_size;
+	camera.output_format = *format;
+	camera.stream_output = config.stream_output;
+	camera.adaptive_threshold = config.adaptive_threshold;
+	camera.min_samples = config.min_samples;
+	camera.integrator = *integrator;
+	camera.sampler = *sampler;
+	camera.denoise = config.denoise;
+
+	std::ofstream heatmap;
+	if (config.sample_heatmap) {
+		heatmap.open("samples.ppm", std::ios::trunc | std::ios::binary);
+		camera.sample_heatmap = &heatmap;
+	}
+	//every AOV goes to its own file next to the image, e.g. example.normal.ppm
+	std::array<std::ofstream, aov_count> aov_files;
+	for (auto part : config.aovs | std::views::split(',')) {
+		const std::string_view name(part.begin(), part.end());
+		if (name.empty()) continue;
+		auto aov = parse_aov(name);
+		if (!aov) {
+			std::println("Unknown AOV '{}', skipping it", name);
+			continue;
+		}
+		auto& aov_file = aov_files[static_cast<size_t>(*aov)];
+		aov_file.open(std::format("example.{}.{}", name, file_extension(*format)), std::ios::trunc | std::ios::binary);
+		camera.aov_outputs[static_cast<size_t>(*aov)] = &aov_file;
+	}
+	camera.lookfrom = sphere_field ? Point3D(13.0, 2.0, 3.0) : Point3D(0.0, 3.0, 4.0);
+	camera.lookat = sphere_field ? Point3D(0, 0, 0) : Point3D(0, 0.5, 0);
 	camera.vup = Vec3(0, 1, 0);
 
-	//not using focus blur right now
+	//defocus_angle 0 keeps everything sharp
 	camera.defocus_angle = config.defocus_angle;
 	camera.focus_dist = config.focus_dist;
 
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+//Read-only memory map of a whole file. The pages are shared with the page cache, so
+//opening a file that was read recently costs no copy.
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path) {
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) throw std::runtime_error("Unable to open file: " + path);
+
+		struct stat info;
+		if (::fstat(fd, &info) != 0) {
+			::close(fd);
+			throw std::runtime_error("Unable to stat file: " + path);
+		}
+		size_ = static_cast<size_t>(info.st_size);
+		if (size_ > 0) {
+			void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data == MAP_FAILED) {
+				::close(fd);
+				throw std::runtime_error("Unable to map file: " + path);
+			}
+			::madvise(data, size_, MADV_WILLNEED);
+			data_ = static_cast<const char*>(data);
+		}
+		::close(fd);
+	}
+
+	MappedFile(MappedFile&& other) noexcept : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile() {
+		if (data_) ::munmap(const_cast<char*>(data_), size_);
+	}
+
+	const char* data() const { return data_; }
+	size_t size() const { return size_; }
+	std::string_view view() const { return std::string_view(data_, size_); }
+
+private:
+	const char* data_ = nullptr;
+	size_t size_ = 0;
+};
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <memory>
+#include <utility>
+#include <vector>
 #include "constants.hpp"
 #include "hittable.hpp"
+#include "sampler.hpp"
 #include "texture.hpp"
 
 class Material {
@@ -13,6 +17,12 @@ public:
 	) const {
 		return false;
 	}
+
+	//Color of the surface at rec without sampling anything, the denoiser's albedo guide.
+	//Materials without a color of their own count as white.
+	virtual Vec3 surface_albedo(const HitRecord&) const {
+		return Vec3(1.0, 1.0, 1.0);
+	}
 };
 
 class Lambertian : public Material {
@@ -20,7 +30,7 @@ public:
 	Lambertian(const Vec3& albedo) : albedo(albedo) {}
 
 	bool scatter(const Ray&, const HitRecord &rec, Vec3 &attentuation, Ray &scattered) const override {
-		auto scatter_direction = rec.normal + random_unit_vector();
+		auto scatter_direction = rec.normal + square_to_unit_sphere(sample_2d());
 
 		if (scatter_direction.near_zero())
 		{
@@ -32,6 +42,8 @@ public:
 		return true;
 	}
 
+	Vec3 surface_albedo(const HitRecord&) const override { return albedo; }
+
 private:
 	//albedo is latin for "whiteness"
 	//used to define a form of "fractional reflectance"
@@ -44,7 +56,7 @@ public:
 	LambertianTexture(std::shared_ptr<Texture> texture) : texture_(texture) {}
 	
 	bool scatter(const Ray&, const HitRecord &rec, Vec3 &attentuation, Ray &scattered) const override {
-		auto scatter_direction = rec.normal + random_unit_vector();
+		auto scatter_direction = rec.normal + square_to_unit_sphere(sample_2d());
 
 		if (scatter_direction.near_zero())
 		{
@@ -57,6 +69,10 @@ public:
 		return true;
 	}
 
+	Vec3 surface_albedo(const HitRecord& rec) const override {
+		return texture_->sample(rec.uv.x(), rec.uv.y()).to_vec3();
+	}
+
 private:
 	std::shared_ptr<Texture> texture_;
 };
@@ -67,12 +83,14 @@ public:
 
 	bool scatter(const Ray &r_in, const HitRecord &rec, Vec3 &attentuation, Ray &scattered) const override {
 		Vec3 reflected = reflect(r_in.direction(), rec.normal);
-		reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
+		reflected = unit_vector(reflected) + (fuzz * square_to_unit_sphere(sample_2d()));
 		scattered = Ray(rec.p, reflected);
 		attentuation = albedo;
 		return (dot(scattered.direction(), rec.normal) > 0);
 	}
 
+	Vec3 surface_albedo(const HitRecord&) const override { return albedo; }
+
 private:
 	Vec3 albedo;
 	double fuzz;
@@ -94,7 +112,7 @@ public:
 		bool cannot_refract = ri * sin_theta > 1.0;
 		Vec3 direction;
 
-		if (cannot_refract || reflectance(cos_theta, ri) > random_double()) 
+		if (cannot_refract || reflectance(cos_theta, ri) > sample_1d()) 
 			direction = reflect(unit_direction, rec.normal);
 		else
 			direction = refract(unit_direction, rec.normal, ri);
@@ -123,3 +141,21 @@ public:
 
 
 };
+
+//Owns the materials of a scene. Primitives and hit records refer to them by raw pointer,
+//so the registry has to outlive every Hittable built from it.
+class MaterialRegistry {
+public:
+	template<typename M, typename... Args>
+	const M* add(Args&&... args) {
+		auto material = std::make_unique<M>(std::forward<Args>(args)...);
+		const M* handle = material.get();
+		materials_.push_back(std::move(material));
+		return handle;
+	}
+
+	size_t size() const { return materials_.size(); }
+
+private:
+	std::vector<std::unique_ptr<Material>> materials_;
+};
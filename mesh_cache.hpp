@@ -0,0 +1,113 @@
+#pragma once
+
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include "random.hpp"
+#include "vertex_buffer.hpp"
+
+//Binary cache of a loaded mesh and its prebuilt acceleration structure, written next to
+//the OBJ it came from. The header holds the OBJ's size, modification time and content
+//hash, the origin the mesh was moved by, the vertex format and the sizes of the stored
+//structs; a cache that does not match them is rebuilt. Every section starts on an alignment boundary, so the whole
+//mesh is used in place from the read-only mapping. Layout: Header, vertices, vertex
+//indices, normals, normal indices, nodes.
+namespace mesh_cache {
+
+constexpr char magic[8] = { 'R', 'T', 'M', 'E', 'S', 'H', 0, 0 };
+constexpr uint32_t version = 4;
+constexpr size_t alignment = 64;
+
+struct Header {
+	char magic[8];
+	uint32_t version;
+	uint32_t real_size;
+	uint32_t node_size;
+	uint32_t vertex_format;
+	uint64_t content_hash;
+	uint64_t source_size;
+	int64_t source_mtime; //nanoseconds since the file clock's epoch
+	double origin[3];
+	double bounds[6]; //low x, y, z, then high x, y, z
+	double quantization[6]; //low corner, then step size, of quantized vertices
+	uint64_t vertex_count;
+	uint64_t face_count;
+	uint64_t normal_count;
+	uint64_t normal_index_count;
+	uint64_t node_count;
+};
+
+//Offsets of the sections that follow the header.
+struct Layout {
+	size_t vertices, indices, normals, normal_indices, nodes, end;
+
+	explicit Layout(const Header& h) {
+		auto align = [](size_t offset) { return (offset + alignment - 1) / alignment * alignment; };
+		vertices = align(sizeof(Header));
+		indices = align(vertices + h.vertex_count * VertexBuffer::stride(static_cast<VertexFormat>(h.vertex_format)));
+		normals = align(indices + h.face_count * 3 * sizeof(uint32_t));
+		normal_indices = align(normals + h.normal_count * 3 * sizeof(float));
+		nodes = align(normal_indices + h.normal_index_count * sizeof(uint32_t));
+		end = nodes + h.node_count * h.node_size;
+	}
+};
+
+//count values of type T stored at offset in a mapped cache file.
+template<typename T>
+std::span<const T> section(const char* data, size_t offset, size_t count) {
+	return std::span<const T>(reinterpret_cast<const T*>(data + offset), count);
+}
+
+//The OBJ a cache has to stand in for. Size and modification time are read without
+//touching the file's contents, so a matching cache loads in time independent of the
+//OBJ's size; a file rewritten to the same size within one clock tick goes unnoticed.
+//With content_hash set, the hash decides instead.
+struct Source {
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	std::optional<uint64_t> content_hash;
+
+	static Source of(const std::string& path) {
+		const auto time = std::filesystem::last_write_time(path).time_since_epoch();
+		return Source{ std::filesystem::file_size(path), std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(), std::nullopt };
+	}
+
+	bool matches(const Header& h) const {
+		return content_hash ? h.content_hash == *content_hash : h.source_size == size && h.source_mtime == mtime;
+	}
+};
+
+inline std::string path_for(const std::string& obj_path) { return obj_path + ".rtcache"; }
+
+//Name to write a cache under before it is renamed into place. Unique per process and call,
+//so writers building the same mesh at once never share a file.
+inline std::string temp_path_for(const std::string& cache_path) {
+	static std::atomic<uint64_t> counter = 0;
+	return cache_path + "." + std::to_string(::getpid()) + "." + std::to_string(counter++) + ".tmp";
+}
+
+//64 bit hash of a file's bytes, taken 8 at a time. Tells edited files apart, it is not
+//meant to resist deliberate collisions.
+inline uint64_t content_hash(const char* data, size_t size) {
+	uint64_t h = rng::mix64(size ^ 0x6A09E667F3BCC909ull);
+	//an empty mapping may have no data pointer at all.
+	if (size == 0) return h;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, data + i, 8);
+		h = (h ^ rng::mix64(word)) * 0x9E3779B97F4A7C15ull;
+	}
+	uint64_t tail = 0;
+	std::memcpy(&tail, data + i, size - i);
+	return rng::mix64(h ^ tail);
+}
+
+}
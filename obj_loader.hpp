@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include "vec.hpp"
+
+//A mesh the way an OBJ file stores it: shared attribute arrays and three corners per
+//triangle. Every corner indexes positions and, when the file has them, texcoords and
+//normals; a corner without one holds no_index there.
+struct ObjMesh {
+	static constexpr uint32_t no_index = std::numeric_limits<uint32_t>::max();
+
+	std::vector<Point3D> positions;
+	std::vector<Vec2> texcoords;
+	std::vector<Vec3> normals;
+	std::vector<uint32_t> position_indices; //3 per triangle
+	std::vector<uint32_t> texcoord_indices; //3 per triangle, empty when no face has texcoords
+	std::vector<uint32_t> normal_indices; //3 per triangle, empty when no face has normals
+
+	size_t triangle_count() const { return position_indices.size() / 3; }
+};
+
+namespace obj {
+
+//Lines of one chunk of the file. The first pass counts the vertex lines so every chunk
+//knows where its vertices go, the second parses them in place and collects the faces.
+struct Chunk {
+	const char* begin;
+	const char* end;
+	size_t counts[3] = {}; //positions, texcoords, normals declared in the chunk
+	size_t bases[3] = {}; //declared before the chunk
+	std::vector<uint32_t> corners[3] = {}; //per triangle corner: position, texcoord, normal
+	const char* error = nullptr;
+};
+
+enum Attribute { position, texcoord, normal };
+
+inline const char* skip_blanks(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t')) p++;
+	return p;
+}
+
+//kind of the statement starting at p: 0 v, 1 vt, 2 vn, 3 f, -1 anything else.
+inline int statement(const char* p, const char* end) {
+	auto blank = [&](const char* q) { return q >= end || *q == ' ' || *q == '\t'; };
+	if (p >= end) return -1;
+	if (p[0] == 'f' && blank(p + 1)) return 3;
+	if (p[0] != 'v') return -1;
+	if (blank(p + 1)) return position;
+	if (p + 1 < end && p[1] == 't' && blank(p + 2)) return texcoord;
+	if (p + 1 < end && p[1] == 'n' && blank(p + 2)) return normal;
+	return -1;
+}
+
+inline const char* line_end(const char* p, const char* end) {
+	const void* nl = std::memchr(p, '\n', static_cast<size_t>(end - p));
+	return nl ? static_cast<const char*>(nl) : end;
+}
+
+inline bool parse_reals(const char*& p, const char* end, double* values, int count) {
+	for (int i = 0; i < count; i++) {
+		p = skip_blanks(p, end);
+		const auto [next, ec] = std::from_chars(p, end, values[i]);
+		if (ec != std::errc()) return false;
+		p = next;
+	}
+	return true;
+}
+
+//OBJ indices start at 1, negative ones count back from the last vertex declared so far.
+inline bool resolve_index(long index, size_t declared, size_t total, uint32_t& resolved) {
+	const long long i = index > 0 ? index - 1 : static_cast<long long>(declared) + index;
+	if (index == 0 || i < 0 || i >= static_cast<long long>(total)) return false;
+	resolved = static_cast<uint32_t>(i);
+	return true;
+}
+
+//Parses one "v", "v/t", "v//n" or "v/t/n" corner of a face.
+inline bool parse_corner(const char*& p, const char* end, const size_t* declared, const size_t* totals, uint32_t* corner) {
+	corner[texcoord] = corner[normal] = ObjMesh::no_index;
+	for (int attribute = position; attribute <= normal; attribute++) {
+		if (attribute > position) {
+			if (p >= end || *p != '/') return true;
+			p++;
+			if (p < end && *p == '/') continue;
+		}
+		long index;
+		const auto [next, ec] = std::from_chars(p, end, index);
+		if (ec != std::errc()) return false;
+		p = next;
+		if (!resolve_index(index, declared[attribute], totals[attribute], corner[attribute])) return false;
+	}
+	return true;
+}
+
+inline void count_chunk(Chunk& chunk) {
+	for (const char* p = chunk.begin; p < chunk.end; p = line_end(p, chunk.end) + 1) {
+		const int kind = statement(skip_blanks(p, chunk.end), chunk.end);
+		if (kind >= position && kind <= normal) chunk.counts[kind]++;
+	}
+}
+
+inline void parse_chunk(Chunk& chunk, ObjMesh& mesh, const size_t* totals) {
+	size_t declared[3] = { chunk.bases[0], chunk.bases[1], chunk.bases[2] };
+	std::vector<uint32_t> polygon; //corners of the current face, 3 values each
+
+	for (const char* p = chunk.begin; p < chunk.end;) {
+		const char* end = line_end(p, chunk.end);
+		const char* line = p;
+		p = skip_blanks(p, end);
+		const int kind = statement(p, end);
+		double values[3] = {};
+		bool ok = true;
+
+		switch (kind) {
+		case position:
+			p += 1;
+			ok = parse_reals(p, end, values, 3);
+			mesh.positions[declared[position]++] = Point3D(values[0], values[1], values[2]);
+			break;
+		case texcoord:
+			//the second coordinate is optional.
+			p += 2;
+			ok = parse_reals(p, end, values, 1);
+			if (ok) parse_reals(p, end, values + 1, 1);
+			mesh.texcoords[declared[texcoord]++] = Vec2(values[0], values[1]);
+			break;
+		case normal:
+			p += 2;
+			ok = parse_reals(p, end, values, 3);
+			mesh.normals[declared[normal]++] = Vec3(values[0], values[1], values[2]);
+			break;
+		case 3: {
+			polygon.clear();
+			p++;
+			for (;;) {
+				p = skip_blanks(p, end);
+				if (p >= end || *p == '\r' || *p == '#') break;
+				uint32_t corner[3];
+				if (!parse_corner(p, end, declared, totals, corner)) {
+					ok = false;
+					break;
+				}
+				polygon.insert(polygon.end(), corner, corner + 3);
+			}
+			ok = ok && polygon.size() >= 9;
+			if (!ok) break;
+
+			//n-gons become a fan around their first corner.
+			for (size_t i = 3; i + 3 < polygon.size(); i += 3) {
+				for (const size_t c : { size_t(0), i, i + 3 })
+					for (int attribute = position; attribute <= normal; attribute++)
+						chunk.corners[attribute].push_back(polygon[c + attribute]);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+
+		if (!ok && !chunk.error) chunk.error = line;
+		p = end + 1;
+	}
+}
+
+//A chunk boundary moves forward to the next line start, so no line is split.
+inline std::vector<Chunk> split(const char* data, size_t size, size_t chunk_size) {
+	std::vector<Chunk> chunks;
+	const char* end = data + size;
+	for (const char* p = data; p < end;) {
+		const char* q = p + std::min<size_t>(chunk_size, static_cast<size_t>(end - p));
+		if (q < end) q = std::min(end, line_end(q, end) + 1);
+		chunks.push_back(Chunk{ .begin = p, .end = q });
+		p = q;
+	}
+	return chunks;
+}
+
+}
+
+//Loads the v, vt, vn and f statements of an OBJ file mapped from path; everything else is
+//skipped. The file is parsed in chunks of about a megabyte on the pool: one pass counts
+//the vertex lines of every chunk, the second parses each chunk into its place. Polygons
+//are split into triangle fans. Throws std::runtime_error on a malformed statement or an
+//index out of range.
+inline ObjMesh load_obj(const MappedFile& file, const std::string& path, ThreadPool& pool) {
+	std::vector<obj::Chunk> chunks = obj::split(file.data(), file.size(), size_t(1) << 20);
+
+	pool.parallel_for(0, chunks.size(), 1, [&](size_t i) { obj::count_chunk(chunks[i]); });
+	size_t totals[3] = {};
+	for (auto& chunk : chunks) {
+		for (int a = 0; a < 3; a++) {
+			chunk.bases[a] = totals[a];
+			totals[a] += chunk.counts[a];
+		}
+	}
+
+	ObjMesh mesh;
+	mesh.positions.resize(totals[obj::position]);
+	mesh.texcoords.resize(totals[obj::texcoord]);
+	mesh.normals.resize(totals[obj::normal]);
+	pool.parallel_for(0, chunks.size(), 1, [&](size_t i) { obj::parse_chunk(chunks[i], mesh, totals); });
+
+	size_t corners = 0;
+	bool has[3] = { true, false, false };
+	for (const auto& chunk : chunks) {
+		if (chunk.error) {
+			const char* end = obj::line_end(chunk.error, chunk.end);
+			throw std::runtime_error(path + ": bad OBJ statement '" + std::string(chunk.error, end) + "'");
+		}
+		corners += chunk.corners[0].size();
+		for (int a = obj::texcoord; a <= obj::normal; a++)
+			has[a] = has[a] || std::any_of(chunk.corners[a].begin(), chunk.corners[a].end(), [](uint32_t i) { return i != ObjMesh::no_index; });
+	}
+
+	std::vector<uint32_t>* targets[3] = { &mesh.position_indices, &mesh.texcoord_indices, &mesh.normal_indices };
+	for (int a = 0; a < 3; a++) {
+		if (!has[a]) continue;
+		targets[a]->reserve(corners);
+		for (const auto& chunk : chunks) targets[a]->insert(targets[a]->end(), chunk.corners[a].begin(), chunk.corners[a].end());
+	}
+	return mesh;
+}
+
+inline ObjMesh load_obj(const std::string& path, ThreadPool& pool) {
+	return load_obj(MappedFile(path), path, pool);
+}
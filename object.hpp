@@ -2,150 +2,518 @@
 
 
 #include "hittable.hpp"
+#include "mapped_file.hpp"
+#include "mesh_cache.hpp"
+#include "obj_loader.hpp"
 #include "vec.hpp"
+#include "triangle_block.hpp"
+#include "vertex_buffer.hpp"
+#include "wide_bvh.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <memory>
 #include <print>
-#include <stdexcept>
+#include <span>
 #include <string>
 #include <vector>
 
+//Moller-Trumbore test against a triangle stored as one vertex and its two edges.
+//On a hit, t is the ray parameter and (b1, b2) are the barycentric weights of the
+//second and third vertex; the first vertex gets 1 - b1 - b2.
+inline bool intersect_triangle(const Ray& r, const Point3D& v0, const Vec3& e1, const Vec3& e2, Interval ray_t, double& t, double& b1, double& b2) {
+	Vec3 pvec = cross(r.direction(), e2);
+	double det = dot(e1, pvec);
+	if (std::fabs(det) < 1e-12) return false;
+
+	double inv_det = 1.0 / det;
+	Vec3 tvec = r.origin() - v0;
+	b1 = dot(tvec, pvec) * inv_det;
+	if (b1 < 0.0 || b1 > 1.0) return false;
+
+	Vec3 qvec = cross(tvec, e1);
+	b2 = dot(r.direction(), qvec) * inv_det;
+	if (b2 < 0.0 || b1 + b2 > 1.0) return false;
+
+	t = dot(e2, qvec) * inv_det;
+	return ray_t.contains(t);
+}
+
 class Triangle : public Hittable {
 public:
 	
 	Triangle() = delete;
-	Triangle(Vec3 a, Vec3 b, Vec3 c) noexcept : f_{std::move(a), std::move(b), std::move(c)} {
+	Triangle(Vec3 a, Vec3 b, Vec3 c) noexcept : v0_(a), e1_(b - a), e2_(c - a) {
+		compute_normal();
+		vn_[0] = vn_[1] = vn_[2] = n_;
+	}
+
+	//smooth shaded triangle, the vertex normals are interpolated across the face.
+	Triangle(Vec3 a, Vec3 b, Vec3 c, Vec3 na, Vec3 nb, Vec3 nc) noexcept : v0_(a), e1_(b - a), e2_(c - a), vn_{unit_vector(na), unit_vector(nb), unit_vector(nc)}, smooth_(true) {
 		compute_normal();
 	}
 
 	bool hit(const Ray &r, Interval ray_t, HitRecord &rec) const override {
-		//check if it hits the plane and get where on the plane the ray hit...
-		
-		auto denom = dot(r.direction(), n_);
-		if (std::abs(denom) < 1e-12) return false;
-
-		//plane origin can just be the first vertices for now...
-		auto plane_origin = f_[0];
-		auto t = dot(plane_origin - r.origin(), n_) / denom;
-
-		if (ray_t.contains(t)) {
-			//Ok, now we have t, meaning...
-			auto world_pos = r.at(t); //we can get the world position of the ray on this plane created by the triangle.
-			//we need to check now to see if x is really on the triangle
-			bool is_outside = false;
-			auto edge1 = f_[1] - f_[0];
-			auto edge2 = f_[2] - f_[1];
-			auto edge3 = f_[0] - f_[2];
-			auto toP1 = world_pos - f_[0];
-			auto toP2 = world_pos - f_[1];
-			auto toP3 = world_pos - f_[2];
-
-			if (dot(cross(edge1, toP1), n_) < 0) is_outside = true;
-			if (dot(cross(edge2, toP2), n_) < 0) is_outside = true;
-			if (dot(cross(edge3, toP3), n_) < 0) is_outside = true;
-			if(is_outside) return false;
-
-			rec.t = t;
-			rec.p = world_pos;
-			rec.set_face_normal(r, n_);
+		double t, b1, b2;
+		if (!intersect_triangle(r, v0_, e1_, e2_, ray_t, t, b1, b2)) return false;
 
-		        //TODO:	rec.uv
-			return true;
+		rec.t = t;
+		//without texture coordinates the barycentrics are the surface parameterization,
+		//finalize() reads them back to interpolate the normal.
+		rec.uv = Vec2(b1, b2);
+		rec.object = this;
+		rec.prim = 0;
+		return true;
+	}
+
+	bool occluded(const Ray& r, Interval ray_t) const override {
+		double t, b1, b2;
+		return intersect_triangle(r, v0_, e1_, e2_, ray_t, t, b1, b2);
+	}
+
+	void finalize(const Ray& r, HitRecord& rec) const override {
+		rec.p = r.at(rec.t);
+		if (smooth_) {
+			//the side is decided by the geometric normal, the shading normal only bends the result.
+			const double b1 = rec.uv.x(), b2 = rec.uv.y();
+			Vec3 shading = unit_vector((1.0 - b1 - b2) * vn_[0] + b1 * vn_[1] + b2 * vn_[2]);
+			rec.front_face = dot(r.direction(), n_) < 0;
+			rec.normal = rec.front_face ? shading : -shading;
+		} else {
+			rec.set_face_normal(r, n_);
 		}
-		return false;
 	}
+
+	AABB bounding_box() const override {
+		return AABB(AABB(v0_, v0_ + e1_), AABB(v0_ + e2_, v0_ + e2_));
+	}
+
+	const Point3D& vertex0() const { return v0_; }
+	const Vec3& edge1() const { return e1_; }
+	const Vec3& edge2() const { return e2_; }
+	const Vec3& normal() const { return n_; }
+	bool smooth() const { return smooth_; }
+	const Vec3& vertex_normal(int i) const { return vn_[i]; }
 private:
-	Vec3 f_[3]; //Vertices
-	Vec3 n_; //normal
-	//
+	Point3D v0_; //first vertex
+	Vec3 e1_, e2_; //edges from the first vertex to the other two
+	Vec3 n_; //unit geometric normal
+	Vec3 vn_[3]; //vertex normals
+	bool smooth_ = false;
+
 	void compute_normal() {
-		//we assume that all 3 vertices exist on the same "plane"
-		//That means we can just pick two random vectors, and just take the cross product.
-		n_ = cross(f_[1] - f_[0], f_[2] - f_[0]);
+		n_ = unit_vector(cross(e1_, e2_));
 	}
 };
 
 
+//Triangle mesh stored indexed: a shared VertexBuffer, three vertex indices per face and,
+//for smooth faces, three indices into a table of unit normals. Faces are kept in tree
+//order, so every leaf of the wide BVH is a run of at most triangle_block_width faces,
+//named by the first one. The leaf kernel decodes them into a TriangleBlock for the 8-wide
+//filter and runs the exact test on the candidates.
 class Object : public Hittable {
-public: 
+public:
+	static constexpr uint32_t no_index = ObjMesh::no_index;
 
-	explicit Object(std::vector<Triangle> faces, std::shared_ptr<Material> mat) : faces_(std::move(faces)), mat_(mat) {}
+	//Normals are used when a face has all three. When every face indexes its normals like
+	//its positions, normal_indices() stays empty and normals() lines up with the vertices.
+	Object(const ObjMesh& mesh, const Material* mat, VertexFormat format = VertexFormat::full)
+		: mat_(mat), vertices_(mesh.positions, format) {
+		const size_t face_count = mesh.triangle_count();
+		std::vector<AABB> boxes;
+		boxes.reserve(face_count);
+		for (size_t face = 0; face < face_count; face++) {
+			const uint32_t* v = &mesh.position_indices[3 * face];
+			const Point3D a = vertices_[v[0]], b = vertices_[v[1]], c = vertices_[v[2]];
+			boxes.push_back(AABB(AABB(a, b), AABB(c, c)));
+			bbox_ = AABB(bbox_, boxes.back());
+		}
+
+		std::vector<uint32_t> order;
+		bvh_ = WideBvh::build(boxes, order, triangle_block_width);
+		owned_indices_.reserve(3 * face_count);
+		for (const uint32_t face : order)
+			owned_indices_.insert(owned_indices_.end(), &mesh.position_indices[3 * face], &mesh.position_indices[3 * face + 3]);
+
+		if (!mesh.normal_indices.empty()) {
+			owned_normals_.reserve(3 * mesh.normals.size());
+			for (const Vec3& n : mesh.normals) {
+				const Vec3 unit = unit_vector(n);
+				owned_normals_.insert(owned_normals_.end(), { static_cast<float>(unit.x()), static_cast<float>(unit.y()), static_cast<float>(unit.z()) });
+			}
+			if (mesh.normal_indices != mesh.position_indices) {
+				owned_normal_indices_.reserve(3 * face_count);
+				for (const uint32_t face : order) {
+					const uint32_t* n = &mesh.normal_indices[3 * face];
+					const bool smooth = n[0] != no_index && n[1] != no_index && n[2] != no_index;
+					owned_normal_indices_.insert(owned_normal_indices_.end(), { smooth ? n[0] : no_index, n[1], n[2] });
+				}
+			}
+		}
+		indices_ = owned_indices_;
+		normals_ = owned_normals_;
+		normal_indices_ = owned_normal_indices_;
+	}
+
+	//a mesh of separate triangles, three vertices each.
+	explicit Object(const std::vector<Triangle>& faces, const Material* mat) : Object(mesh_of(faces), mat) {}
+
+	//Mesh restored from a cache file: the vertices, indices, normals and tree point into
+	//storage, which keeps the mapping alive.
+	Object(VertexBuffer vertices, std::span<const uint32_t> indices, std::span<const float> normals, std::span<const uint32_t> normal_indices, WideBvh bvh, AABB bbox, const Material* mat, std::shared_ptr<const void> storage)
+		: mat_(mat), vertices_(std::move(vertices)), indices_(indices), normals_(normals), normal_indices_(normal_indices), bvh_(std::move(bvh)), bbox_(bbox), storage_(std::move(storage)) {}
+
+	//the spans may point into the object itself.
+	Object(const Object&) = delete;
+	Object& operator=(const Object&) = delete;
 
 	bool hit(const Ray &r, Interval ray_t, HitRecord &rec) const override {
-		//naive implementation just loop through all triangles to see what hits? 
 		bool hit_anything = false;
-		double closest = ray_t.high;
-
-		HitRecord temp;
-		for(const auto& t : faces_) {
-			if (t.hit(r, Interval(ray_t.low, closest), temp)) {
-				hit_anything = true;
-				closest = temp.t;
-				rec = temp;
-				rec.mat = mat_;
+
+		//the 8-wide float test picks the candidate lanes, the exact test on those faces
+		//decides the hit and its attributes.
+		const BlockRay block_ray(r);
+		bvh_.traverse(r, ray_t, [&](uint32_t first, uint32_t count, Interval& t) {
+			ray_stats::count_tests(count);
+			Leaf leaf;
+			decode_leaf(first, count, leaf);
+			unsigned mask = intersect_block(leaf.block, block_ray, static_cast<float>(t.low), static_cast<float>(t.high));
+			while (mask) {
+				int lane = std::countr_zero(mask);
+				mask &= mask - 1;
+				if (hit_face(r, leaf.faces[lane], t, rec)) {
+					hit_anything = true;
+					t.high = rec.t;
+					rec.prim = first + lane;
+				}
 			}
-		}
+		});
 
+		if (hit_anything) rec.object = this;
 		return hit_anything;
 	}
-private:
-	std::vector<Triangle> faces_;
-	std::shared_ptr<Material> mat_;
-};
 
+	bool occluded(const Ray& r, Interval ray_t) const override {
+		const BlockRay block_ray(r);
+		return bvh_.traverse_any(r, ray_t, [&](uint32_t first, uint32_t count, Interval t) {
+			ray_stats::count_tests(count);
+			Leaf leaf;
+			decode_leaf(first, count, leaf);
+			unsigned mask = intersect_block(leaf.block, block_ray, static_cast<float>(t.low), static_cast<float>(t.high));
+			HitRecord rec;
+			for (; mask; mask &= mask - 1)
+				if (hit_face(r, leaf.faces[std::countr_zero(mask)], t, rec)) return true;
+			return false;
+		});
+	}
 
-inline std::shared_ptr<Object> parse_obj(const std::string& path, std::shared_ptr<Material> mat, Point3D origin) {
-	std::vector<Vec3> vertices;
-	//std::vector<Vec3> normals;
-	std::vector<Triangle> triangles;
+	//a leaf is decoded once and tested against every lane that reached it.
+	void hit_packet(const RayPacket& packet, unsigned lanes, PacketHit& hits) const override {
+		BlockRay block_rays[packet_width];
+		for (unsigned m = lanes; m; m &= m - 1) {
+			int lane = std::countr_zero(m);
+			block_rays[lane] = BlockRay(packet.rays[lane]);
+		}
 
-	std::ifstream file(path);
-	
-	if (!file.is_open()) throw std::runtime_error("Unable to open file!");
-	
-	std::string line;
-	while(std::getline(file, line)) {
-		if (line[0] == 'v') {
-			//Parse vertex
-			double f[3];
-			int counter = 0;
-			int start = 2;
-			for(size_t i = 2; i < line.length(); ++i) {
-				if (line[i] == ' ') {
-					auto slice = line.substr(start, i - start);
-					f[counter] = std::stod(slice);
-					++counter;
-					start = i+1;
+		unsigned found = 0;
+		bvh_.traverse_packet(packet, lanes, hits.t_max, [&](uint32_t first, uint32_t count, unsigned leaf_lanes) {
+			ray_stats::count_tests(count * std::popcount(leaf_lanes));
+			Leaf leaf;
+			decode_leaf(first, count, leaf);
+			for (; leaf_lanes; leaf_lanes &= leaf_lanes - 1) {
+				int lane = std::countr_zero(leaf_lanes);
+				unsigned mask = intersect_block(leaf.block, block_rays[lane], static_cast<float>(packet.t_min), static_cast<float>(hits.t_max[lane]));
+				while (mask) {
+					int i = std::countr_zero(mask);
+					mask &= mask - 1;
+					if (hit_face(packet.rays[lane], leaf.faces[i], Interval(packet.t_min, hits.t_max[lane]), hits.rec[lane])) {
+						hits.t_max[lane] = hits.rec[lane].t;
+						hits.rec[lane].prim = first + i;
+						found |= 1u << lane;
+					}
 				}
 			}
+		});
 
-			//parse last
-			auto slice = line.substr(start);
-			f[counter] = std::stod(slice);
-
-			vertices.push_back(Vec3(f[0], f[1], f[2]));
-		} else if(line[0] == 'f') {
-			//Parse face (this is a triangle)
-			int f[3];
-			int counter = 0;
-			int start = 2;
-			for (size_t i = 2; i < line.length(); ++i) {
-				if (line[i] == ' ') {
-					auto slice = line.substr(start, i - start);
-					f[counter] = std::stoi(slice) - 1;
-					++counter;
-					start = i+1;
-				}
+		for (unsigned m = found; m; m &= m - 1)
+			hits.rec[std::countr_zero(m)].object = this;
+		hits.mask |= found;
+	}
+
+	//prim is the index of the face in tree order. The side is decided by the geometric
+	//normal, the interpolated shading normal only bends the result.
+	void finalize(const Ray& r, HitRecord& rec) const override {
+		const FaceGeometry f = geometry(rec.prim);
+		rec.p = r.at(rec.t);
+		rec.mat = mat_;
+
+		const Vec3 n = unit_vector(cross(f.e1, f.e2));
+		const uint32_t* corners = normal_indices_.empty() ? &indices_[3 * rec.prim] : &normal_indices_[3 * rec.prim];
+		if (normals_.empty() || corners[0] == no_index) {
+			rec.set_face_normal(r, n);
+			return;
+		}
+		const double b1 = rec.uv.x(), b2 = rec.uv.y();
+		const Vec3 shading = unit_vector((1.0 - b1 - b2) * normal(corners[0]) + b1 * normal(corners[1]) + b2 * normal(corners[2]));
+		rec.front_face = dot(r.direction(), n) < 0;
+		rec.normal = rec.front_face ? shading : -shading;
+	}
+
+	AABB bounding_box() const override { return bbox_; }
+
+	size_t face_count() const { return indices_.size() / 3; }
+	const VertexBuffer& vertices() const { return vertices_; }
+	std::span<const uint32_t> indices() const { return indices_; }
+	std::span<const float> normals() const { return normals_; }
+	std::span<const uint32_t> normal_indices() const { return normal_indices_; }
+	const WideBvh& bvh() const { return bvh_; }
+
+private:
+	struct FaceGeometry {
+		Point3D v0;
+		Vec3 e1, e2;
+	};
+
+	//The faces of one leaf, decoded from the vertex buffer: exact edges for the final test
+	//and the same faces as a float block for the 8-wide filter. Unused lanes stay zero.
+	struct Leaf {
+		TriangleBlock block{};
+		FaceGeometry faces[triangle_block_width];
+	};
+
+	FaceGeometry geometry(uint32_t face) const {
+		const uint32_t* v = &indices_[3 * static_cast<size_t>(face)];
+		const Point3D a = vertices_[v[0]];
+		return { a, vertices_[v[1]] - a, vertices_[v[2]] - a };
+	}
+
+	void decode_leaf(uint32_t first, uint32_t count, Leaf& leaf) const {
+		vertices_.visit([&](const auto& vertices) {
+			for (uint32_t i = 0; i < count; i++) {
+				const uint32_t* v = &indices_[3 * (static_cast<size_t>(first) + i)];
+				const Point3D a = vertices[v[0]];
+				FaceGeometry& f = leaf.faces[i];
+				f = { a, vertices[v[1]] - a, vertices[v[2]] - a };
+				leaf.block.set(static_cast<int>(i), f.v0, f.e1, f.e2);
 			}
+		});
+	}
 
-			auto slice = line.substr(start);
-			f[counter] = std::stoi(slice) - 1;
+	//exact test of one face, fills t and the barycentrics finalize() interpolates with.
+	static bool hit_face(const Ray& r, const FaceGeometry& f, Interval ray_t, HitRecord& rec) {
+		double t, b1, b2;
+		if (!intersect_triangle(r, f.v0, f.e1, f.e2, ray_t, t, b1, b2)) return false;
+		rec.t = t;
+		rec.uv = Vec2(b1, b2);
+		return true;
+	}
 
-			triangles.push_back(Triangle(vertices[f[0]] + origin, vertices[f[1]] + origin, vertices[f[2]] + origin));
-		} else {
-			continue;
-		}	
+	Vec3 normal(uint32_t i) const {
+		const float* n = &normals_[3 * static_cast<size_t>(i)];
+		return Vec3(n[0], n[1], n[2]);
+	}
+
+	static ObjMesh mesh_of(const std::vector<Triangle>& faces) {
+		ObjMesh mesh;
+		const bool smooth = std::any_of(faces.begin(), faces.end(), [](const Triangle& face) { return face.smooth(); });
+		for (const Triangle& face : faces) {
+			const uint32_t first = static_cast<uint32_t>(mesh.positions.size());
+			mesh.positions.insert(mesh.positions.end(), { face.vertex0(), face.vertex0() + face.edge1(), face.vertex0() + face.edge2() });
+			mesh.position_indices.insert(mesh.position_indices.end(), { first, first + 1, first + 2 });
+			if (!smooth) continue;
+			if (face.smooth()) {
+				const uint32_t normal = static_cast<uint32_t>(mesh.normals.size());
+				for (int i = 0; i < 3; i++) mesh.normals.push_back(face.vertex_normal(i));
+				mesh.normal_indices.insert(mesh.normal_indices.end(), { normal, normal + 1, normal + 2 });
+			} else {
+				mesh.normal_indices.insert(mesh.normal_indices.end(), 3, no_index);
+			}
+		}
+		return mesh;
 	}
 
-	return std::make_shared<Object>(std::move(triangles), mat);
+	const Material* mat_;
+	VertexBuffer vertices_;
+	std::vector<uint32_t> owned_indices_;
+	std::vector<float> owned_normals_;
+	std::vector<uint32_t> owned_normal_indices_;
+	std::span<const uint32_t> indices_; //3 vertices per face, in tree order
+	std::span<const float> normals_; //3 floats per unit normal
+	std::span<const uint32_t> normal_indices_; //3 per face, no_index first for a flat face
+	WideBvh bvh_; //leaf children are the first face of their run
+	AABB bbox_;
+	std::shared_ptr<const void> storage_; //mapped cache file the spans point into, if any
+};
+
+
+//Triangles of an OBJ file moved by origin. Faces with vertex normals are smooth shaded.
+inline std::vector<Triangle> load_obj_triangles(const std::string& path, Point3D origin, ThreadPool& pool) {
+	const ObjMesh mesh = load_obj(path, pool);
+	const bool smooth = !mesh.normal_indices.empty();
+	std::vector<Triangle> triangles;
+	triangles.reserve(mesh.triangle_count());
+
+	for (size_t i = 0; i < mesh.position_indices.size(); i += 3) {
+		const uint32_t* v = &mesh.position_indices[i];
+		const Point3D a = mesh.positions[v[0]] + origin, b = mesh.positions[v[1]] + origin, c = mesh.positions[v[2]] + origin;
+		const uint32_t* n = smooth ? &mesh.normal_indices[i] : nullptr;
+		if (n && n[0] != ObjMesh::no_index && n[1] != ObjMesh::no_index && n[2] != ObjMesh::no_index)
+			triangles.emplace_back(a, b, c, mesh.normals[n[0]], mesh.normals[n[1]], mesh.normals[n[2]]);
+		else
+			triangles.emplace_back(a, b, c);
+	}
+	return triangles;
 }
 
+//Writes mesh to a mesh_cache file at path, through a temporary file so a reader never
+//sees half of it. source has to carry its content hash. Returns false when the file
+//cannot be written.
+inline bool save_mesh_cache(const std::string& path, const mesh_cache::Source& source, const Point3D& origin, const Object& mesh) {
+	mesh_cache::Header header{};
+	std::memcpy(header.magic, mesh_cache::magic, sizeof(header.magic));
+	header.version = mesh_cache::version;
+	header.real_size = sizeof(Real);
+	header.node_size = sizeof(WideNode);
+	header.vertex_format = static_cast<uint32_t>(mesh.vertices().format());
+	header.content_hash = source.content_hash.value_or(0);
+	header.source_size = source.size;
+	header.source_mtime = source.mtime;
+	const AABB bbox = mesh.bounding_box();
+	for (int axis = 0; axis < 3; axis++) {
+		header.origin[axis] = origin.e[axis];
+		header.bounds[axis] = bbox.axis_interval(axis).low;
+		header.bounds[3 + axis] = bbox.axis_interval(axis).high;
+		header.quantization[axis] = mesh.vertices().low()[axis];
+		header.quantization[3 + axis] = mesh.vertices().step()[axis];
+	}
+	const auto nodes = mesh.bvh().node_span();
+	header.vertex_count = mesh.vertices().size();
+	header.face_count = mesh.face_count();
+	header.normal_count = mesh.normals().size() / 3;
+	header.normal_index_count = mesh.normal_indices().size();
+	header.node_count = nodes.size();
+	const mesh_cache::Layout layout(header);
+
+	const std::string temp = mesh_cache::temp_path_for(path);
+	std::error_code error;
+	{
+		std::ofstream out(temp, std::ios::trunc | std::ios::binary);
+		if (!out) return false;
+		auto write_at = [&](size_t offset, std::span<const std::byte> data) {
+			while (static_cast<size_t>(out.tellp()) < offset) out.put('\0');
+			out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+		};
+		write_at(0, std::as_bytes(std::span(&header, 1)));
+		write_at(layout.vertices, mesh.vertices().bytes());
+		write_at(layout.indices, std::as_bytes(mesh.indices()));
+		write_at(layout.normals, std::as_bytes(mesh.normals()));
+		write_at(layout.normal_indices, std::as_bytes(mesh.normal_indices()));
+		write_at(layout.nodes, std::as_bytes(nodes));
+		out.close();
+		if (!out) {
+			std::filesystem::remove(temp, error);
+			return false;
+		}
+	}
+	std::filesystem::rename(temp, path, error);
+	if (!error) return true;
+	std::filesystem::remove(temp, error);
+	return false;
+}
+
+//Whether the sections of a cache only refer to what it holds: vertex and normal indices
+//in range, leaves within the faces and inner children after their parent, which rules
+//out cycles, and no deeper than the traversal stacks allow. A corrupted file that kept a
+//valid header is rejected instead of read out of bounds.
+inline bool mesh_cache_in_bounds(const mesh_cache::Header& header, std::span<const uint32_t> indices, std::span<const uint32_t> normal_indices, std::span<const WideNode> nodes) {
+	for (uint32_t v : indices)
+		if (v >= header.vertex_count) return false;
+
+	//without indices of their own, normals are looked up by vertex index.
+	if (normal_indices.empty() && header.normal_count > 0 && header.normal_count < header.vertex_count) return false;
+	if (!normal_indices.empty() && normal_indices.size() != indices.size()) return false;
+	for (size_t i = 0; i < normal_indices.size(); i += 3) {
+		if (normal_indices[i] == ObjMesh::no_index) continue;
+		for (int k = 0; k < 3; k++)
+			if (normal_indices[i + k] >= header.normal_count) return false;
+	}
+
+	std::vector<int> depth(nodes.size(), 0);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		const WideNode& node = nodes[i];
+		for (int slot = 0; slot < wide_bvh_width; slot++) {
+			if (!(node.occupied >> slot & 1)) continue;
+			const uint64_t child = node.child[slot];
+			if (node.count[slot] > 0) {
+				if (node.count[slot] > triangle_block_width || child + node.count[slot] > header.face_count) return false;
+			} else {
+				if (child <= i || child >= nodes.size() || depth[i] + 1 >= bvh::max_depth) return false;
+				depth[child] = std::max(depth[child], depth[i] + 1);
+			}
+		}
+	}
+	return true;
+}
+
+//Maps the mesh_cache file at path, or returns nullptr when there is none, it does not
+//match source, was made for another origin or vertex format or another build's struct
+//layout, or fails mesh_cache_in_bounds. Nothing is copied, the mesh is used straight
+//from the mapping.
+inline std::shared_ptr<Object> load_mesh_cache(const std::string& path, const mesh_cache::Source& source, const Point3D& origin, VertexFormat format, const Material* mat) {
+	if (!std::filesystem::exists(path)) return nullptr;
+	auto file = std::make_shared<const MappedFile>(path);
+	if (file->size() < sizeof(mesh_cache::Header)) return nullptr;
+
+	mesh_cache::Header header;
+	std::memcpy(&header, file->data(), sizeof(header));
+	bool valid = std::memcmp(header.magic, mesh_cache::magic, sizeof(header.magic)) == 0 && header.version == mesh_cache::version
+		&& header.real_size == sizeof(Real) && header.node_size == sizeof(WideNode)
+		&& header.vertex_format == static_cast<uint32_t>(format) && source.matches(header);
+	for (int axis = 0; axis < 3; axis++) valid = valid && header.origin[axis] == static_cast<double>(origin.e[axis]);
+	//every stored element takes at least a byte, which also keeps the layout from overflowing.
+	for (uint64_t count : { header.vertex_count, header.face_count, header.normal_count, header.normal_index_count, header.node_count })
+		valid = valid && count <= file->size();
+	if (!valid || file->size() < mesh_cache::Layout(header).end) return nullptr;
+	const mesh_cache::Layout layout(header);
+
+	const char* data = file->data();
+	VertexBuffer vertices = VertexBuffer::view(format, header.vertex_count, header.quantization, header.quantization + 3,
+		reinterpret_cast<const std::byte*>(data + layout.vertices));
+	const auto indices = mesh_cache::section<uint32_t>(data, layout.indices, 3 * header.face_count);
+	const auto normals = mesh_cache::section<float>(data, layout.normals, 3 * header.normal_count);
+	const auto normal_indices = mesh_cache::section<uint32_t>(data, layout.normal_indices, header.normal_index_count);
+	const auto nodes = mesh_cache::section<WideNode>(data, layout.nodes, header.node_count);
+	if (!mesh_cache_in_bounds(header, indices, normal_indices, nodes)) return nullptr;
+	const WideBvh bvh = WideBvh::view(nodes.data(), nodes.size());
+	const AABB bbox(Point3D(header.bounds[0], header.bounds[1], header.bounds[2]), Point3D(header.bounds[3], header.bounds[4], header.bounds[5]));
+	return std::make_shared<Object>(std::move(vertices), indices, normals, normal_indices, bvh, bbox, mat, file);
+}
+
+//Loads an OBJ as an Object moved by origin, its vertices stored in format, parsing on
+//pool. The built mesh is cached next to the file, so later loads of the same file map the
+//cache instead of parsing and building again. The cache is found by the OBJ's size and
+//modification time; only when those changed, or verify_cache asks for it, is the OBJ
+//read and its content hash compared.
+inline std::shared_ptr<Object> parse_obj(const std::string& path, const Material* mat, Point3D origin, ThreadPool& pool, VertexFormat format = VertexFormat::full, bool verify_cache = false) {
+	const std::string cache = mesh_cache::path_for(path);
+	mesh_cache::Source source = mesh_cache::Source::of(path);
+	if (!verify_cache)
+		if (auto mesh = load_mesh_cache(cache, source, origin, format, mat)) return mesh;
+
+	const MappedFile file(path);
+	source.content_hash = mesh_cache::content_hash(file.data(), file.size());
+	if (auto mesh = load_mesh_cache(cache, source, origin, format, mat)) {
+		//same content under a new stamp, e.g. a copied file: store it so the next load skips the hash.
+		if (!verify_cache) save_mesh_cache(cache, source, origin, *mesh);
+		return mesh;
+	}
+
+	ObjMesh obj = load_obj(file, path, pool);
+	for (Point3D& p : obj.positions) p += origin;
+	auto mesh = std::make_shared<Object>(obj, mat, format);
+	if (!save_mesh_cache(cache, source, origin, *mesh)) std::println("Unable to write the mesh cache {}", cache);
+	return mesh;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include "vec.hpp"
+
+inline double luminance(const Vec3& c) {
+	return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
+//Running mean and variance of a pixel's sample luminance (Welford's update), used to
+//decide when a pixel has converged.
+struct PixelStats {
+	int count = 0;
+	double mean = 0.0;
+	double m2 = 0.0;
+
+	void add(double value) {
+		count++;
+		const double delta = value - mean;
+		mean += delta / count;
+		m2 += delta * (value - mean);
+	}
+
+	//Variance of the mean luminance, the square of its standard error. 0 until there are
+	//two samples.
+	double mean_variance() const {
+		return count < 2 ? 0.0 : m2 / (static_cast<double>(count) * (count - 1));
+	}
+
+	//Standard error of the mean, converted to display units through the slope of the
+	//gamma 2 curve at the mean, so dark pixels are held to the same visible error as bright
+	//ones. threshold is in [0, 1] display units.
+	bool converged(double threshold) const {
+		if (count < 2) return false;
+		const double std_error = std::sqrt(mean_variance());
+		const double gamma_slope = 0.5 / std::sqrt(std::max(mean, 1e-4));
+		return std_error * gamma_slope <= threshold;
+	}
+};
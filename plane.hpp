@@ -1,18 +1,21 @@
 #pragma once
 
+#include <bit>
 #include "hittable.hpp"
+#include "simd_pack.hpp"
 #include "vec.hpp"
 
 class Plane : public Hittable {
 public:
 
-	explicit Plane(Point3D point, Vec3 normal, std::shared_ptr<Material> mat) : p_(std::move(point)), n_(std::move(normal)), mat_(mat) {
+	explicit Plane(Point3D point, Vec3 normal, const Material* mat) : p_(std::move(point)), n_(std::move(normal)), mat_(mat) {
 		Vec3 a = (std::abs(n_.x()) > 0.9) ? Vec3(0, 1, 0) : Vec3(1, 0, 0);
 		t1_ = unit_vector(cross(a, n_));
 		t2_ = cross(n_, t1_);
 	};
 
 	bool hit(const Ray &r, Interval ray_t, HitRecord &rec) const override {
+		ray_stats::count_tests(1);
 		//calculate T
 		// t = (r0 - p) * n / Rn_ * n_
 		auto bottom = dot(r.direction(), n_);
@@ -22,19 +25,73 @@ public:
 
 		if (ray_t.contains(t)) {
 			rec.t = t;
-			rec.p = r.at(t);
-			rec.set_face_normal(r, n_);
-			rec.mat = mat_;
-			rec.uv = Vec2(dot(rec.p - p_, t1_), dot(rec.p - p_, t2_));
+			rec.object = this;
+			rec.prim = 0;
 			return true;
 		}
 
 		return false;
 	}
+
+	bool occluded(const Ray& r, Interval ray_t) const override {
+		ray_stats::count_tests(1);
+		auto bottom = dot(r.direction(), n_);
+		if (std::abs(bottom) < 1e-12) return false;
+		return ray_t.contains(dot((p_ - r.origin()), n_) / bottom);
+	}
+
+#if HAVE_AVX2
+	void hit_packet(const RayPacket& packet, unsigned lanes, PacketHit& hits) const override {
+		using Pack = RealPack;
+		ray_stats::count_tests(std::popcount(lanes));
+		const Pack nx = Pack::broadcast(n_.x()), ny = Pack::broadcast(n_.y()), nz = Pack::broadcast(n_.z());
+		const Pack pn = Pack::broadcast(dot(p_, n_));
+		const Pack t_min = Pack::broadcast(packet.t_min);
+		const Pack eps = Pack::broadcast(1e-12);
+		constexpr unsigned group_mask = (1u << Pack::width) - 1;
+
+		for (int base = 0; base < packet_width; base += Pack::width) {
+			if (((lanes >> base) & group_mask) == 0) continue;
+
+			const Pack bottom = Pack::load(&packet.dir[0][base]) * nx + Pack::load(&packet.dir[1][base]) * ny + Pack::load(&packet.dir[2][base]) * nz;
+			const Pack on = Pack::load(&packet.origin[0][base]) * nx + Pack::load(&packet.origin[1][base]) * ny + Pack::load(&packet.origin[2][base]) * nz;
+			const Pack t = (pn - on) / bottom;
+
+			const Pack ok = (abs(bottom) >= eps) & (t >= t_min) & (t <= Pack::loadu(&hits.t_max[base]));
+
+			unsigned found = ok.movemask() & ((lanes >> base) & group_mask);
+			if (found == 0) continue;
+
+			alignas(32) Real ts[Pack::width];
+			t.store(ts);
+			while (found) {
+				int i = std::countr_zero(found);
+				found &= found - 1;
+
+				const int lane = base + i;
+				hits.rec[lane].t = ts[i];
+				hits.rec[lane].object = this;
+				hits.rec[lane].prim = 0;
+				hits.t_max[lane] = ts[i];
+				hits.mask |= 1u << lane;
+			}
+		}
+	}
+#endif
+
+	void finalize(const Ray& r, HitRecord& rec) const override {
+		rec.p = r.at(rec.t);
+		rec.set_face_normal(r, n_);
+		rec.mat = mat_;
+		rec.uv = Vec2(dot(rec.p - p_, t1_), dot(rec.p - p_, t2_));
+	}
+
+	//planes are infinite, the BVH keeps them outside the tree.
+	AABB bounding_box() const override { return AABB::universe; }
 private:
 	Point3D p_;
 	Vec3 n_;
-	std::shared_ptr<Material> mat_;
+	const Material* mat_;
 
 	Vec3 t1_;
 	Vec3 t2_;
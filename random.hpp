@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "simd_config.hpp"
+
+//Random numbers for rendering. Every path draws from its own stream, seeded from
+//(pixel, sample, bounce), so an image does not depend on which thread rendered which tile
+//or in what order. The camera jitter comes from a counter based hash instead, which has a
+//SIMD batch form for whole packets.
+namespace rng {
+
+//SplitMix64 finalizer, a full avalanche 64 bit mix.
+inline uint64_t mix64(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+//lowbias32, a 32 bit integer hash that only needs 32 bit multiplies.
+inline uint32_t hash32(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+	return x;
+}
+
+//seed of the stream used while shading bounce of a path.
+inline uint64_t path_seed(uint32_t pixel, uint32_t sample, uint32_t bounce) {
+	return mix64((static_cast<uint64_t>(pixel) << 32 | sample) ^ mix64(bounce + 1));
+}
+
+//key of one (pixel, sample) for the counter based values below.
+inline uint32_t sample_key(uint32_t pixel, uint32_t sample) {
+	return hash32(pixel ^ hash32(sample + 0x9E3779B9u));
+}
+
+//uniform float in [0, 1) for dimension dim of a sample key, 24 bits of resolution.
+inline float uniform(uint32_t key, uint32_t dim) {
+	return static_cast<float>(hash32(key + dim * 0x9E3779B9u) >> 8) * 0x1.0p-24f;
+}
+
+//uniform() for count keys at once, 8 per AVX2 step. Gives the same values as the scalar
+//version, lane for lane.
+inline void uniform_batch(const uint32_t* keys, size_t count, uint32_t dim, float* out) {
+	size_t i = 0;
+#if HAVE_AVX2
+	const __m256i offset = _mm256_set1_epi32(static_cast<int>(dim * 0x9E3779B9u));
+	const __m256i m1 = _mm256_set1_epi32(0x7FEB352D);
+	const __m256i m2 = _mm256_set1_epi32(static_cast<int>(0x846CA68Bu));
+	const __m256 scale = _mm256_set1_ps(0x1.0p-24f);
+	for (; i + 8 <= count; i += 8) {
+		__m256i x = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), offset);
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+		x = _mm256_mullo_epi32(x, m1);
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+		x = _mm256_mullo_epi32(x, m2);
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8)), scale));
+	}
+#endif
+	for (; i < count; i++) out[i] = uniform(keys[i], dim);
+}
+
+}
+
+//SplitMix64: one 64 bit add and a mix per value, 8 bytes of state.
+class Rng {
+public:
+	explicit Rng(uint64_t seed = 0) : state_(seed) {}
+
+	void seed(uint64_t seed) { state_ = seed; }
+
+	uint64_t next() {
+		state_ += 0x9E3779B97F4A7C15ull;
+		return rng::mix64(state_);
+	}
+
+	//[0.0, 1.0) with 53 bits of resolution
+	double next_double() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+
+private:
+	uint64_t state_;
+};
+
+//the stream random_double() draws from on this thread.
+inline Rng& thread_rng() {
+	thread_local Rng rng;
+	return rng;
+}
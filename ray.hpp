@@ -2,21 +2,24 @@
 
 #include "vec.hpp"
 
-class Ray {
+template<typename T>
+class RayT {
 public:
-	Ray() {}
+	RayT() {}
 
-	Ray(const Point3D& org, const Vec3& direction) : orig(org), dir(direction) {}
+	RayT(const Vec3T<T>& org, const Vec3T<T>& direction) : orig(org), dir(direction) {}
 	
 
-	const Point3D& origin() const { return orig; }
-	const Vec3& direction() const { return dir; }
+	const Vec3T<T>& origin() const { return orig; }
+	const Vec3T<T>& direction() const { return dir; }
 
 	//calculates the point3D(Vec3) that is at the delta T on the ray line.
-	Vec3 at(double t) const {
+	Vec3T<T> at(T t) const {
 		return orig + t*dir;
 	}
 private:
-	Point3D orig;
-	Vec3 dir;
+	Vec3T<T> orig;
+	Vec3T<T> dir;
 };
+
+using Ray = RayT<Real>;
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ray.hpp"
+
+constexpr int packet_width = 8;
+
+//Up to eight coherent rays traced together. The rays are kept whole for the scalar paths
+//and transposed into SoA lanes for the SIMD kernels.
+struct RayPacket {
+	Ray rays[packet_width];
+	alignas(32) Real origin[3][packet_width];
+	alignas(32) Real dir[3][packet_width];
+	alignas(32) Real inv_dir[3][packet_width];
+	Real t_min = 0.001;
+
+	void set(int lane, const Ray& r) {
+		rays[lane] = r;
+		for (int axis = 0; axis < 3; axis++) {
+			origin[axis][lane] = r.origin().e[axis];
+			dir[axis][lane] = r.direction().e[axis];
+			inv_dir[axis][lane] = Real(1) / r.direction().e[axis];
+		}
+	}
+};
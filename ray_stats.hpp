@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+//Per thread count of the intersection tests done, for the cost AOV. A test is one BVH node
+//visited by one ray or one primitive tested against one ray. `make COUNT_TESTS=1` defines
+//RT_COUNT_TESTS; without it counting compiles to nothing and test_count() stays 0.
+namespace ray_stats {
+
+#ifdef RT_COUNT_TESTS
+constexpr bool enabled = true;
+
+inline uint64_t& thread_tests() {
+	thread_local uint64_t tests = 0;
+	return tests;
+}
+
+inline void count_tests(uint64_t n) { thread_tests() += n; }
+inline uint64_t test_count() { return thread_tests(); }
+#else
+constexpr bool enabled = false;
+
+inline void count_tests(uint64_t) {}
+inline uint64_t test_count() { return 0; }
+#endif
+
+}
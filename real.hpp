@@ -0,0 +1,9 @@
+#pragma once
+
+//Scalar used by the renderer's math types. `make PRECISION=float` defines RT_FLOAT and
+//builds everything in single precision, which doubles the lanes per AVX2 register.
+#ifdef RT_FLOAT
+using Real = float;
+#else
+using Real = double;
+#endif
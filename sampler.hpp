@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include "random.hpp"
+#include "vec.hpp"
+
+//Where the sample values of a path come from. random draws from the path's rng stream.
+//sobol gives every pixel its own Owen scrambled Sobol sequence, so the samples of a pixel
+//are stratified. blue_noise shares one scrambled sequence between all pixels and offsets
+//it per pixel by a blue noise mask, which pushes the remaining error to high frequencies.
+enum class SamplerType {
+	random,
+	sobol,
+	blue_noise
+};
+
+inline std::optional<SamplerType> parse_sampler(std::string_view name) {
+	if (name == "random") return SamplerType::random;
+	if (name == "sobol") return SamplerType::sobol;
+	if (name == "blue_noise") return SamplerType::blue_noise;
+	return std::nullopt;
+}
+
+//Samples are drawn two dimensions at a time from independently scrambled 2D Sobol points
+//(Burley, "Practical Hash-based Owen Scrambling"). The camera uses pair 0 for the pixel and
+//pair 1 for the lens, bounce b starts at pair first_bounce_pair + b * pairs_per_bounce.
+constexpr uint32_t first_bounce_pair = 2;
+constexpr uint32_t pairs_per_bounce = 4;
+
+namespace sobol {
+
+inline uint32_t reverse_bits(uint32_t x) {
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00FF00FFu) << 8) | ((x & 0xFF00FF00u) >> 8);
+	x = ((x & 0x0F0F0F0Fu) << 4) | ((x & 0xF0F0F0F0u) >> 4);
+	x = ((x & 0x33333333u) << 2) | ((x & 0xCCCCCCCCu) >> 2);
+	x = ((x & 0x55555555u) << 1) | ((x & 0xAAAAAAAAu) >> 1);
+	return x;
+}
+
+//second Sobol dimension, the first is reverse_bits(index).
+inline uint32_t dimension1(uint32_t index) {
+	uint32_t result = 0;
+	for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+		if (index & 1) result ^= v;
+	return result;
+}
+
+//Laine and Karras style hash that only lets each bit depend on the bits below it.
+inline uint32_t laine_karras(uint32_t x, uint32_t seed) {
+	x += seed;
+	x ^= x * 0x6C50B47Cu;
+	x ^= x * 0xB82F1E52u;
+	x ^= x * 0xC7AFE638u;
+	x ^= x * 0x8D22F6E6u;
+	return x;
+}
+
+//Owen scrambling of a 32 bit fixed point value: every bit is flipped depending on the
+//bits above it.
+inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+	return reverse_bits(laine_karras(reverse_bits(x), seed));
+}
+
+//Point index of a shuffled, Owen scrambled 2D Sobol sequence, in 32 bit fixed point.
+//Any power of two run of indices starting at 0 still forms a stratified net.
+inline void point(uint32_t index, uint32_t seed, uint32_t& x, uint32_t& y) {
+	const uint32_t shuffled = nested_uniform_scramble(index, rng::hash32(seed));
+	x = nested_uniform_scramble(reverse_bits(shuffled), rng::hash32(seed ^ 0xA511E9B3u));
+	y = nested_uniform_scramble(dimension1(shuffled), rng::hash32(seed ^ 0x63D83595u));
+}
+
+}
+
+namespace blue_noise {
+
+constexpr int mask_size = 64;
+
+//A mask_size x mask_size tile of the ranks 0 .. mask_size^2 - 1, built once by the void
+//and cluster ordering: every rank goes to the empty pixel farthest from the ones placed
+//so far, measured by a toroidal Gaussian energy.
+inline const std::vector<uint16_t>& mask() {
+	static const std::vector<uint16_t> ranks = [] {
+		constexpr int n = mask_size, count = n * n;
+		constexpr double sigma = 1.9;
+
+		std::vector<double> kernel(count);
+		for (int dy = 0; dy < n; dy++) {
+			for (int dx = 0; dx < n; dx++) {
+				const int tx = std::min(dx, n - dx), ty = std::min(dy, n - dy);
+				kernel[dy * n + dx] = std::exp(-(tx * tx + ty * ty) / (2 * sigma * sigma));
+			}
+		}
+
+		std::vector<double> energy(count, 0.0);
+		std::vector<uint16_t> result(count);
+		std::vector<bool> placed(count, false);
+		for (int rank = 0; rank < count; rank++) {
+			int best = 0;
+			double best_energy = infinity;
+			for (int i = 0; i < count; i++) {
+				if (!placed[i] && energy[i] < best_energy) {
+					best_energy = energy[i];
+					best = i;
+				}
+			}
+
+			placed[best] = true;
+			result[best] = static_cast<uint16_t>(rank);
+			const int bx = best % n, by = best / n;
+			for (int y = 0; y < n; y++) {
+				const double* row = &kernel[((y - by + n) % n) * n];
+				for (int x = 0; x < n; x++) energy[y * n + x] += row[(x - bx + n) % n];
+			}
+		}
+		return result;
+	}();
+	return ranks;
+}
+
+//mask value at a pixel as an offset in [0, 1), shifted per dimension so the dimensions
+//of a pixel are not correlated.
+inline double offset(uint32_t x, uint32_t y, uint32_t dimension) {
+	const uint32_t h = rng::hash32(dimension + 0x2C1B3C6Du);
+	const uint32_t mx = (x + h) % mask_size;
+	const uint32_t my = (y + (h >> 16)) % mask_size;
+	return (mask()[my * mask_size + mx] + 0.5) / (mask_size * mask_size);
+}
+
+}
+
+//value of dimension pair of a pixel sample, in [0, 1)^2. Not for SamplerType::random.
+inline Vec2 sample_pair(SamplerType type, uint32_t pixel, uint32_t x, uint32_t y, uint32_t sample, uint32_t pair) {
+	uint32_t u, v;
+	if (type == SamplerType::sobol) {
+		sobol::point(sample, rng::hash32(pixel) ^ rng::hash32(pair + 0x68E31DA4u), u, v);
+		return Vec2(u * 0x1.0p-32, v * 0x1.0p-32);
+	}
+
+	//one sequence for the image, Cranley-Patterson rotated by the mask.
+	sobol::point(sample, rng::hash32(pair + 0x68E31DA4u), u, v);
+	double a = u * 0x1.0p-32 + blue_noise::offset(x, y, 2 * pair);
+	double b = v * 0x1.0p-32 + blue_noise::offset(x, y, 2 * pair + 1);
+	return Vec2(a >= 1.0 ? a - 1.0 : a, b >= 1.0 ? b - 1.0 : b);
+}
+
+//The sampler state of the path a thread is shading. The camera starts every bounce with
+//begin_bounce(); materials then take their values with sample_1d() and sample_2d().
+class SampleStream {
+public:
+	void begin_bounce(SamplerType type, uint32_t pixel, uint32_t image_width, uint32_t sample, uint32_t bounce) {
+		type_ = type;
+		pixel_ = pixel;
+		x_ = pixel % image_width;
+		y_ = pixel / image_width;
+		sample_ = sample;
+		pair_ = first_bounce_pair + bounce * pairs_per_bounce;
+		thread_rng().seed(rng::path_seed(pixel, sample, bounce));
+	}
+
+	Vec2 next_2d() {
+		if (type_ == SamplerType::random) return Vec2(random_double(), random_double());
+		return sample_pair(type_, pixel_, x_, y_, sample_, pair_++);
+	}
+
+private:
+	SamplerType type_ = SamplerType::random;
+	uint32_t pixel_ = 0, x_ = 0, y_ = 0, sample_ = 0, pair_ = 0;
+};
+
+inline SampleStream& thread_sampler() {
+	thread_local SampleStream stream;
+	return stream;
+}
+
+inline Vec2 sample_2d() { return thread_sampler().next_2d(); }
+
+//one dimension, it uses up a whole pair.
+inline double sample_1d() { return sample_2d().x(); }
@@ -9,3 +9,10 @@
     #define HAVE_X86_SIMD 0
 #endif
 
+// AVX2 kernels are only compiled in when the target allows them (-march=native in RELEASE),
+// every such kernel keeps a scalar path for the other builds.
+#if HAVE_X86_SIMD && defined(__AVX2__)
+    #define HAVE_AVX2 1
+#else
+    #define HAVE_AVX2 0
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "real.hpp"
+#include "simd_config.hpp"
+
+#if HAVE_AVX2
+
+//One AVX register of scalars: 8 floats or 4 doubles. Packet kernels are written once
+//against SimdPack<T> and step through a packet width lanes at a time, so the float build
+//covers a whole 8-ray packet per instruction. Comparisons return a lane mask as a pack.
+template<typename T>
+struct SimdPack;
+
+template<>
+struct SimdPack<float> {
+	static constexpr int width = 8;
+	__m256 v;
+
+	static SimdPack load(const float* p) { return { _mm256_load_ps(p) }; }
+	static SimdPack loadu(const float* p) { return { _mm256_loadu_ps(p) }; }
+	static SimdPack broadcast(float x) { return { _mm256_set1_ps(x) }; }
+	static SimdPack zero() { return { _mm256_setzero_ps() }; }
+	void store(float* p) const { _mm256_store_ps(p, v); }
+
+	friend SimdPack operator+(SimdPack a, SimdPack b) { return { _mm256_add_ps(a.v, b.v) }; }
+	friend SimdPack operator-(SimdPack a, SimdPack b) { return { _mm256_sub_ps(a.v, b.v) }; }
+	friend SimdPack operator*(SimdPack a, SimdPack b) { return { _mm256_mul_ps(a.v, b.v) }; }
+	friend SimdPack operator/(SimdPack a, SimdPack b) { return { _mm256_div_ps(a.v, b.v) }; }
+	friend SimdPack operator&(SimdPack a, SimdPack b) { return { _mm256_and_ps(a.v, b.v) }; }
+	friend SimdPack operator|(SimdPack a, SimdPack b) { return { _mm256_or_ps(a.v, b.v) }; }
+	friend SimdPack operator<(SimdPack a, SimdPack b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+	friend SimdPack operator<=(SimdPack a, SimdPack b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+	friend SimdPack operator>(SimdPack a, SimdPack b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+	friend SimdPack operator>=(SimdPack a, SimdPack b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+
+	//like the intrinsics, min and max return b when either operand is NaN.
+	friend SimdPack min(SimdPack a, SimdPack b) { return { _mm256_min_ps(a.v, b.v) }; }
+	friend SimdPack max(SimdPack a, SimdPack b) { return { _mm256_max_ps(a.v, b.v) }; }
+	friend SimdPack sqrt(SimdPack a) { return { _mm256_sqrt_ps(a.v) }; }
+	friend SimdPack abs(SimdPack a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+	//lanes of a where mask is set, b elsewhere
+	friend SimdPack select(SimdPack mask, SimdPack a, SimdPack b) { return { _mm256_blendv_ps(b.v, a.v, mask.v) }; }
+
+	unsigned movemask() const { return static_cast<unsigned>(_mm256_movemask_ps(v)); }
+};
+
+template<>
+struct SimdPack<double> {
+	static constexpr int width = 4;
+	__m256d v;
+
+	static SimdPack load(const double* p) { return { _mm256_load_pd(p) }; }
+	static SimdPack loadu(const double* p) { return { _mm256_loadu_pd(p) }; }
+	static SimdPack broadcast(double x) { return { _mm256_set1_pd(x) }; }
+	static SimdPack zero() { return { _mm256_setzero_pd() }; }
+	void store(double* p) const { _mm256_store_pd(p, v); }
+
+	friend SimdPack operator+(SimdPack a, SimdPack b) { return { _mm256_add_pd(a.v, b.v) }; }
+	friend SimdPack operator-(SimdPack a, SimdPack b) { return { _mm256_sub_pd(a.v, b.v) }; }
+	friend SimdPack operator*(SimdPack a, SimdPack b) { return { _mm256_mul_pd(a.v, b.v) }; }
+	friend SimdPack operator/(SimdPack a, SimdPack b) { return { _mm256_div_pd(a.v, b.v) }; }
+	friend SimdPack operator&(SimdPack a, SimdPack b) { return { _mm256_and_pd(a.v, b.v) }; }
+	friend SimdPack operator|(SimdPack a, SimdPack b) { return { _mm256_or_pd(a.v, b.v) }; }
+	friend SimdPack operator<(SimdPack a, SimdPack b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ) }; }
+	friend SimdPack operator<=(SimdPack a, SimdPack b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ) }; }
+	friend SimdPack operator>(SimdPack a, SimdPack b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ) }; }
+	friend SimdPack operator>=(SimdPack a, SimdPack b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ) }; }
+
+	friend SimdPack min(SimdPack a, SimdPack b) { return { _mm256_min_pd(a.v, b.v) }; }
+	friend SimdPack max(SimdPack a, SimdPack b) { return { _mm256_max_pd(a.v, b.v) }; }
+	friend SimdPack sqrt(SimdPack a) { return { _mm256_sqrt_pd(a.v) }; }
+	friend SimdPack abs(SimdPack a) { return { _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v) }; }
+	friend SimdPack select(SimdPack mask, SimdPack a, SimdPack b) { return { _mm256_blendv_pd(b.v, a.v, mask.v) }; }
+
+	unsigned movemask() const { return static_cast<unsigned>(_mm256_movemask_pd(v)); }
+};
+
+using RealPack = SimdPack<Real>;
+
+#endif
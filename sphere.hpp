@@ -1,14 +1,36 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
 #include "hittable.hpp"
+#include "simd_pack.hpp"
 #include "vec.hpp"
 
+//Point, normal and uv of a hit on the sphere (center, radius) at rec.t. Shared by Sphere
+//and SphereSet.
+inline void sphere_surface(const Ray& r, const Point3D& center, Real radius, HitRecord& rec) {
+	rec.p = r.at(rec.t);
+	Vec3 outward_normal = (rec.p - center) / radius; //the vector from center to P, normalized.
+	rec.set_face_normal(r, outward_normal);
+
+	auto world_hit = unit_vector(outward_normal);
+	//the outward_normal is also just the vector on the unit_sphere
+	//Let's calculate the UV for a sphere...
+	auto theta = std::acos(std::clamp<Real>(world_hit.y(), -1, 1));
+	auto phi = std::atan2(world_hit.z(), world_hit.x());
+
+	rec.uv = Vec2(((phi + pi) / (2 * pi)), (1.0 - (theta / pi)));
+}
 
 class Sphere : public Hittable {
 public:
-	Sphere(const Point3D& center, double radius, std::shared_ptr<Material> mat) : center_(center), radius(std::fmax(0, radius)), mat(mat) {}
+	Sphere(const Point3D& center, Real radius, const Material* mat) : center_(center), radius(std::fmax(Real(0), radius)), mat(mat) {
+		auto rvec = Vec3(radius, radius, radius);
+		bbox = AABB(center_ - rvec, center_ + rvec);
+	}
 
 	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+		ray_stats::count_tests(1);
 		Vec3 oc = center_ - r.origin();
 		auto a = r.direction().length_squared();
 		auto h = dot(r.direction(), oc);
@@ -23,32 +45,96 @@ public:
 		auto sqrtd = std::sqrt(descriminant);
 
 		auto root = (h - sqrtd) / a;
-		if (!ray_t.surrounds(root)) 
+		if (!ray_t.surrounds(root))
 		{
 			root = (h + sqrtd) / a;
-			if (!ray_t.surrounds(root)) 
+			if (!ray_t.surrounds(root))
 				return false;
 		}
 
 		rec.t = root;
-		rec.p = r.at(rec.t);
-		Vec3 outward_normal = (rec.p - center_) / radius; //the vector from center to P, normalized.
-		rec.set_face_normal(r, outward_normal);
-		rec.mat = mat;
+		rec.object = this;
+		rec.prim = 0;
+		return true;
+	}
 
-		auto world_hit = unit_vector(outward_normal);
-		//the outward_normal is also just the vector on the unit_sphere
-		//Let's calculate the UV for a sphere...
-		auto theta = std::acos(std::clamp(world_hit.y(), -1.0, 1.0));
-		auto phi = std::atan2(world_hit.z(), world_hit.x());
+	bool occluded(const Ray& r, Interval ray_t) const override {
+		ray_stats::count_tests(1);
+		Vec3 oc = center_ - r.origin();
+		auto a = r.direction().length_squared();
+		auto h = dot(r.direction(), oc);
+		auto c = oc.length_squared() - radius*radius;
 
+		auto descriminant = h*h - a*c;
+		if (descriminant < 0) return false;
 
-		rec.uv = Vec2(((phi + pi) / (2 * pi)), (1.0 - (theta / pi)));
-		return true;
+		auto sqrtd = std::sqrt(descriminant);
+		return ray_t.surrounds((h - sqrtd) / a) || ray_t.surrounds((h + sqrtd) / a);
+	}
+
+#if HAVE_AVX2
+	//same quadratic as hit(), solved for RealPack::width lanes of the packet at a time.
+	void hit_packet(const RayPacket& packet, unsigned lanes, PacketHit& hits) const override {
+		using Pack = RealPack;
+		ray_stats::count_tests(std::popcount(lanes));
+		const Pack cx = Pack::broadcast(center_.x()), cy = Pack::broadcast(center_.y()), cz = Pack::broadcast(center_.z());
+		const Pack r2 = Pack::broadcast(radius * radius);
+		const Pack t_min = Pack::broadcast(packet.t_min);
+		const Pack zero = Pack::zero();
+		constexpr unsigned group_mask = (1u << Pack::width) - 1;
+
+		for (int base = 0; base < packet_width; base += Pack::width) {
+			if (((lanes >> base) & group_mask) == 0) continue;
+
+			const Pack dx = Pack::load(&packet.dir[0][base]), dy = Pack::load(&packet.dir[1][base]), dz = Pack::load(&packet.dir[2][base]);
+			const Pack ocx = cx - Pack::load(&packet.origin[0][base]);
+			const Pack ocy = cy - Pack::load(&packet.origin[1][base]);
+			const Pack ocz = cz - Pack::load(&packet.origin[2][base]);
+
+			const Pack a = dx * dx + dy * dy + dz * dz;
+			const Pack h = dx * ocx + dy * ocy + dz * ocz;
+			const Pack c = ocx * ocx + ocy * ocy + ocz * ocz - r2;
+			const Pack disc = h * h - a * c;
+
+			const Pack sqrtd = sqrt(max(disc, zero));
+			const Pack near = (h - sqrtd) / a;
+			const Pack far = (h + sqrtd) / a;
+			const Pack t_max = Pack::loadu(&hits.t_max[base]);
+
+			const Pack real = disc >= zero;
+			const Pack near_ok = real & (near > t_min) & (near < t_max);
+			const Pack far_ok = real & (far > t_min) & (far < t_max);
+
+			unsigned found = (near_ok | far_ok).movemask() & ((lanes >> base) & group_mask);
+			if (found == 0) continue;
+
+			alignas(32) Real roots[Pack::width];
+			select(near_ok, near, far).store(roots);
+			while (found) {
+				int i = std::countr_zero(found);
+				found &= found - 1;
+
+				const int lane = base + i;
+				hits.rec[lane].t = roots[i];
+				hits.rec[lane].object = this;
+				hits.rec[lane].prim = 0;
+				hits.t_max[lane] = roots[i];
+				hits.mask |= 1u << lane;
+			}
+		}
 	}
+#endif
+
+	void finalize(const Ray& r, HitRecord& rec) const override {
+		sphere_surface(r, center_, radius, rec);
+		rec.mat = mat;
+	}
+
+	AABB bounding_box() const override { return bbox; }
 
 private:
 	Point3D center_;
-	double radius;
-	std::shared_ptr<Material> mat;
+	Real radius;
+	const Material* mat;
+	AABB bbox;
 };
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+#include "hittable.hpp"
+#include "simd_pack.hpp"
+#include "sphere.hpp"
+#include "wide_bvh.hpp"
+
+constexpr int sphere_block_width = 8;
+
+//Eight spheres of a leaf in structure-of-arrays form. Lanes past the leaf's count are
+//masked off by the caller.
+struct alignas(32) SphereBlock {
+	Real center[3][sphere_block_width];
+	Real radius2[sphere_block_width];
+};
+
+//Closest root of ray r against the first count spheres of a block, inside (t_min, t_max).
+//Returns the lane of the hit or -1, and the root in t.
+inline int intersect_spheres(const SphereBlock& block, int count, const Real* origin, const Real* dir, Real t_min, Real t_max, Real& t) {
+	alignas(32) Real roots[sphere_block_width];
+	unsigned found = 0;
+	const Real a = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+
+#if HAVE_AVX2
+	using Pack = RealPack;
+	const Pack ox = Pack::broadcast(origin[0]), oy = Pack::broadcast(origin[1]), oz = Pack::broadcast(origin[2]);
+	const Pack dx = Pack::broadcast(dir[0]), dy = Pack::broadcast(dir[1]), dz = Pack::broadcast(dir[2]);
+	const Pack pa = Pack::broadcast(a);
+	const Pack lo = Pack::broadcast(t_min), hi = Pack::broadcast(t_max);
+	const Pack zero = Pack::zero();
+
+	for (int base = 0; base < count; base += Pack::width) {
+		const Pack ocx = Pack::load(&block.center[0][base]) - ox;
+		const Pack ocy = Pack::load(&block.center[1][base]) - oy;
+		const Pack ocz = Pack::load(&block.center[2][base]) - oz;
+
+		const Pack h = dx * ocx + dy * ocy + dz * ocz;
+		const Pack c = ocx * ocx + ocy * ocy + ocz * ocz - Pack::load(&block.radius2[base]);
+		const Pack disc = h * h - pa * c;
+
+		const Pack sqrtd = sqrt(max(disc, zero));
+		const Pack near = (h - sqrtd) / pa;
+		const Pack far = (h + sqrtd) / pa;
+
+		const Pack real = disc >= zero;
+		const Pack near_ok = real & (near > lo) & (near < hi);
+		const Pack far_ok = real & (far > lo) & (far < hi);
+		select(near_ok, near, far).store(&roots[base]);
+		found |= (near_ok | far_ok).movemask() << base;
+	}
+#else
+	for (int i = 0; i < count; i++) {
+		const Real ocx = block.center[0][i] - origin[0], ocy = block.center[1][i] - origin[1], ocz = block.center[2][i] - origin[2];
+		const Real h = dir[0] * ocx + dir[1] * ocy + dir[2] * ocz;
+		const Real c = ocx * ocx + ocy * ocy + ocz * ocz - block.radius2[i];
+		const Real disc = h * h - a * c;
+		if (disc < 0) continue;
+
+		const Real sqrtd = std::sqrt(disc);
+		Real root = (h - sqrtd) / a;
+		if (root <= t_min || root >= t_max) root = (h + sqrtd) / a;
+		if (root <= t_min || root >= t_max) continue;
+		roots[i] = root;
+		found |= 1u << i;
+	}
+#endif
+
+	found &= (1u << count) - 1;
+	int lane = -1;
+	t = t_max;
+	for (; found; found &= found - 1) {
+		const int i = std::countr_zero(found);
+		if (roots[i] < t) {
+			t = roots[i];
+			lane = i;
+		}
+	}
+	return lane;
+}
+
+//A field of spheres stored as one primitive: positions and radii live in SoA blocks under
+//a WideBvh, materials are referenced by id into a small palette. Meant for dense sphere
+//scenes, where one Sphere object per sphere costs a virtual call and a pointer chase each.
+class SphereSet : public Hittable {
+public:
+	void add(const Point3D& center, Real radius, const Material* mat) {
+		centers_.push_back(center);
+		radii_.push_back(std::max(Real(0), radius));
+
+		auto it = std::find(materials_.begin(), materials_.end(), mat);
+		material_ids_.push_back(static_cast<uint32_t>(it - materials_.begin()));
+		if (it == materials_.end()) materials_.push_back(mat);
+	}
+
+	size_t size() const { return centers_.size(); }
+
+	//Sorts the spheres into leaf order and packs the blocks. Call once after the last add().
+	void build() {
+		std::vector<AABB> boxes;
+		boxes.reserve(size());
+		bbox_ = AABB();
+		for (size_t i = 0; i < size(); i++) {
+			const Vec3 rvec(radii_[i], radii_[i], radii_[i]);
+			boxes.emplace_back(centers_[i] - rvec, centers_[i] + rvec);
+			bbox_ = AABB(bbox_, boxes.back());
+		}
+
+		std::vector<uint32_t> order;
+		bvh_ = WideBvh::build(boxes, order, sphere_block_width);
+		permute(centers_, order);
+		permute(radii_, order);
+		permute(material_ids_, order);
+
+		blocks_.clear();
+		block_first_.clear();
+		for (auto& node : bvh_.nodes) {
+			for (int i = 0; i < wide_bvh_width; i++) {
+				if (node.count[i] == 0) continue;
+
+				SphereBlock block{};
+				for (int lane = 0; lane < node.count[i]; lane++) {
+					const uint32_t sphere = node.child[i] + lane;
+					for (int axis = 0; axis < 3; axis++) block.center[axis][lane] = centers_[sphere].e[axis];
+					block.radius2[lane] = radii_[sphere] * radii_[sphere];
+				}
+				block_first_.push_back(node.child[i]);
+				node.child[i] = static_cast<uint32_t>(blocks_.size());
+				blocks_.push_back(block);
+			}
+		}
+	}
+
+	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+		bool hit_anything = false;
+		const Real* origin = r.origin().e;
+		const Real* dir = r.direction().e;
+
+		bvh_.traverse(r, ray_t, [&](uint32_t block, uint32_t count, Interval& t) {
+			ray_stats::count_tests(count);
+			Real root;
+			const int lane = intersect_spheres(blocks_[block], count, origin, dir, t.low, t.high, root);
+			if (lane < 0) return;
+
+			hit_anything = true;
+			t.high = root;
+			rec.t = root;
+			rec.prim = block_first_[block] + lane;
+		});
+
+		if (hit_anything) rec.object = this;
+		return hit_anything;
+	}
+
+	bool occluded(const Ray& r, Interval ray_t) const override {
+		const Real* origin = r.origin().e;
+		const Real* dir = r.direction().e;
+		return bvh_.traverse_any(r, ray_t, [&](uint32_t block, uint32_t count, Interval t) {
+			ray_stats::count_tests(count);
+			Real root;
+			return intersect_spheres(blocks_[block], count, origin, dir, t.low, t.high, root) >= 0;
+		});
+	}
+
+	void hit_packet(const RayPacket& packet, unsigned lanes, PacketHit& hits) const override {
+		unsigned found = 0;
+		bvh_.traverse_packet(packet, lanes, hits.t_max, [&](uint32_t block, uint32_t count, unsigned leaf_lanes) {
+			ray_stats::count_tests(count * std::popcount(leaf_lanes));
+			for (; leaf_lanes; leaf_lanes &= leaf_lanes - 1) {
+				const int lane = std::countr_zero(leaf_lanes);
+				const Real origin[3] = { packet.origin[0][lane], packet.origin[1][lane], packet.origin[2][lane] };
+				const Real dir[3] = { packet.dir[0][lane], packet.dir[1][lane], packet.dir[2][lane] };
+
+				Real root;
+				const int i = intersect_spheres(blocks_[block], count, origin, dir, packet.t_min, hits.t_max[lane], root);
+				if (i < 0) continue;
+
+				hits.t_max[lane] = root;
+				hits.rec[lane].t = root;
+				hits.rec[lane].prim = block_first_[block] + i;
+				found |= 1u << lane;
+			}
+		});
+
+		for (unsigned m = found; m; m &= m - 1)
+			hits.rec[std::countr_zero(m)].object = this;
+		hits.mask |= found;
+	}
+
+	//prim is the index of the sphere in leaf order.
+	void finalize(const Ray& r, HitRecord& rec) const override {
+		sphere_surface(r, centers_[rec.prim], radii_[rec.prim], rec);
+		rec.mat = materials_[material_ids_[rec.prim]];
+	}
+
+	AABB bounding_box() const override { return bbox_; }
+
+private:
+	std::vector<Point3D> centers_;
+	std::vector<Real> radii_;
+	std::vector<uint32_t> material_ids_;
+	std::vector<const Material*> materials_; //palette indexed by material_ids_
+	WideBvh bvh_; //leaf children index blocks_
+	std::vector<SphereBlock> blocks_;
+	std::vector<uint32_t> block_first_; //first sphere of each block
+	AABB bbox_;
+
+	template<typename T>
+	static void permute(std::vector<T>& values, const std::vector<uint32_t>& order) {
+		std::vector<T> sorted;
+		sorted.reserve(values.size());
+		for (auto index : order) sorted.push_back(values[index]);
+		values = std::move(sorted);
+	}
+};
@@ -0,0 +1,159 @@
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <vector>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../aov.hpp"
+#include "../bvh.hpp"
+#include "../camera.hpp"
+#include "../hittable_list.hpp"
+#include "../material.hpp"
+#include "../sphere.hpp"
+
+namespace {
+
+Camera make_camera(Integrator integrator) {
+	Camera camera;
+	camera.image_width = 64;
+	camera.aspect_ratio = 1.0;
+	camera.samples_per_pixel = 16;
+	camera.max_depth = 8;
+	camera.vfov = 40;
+	camera.lookfrom = Point3D(0, 0, 3);
+	camera.lookat = Point3D(0, 0, 0);
+	camera.integrator = integrator;
+	return camera;
+}
+
+//renders to PFM files, which the writer fills out of order, and returns the image and the
+//requested passes as floats, top row first.
+std::vector<std::vector<float>> render(const Hittable& world, Integrator integrator, const std::vector<Aov>& aovs) {
+	Camera camera = make_camera(integrator);
+	camera.output_format = ImageFormat::pfm;
+	std::vector<std::filesystem::path> paths;
+	for (size_t i = 0; i <= aovs.size(); i++)
+		paths.push_back(std::filesystem::temp_directory_path() / std::format("aov_test_{}.pfm", i));
+	{
+		std::vector<std::ofstream> files;
+		for (const auto& path : paths) files.emplace_back(path, std::ios::trunc | std::ios::binary);
+		for (size_t i = 0; i < aovs.size(); i++) camera.aov_outputs[static_cast<size_t>(aovs[i])] = &files[i + 1];
+		camera.render(files[0], world);
+	}
+
+	std::vector<std::vector<float>> images;
+	for (const auto& path : paths) {
+		std::ifstream s(path, std::ios::binary);
+		std::string magic, scale;
+		int width, height;
+		s >> magic >> width >> height >> scale;
+		s.get();
+		std::vector<float> values(static_cast<size_t>(width) * height * 3);
+		s.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(float)));
+
+		std::vector<float> flipped(values.size());
+		const size_t row = static_cast<size_t>(width) * 3;
+		for (int y = 0; y < height; y++)
+			std::memcpy(&flipped[y * row], &values[(height - 1 - y) * row], row * sizeof(float));
+		images.push_back(flipped);
+	}
+	return images;
+}
+
+//channel c of pixel (x, y) in a 64 pixel wide image.
+float at(const std::vector<float>& image, int x, int y, int c) { return image[(static_cast<size_t>(y) * 64 + x) * 3 + c]; }
+
+}
+
+TEST_CASE("AOVs leave the image unchanged and agree between integrators") {
+	MaterialRegistry materials;
+	HittableList list;
+	list.add(std::make_shared<Sphere>(Point3D(0, -100.5, 0), 100, materials.add<Lambertian>(Vec3(0.5, 0.6, 0.3))));
+	list.add(std::make_shared<Sphere>(Point3D(0, 0, 0), 0.5, materials.add<Lambertian>(Vec3(0.7, 0.2, 0.2))));
+	const Bvh world(list);
+
+	const std::vector<Aov> passes = { Aov::normal, Aov::depth, Aov::albedo, Aov::prim_id };
+	const auto plain = render(world, Integrator::recursive, {});
+	const auto recursive = render(world, Integrator::recursive, passes);
+	const auto wavefront = render(world, Integrator::wavefront, passes);
+	REQUIRE(recursive[0] == plain[0]);
+	for (size_t i = 0; i < recursive.size(); i++) REQUIRE(recursive[i] == wavefront[i]);
+}
+
+TEST_CASE("first hit AOVs describe the surface under the pixel") {
+	MaterialRegistry materials;
+	HittableList list;
+	list.add(std::make_shared<Sphere>(Point3D(0, 0, 0), 0.5, materials.add<Lambertian>(Vec3(0.7, 0.2, 0.2))));
+	const Bvh world(list);
+
+	const auto images = render(world, Integrator::recursive, { Aov::normal, Aov::depth, Aov::albedo, Aov::prim_id, Aov::samples });
+	const auto& normal = images[1];
+	const auto& depth = images[2];
+	const auto& albedo = images[3];
+	const auto& id = images[4];
+	const auto& samples = images[5];
+
+	//the center pixel looks straight at the sphere, the corner at the sky.
+	REQUIRE(at(normal, 32, 32, 2) > 0.95f);
+	REQUIRE(at(depth, 32, 32, 0) == Catch::Approx(2.5).margin(0.02));
+	REQUIRE(at(albedo, 32, 32, 0) == Catch::Approx(0.7).margin(1e-4));
+	REQUIRE(at(depth, 0, 0, 0) == 0.0f);
+	REQUIRE(at(id, 0, 0, 0) + at(id, 0, 0, 1) + at(id, 0, 0, 2) == 0.0f);
+	REQUIRE(at(id, 32, 32, 0) + at(id, 32, 32, 1) + at(id, 32, 32, 2) > 0.0f);
+	REQUIRE(at(samples, 5, 7, 0) == 16.0f);
+
+	if constexpr (ray_stats::enabled) {
+		const auto cost = render(world, Integrator::recursive, { Aov::cost })[1];
+		REQUIRE(at(cost, 32, 32, 0) > at(cost, 0, 0, 0));
+	}
+}
+
+TEST_CASE("primitive ids depend on the scene, not on where it was allocated") {
+	MaterialRegistry materials;
+	const Material* mat = materials.add<Lambertian>(Vec3(0.5, 0.5, 0.5));
+	auto build = [mat] {
+		HittableList list;
+		list.add(std::make_shared<Sphere>(Point3D(-0.5, 0, 0), 0.4, mat));
+		list.add(std::make_shared<Sphere>(Point3D(0.5, 0, 0), 0.4, mat));
+		return list;
+	};
+
+	const HittableList first = build();
+	std::vector<std::shared_ptr<Sphere>> padding;
+	for (int i = 0; i < 16; i++) padding.push_back(std::make_shared<Sphere>(Point3D(0, 0, 0), 1, mat));
+	const HittableList second = build();
+	REQUIRE(first.objects[0].get() != second.objects[0].get());
+
+	const auto a = render(Bvh(first), Integrator::recursive, { Aov::prim_id })[1];
+	const auto b = render(Bvh(second), Integrator::recursive, { Aov::prim_id })[1];
+	REQUIRE(a == b);
+	//the two spheres still get different ids.
+	REQUIRE(at(a, 16, 32, 0) != at(a, 48, 32, 0));
+}
+
+TEST_CASE("primitive ids are unique over nested lists") {
+	MaterialRegistry materials;
+	const Material* mat = materials.add<Lambertian>(Vec3(0.5, 0.5, 0.5));
+	auto left = std::make_shared<Sphere>(Point3D(-0.6, 0, 0), 0.25, mat);
+	auto inner = std::make_shared<HittableList>();
+	inner->add(std::make_shared<Sphere>(Point3D(0, 0, 0), 0.25, mat));
+	inner->add(std::make_shared<Sphere>(Point3D(0.6, 0, 0), 0.25, mat));
+	//left is also in a list of its own that is not part of the scene.
+	HittableList other;
+	other.add(std::make_shared<Sphere>(Point3D(5, 5, 5), 0.1, mat));
+	other.add(left);
+	HittableList list;
+	list.add(left);
+	list.add(inner);
+
+	const auto id = render(Bvh(list), Integrator::recursive, { Aov::prim_id })[1];
+	auto color = [&](int x) { return std::vector<float>{ at(id, x, 32, 0), at(id, x, 32, 1), at(id, x, 32, 2) }; };
+	const auto a = color(14), b = color(32), c = color(50);
+	REQUIRE(a != b);
+	REQUIRE(b != c);
+	REQUIRE(a != c);
+	REQUIRE(a[0] + a[1] + a[2] > 0.0f);
+}
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../bvh.hpp"
+#include "../hittable_list.hpp"
+#include "../object.hpp"
+#include "../plane.hpp"
+#include "../sphere.hpp"
+
+//packets and single rays round differently, and a grazing sphere hit loses half the digits
+//to the root of its quadratic, so they agree to about the square root of the precision.
+static const double t_epsilon = std::sqrt(std::numeric_limits<Real>::epsilon());
+
+static HittableList random_spheres(int count, std::mt19937_64& rng) {
+	std::uniform_real_distribution<double> pos(-20.0, 20.0);
+	std::uniform_real_distribution<double> rad(0.05, 0.8);
+
+	HittableList list;
+	for (int i = 0; i < count; i++)
+		list.add(std::make_shared<Sphere>(Point3D(pos(rng), pos(rng), pos(rng)), rad(rng), nullptr));
+	return list;
+}
+
+TEST_CASE("BVH matches linear HittableList") {
+	std::mt19937_64 rng(4242);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+	HittableList list = random_spheres(2000, rng);
+	list.add(std::make_shared<Plane>(Point3D(0, -25, 0), Vec3(0, 1, 0), nullptr));
+	Bvh bvh(list);
+
+	int hits = 0;
+	for (int i = 0; i < 5000; i++) {
+		Ray r(Point3D(dist(rng) * 30, dist(rng) * 30, dist(rng) * 30), Vec3(dist(rng), dist(rng), dist(rng)));
+		HitRecord a{}, b{};
+		bool hit_list = list.hit(r, Interval(0.001, infinity), a);
+		bool hit_bvh = bvh.hit(r, Interval(0.001, infinity), b);
+		REQUIRE(hit_list == hit_bvh);
+		if (hit_list) {
+			REQUIRE(a.t == Catch::Approx(b.t));
+			hits++;
+		}
+	}
+	REQUIRE(hits > 0);
+}
+
+TEST_CASE("Packet traversal matches single rays") {
+	std::mt19937_64 rng(11);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+	HittableList list = random_spheres(500, rng);
+	list.add(std::make_shared<Plane>(Point3D(0, -25, 0), Vec3(0, 1, 0), nullptr));
+	ThreadPool pool;
+	list.add(std::make_shared<Object>(load_obj("objs/teapot.obj", pool), nullptr));
+	Bvh bvh(list);
+
+	for (int i = 0; i < 500; i++) {
+		RayPacket packet;
+		PacketHit hits;
+		Point3D origin(dist(rng) * 5, dist(rng) * 5, 30.0);
+		for (int lane = 0; lane < packet_width; lane++) {
+			packet.set(lane, Ray(origin, Vec3(dist(rng) * 0.3, dist(rng) * 0.3, -1.0)));
+			hits.t_max[lane] = infinity;
+		}
+		const unsigned lanes = (i % 2) ? 0xFFu : 0x5Bu;
+		bvh.hit_packet(packet, lanes, hits);
+
+		for (int lane = 0; lane < packet_width; lane++) {
+			HitRecord rec;
+			bool expected = (lanes >> lane & 1) && bvh.hit(packet.rays[lane], Interval(packet.t_min, infinity), rec);
+			REQUIRE(static_cast<bool>(hits.mask >> lane & 1) == expected);
+			if (expected) REQUIRE(hits.rec[lane].t == Catch::Approx(rec.t).epsilon(t_epsilon));
+		}
+	}
+}
+
+//deepest leaf below node, following the depth first layout of BvhNode.
+static int tree_depth(const std::vector<BvhNode>& nodes, uint32_t node = 0) {
+	if (nodes[node].count > 0) return 0;
+	return 1 + std::max(tree_depth(nodes, node + 1), tree_depth(nodes, nodes[node].offset));
+}
+
+TEST_CASE("BVH depth stays within the traversal stack") {
+	//boxes at powers of two, as many as Real can place: the SAH bins only ever split off the
+	//few largest ones, which took the tree past 64 levels in a double build.
+	const int count = std::min(300, std::numeric_limits<Real>::max_exponent - 2);
+	std::vector<AABB> boxes;
+	HittableList list;
+	for (int i = 0; i < count; i++) {
+		const double x = std::ldexp(1.0, i);
+		boxes.emplace_back(Point3D(x, -0.1, -0.1), Point3D(x + 0.1, 0.1, 0.1));
+		list.add(std::make_shared<Sphere>(Point3D(x, 0, 0), 0.05, nullptr));
+	}
+
+	std::vector<uint32_t> order;
+	const auto nodes = bvh::build(boxes, order, 4);
+	REQUIRE(tree_depth(nodes) <= bvh::max_depth);
+	std::vector<uint32_t> sorted = order;
+	std::sort(sorted.begin(), sorted.end());
+	for (uint32_t i = 0; i < sorted.size(); i++) REQUIRE(sorted[i] == i);
+
+	//a ray along the row has to reach the spheres in the deepest leaves.
+	const Bvh bvh(list);
+	for (int i = 0; i < count; i += 7) {
+		const double x = std::ldexp(1.0, i);
+		HitRecord a, b;
+		const Ray r(Point3D(x, 0, 1), Vec3(0, 0, -1));
+		REQUIRE(list.hit(r, Interval(0.001, infinity), a));
+		REQUIRE(bvh.hit(r, Interval(0.001, infinity), b));
+		REQUIRE(b.object == a.object);
+		REQUIRE(bvh.occluded(r, Interval(0.001, infinity)));
+	}
+}
+
+TEST_CASE("BVH traversal benchmark") {
+	std::mt19937_64 rng(7);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+	HittableList list = random_spheres(20000, rng);
+	Bvh bvh(list);
+
+	std::vector<Ray> rays;
+	for (int i = 0; i < 256; i++)
+		rays.emplace_back(Point3D(0, 0, 40), Vec3(dist(rng) * 0.5, dist(rng) * 0.5, -1.0));
+
+	BENCHMARK("linear list") {
+		int hits = 0;
+		HitRecord rec;
+		for (const auto& r : rays) hits += list.hit(r, Interval(0.001, infinity), rec);
+		return hits;
+	};
+
+	BENCHMARK("bvh") {
+		int hits = 0;
+		HitRecord rec;
+		for (const auto& r : rays) hits += bvh.hit(r, Interval(0.001, infinity), rec);
+		return hits;
+	};
+}
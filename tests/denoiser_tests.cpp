@@ -0,0 +1,119 @@
+#include <random>
+#include <sstream>
+#include <vector>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../bvh.hpp"
+#include "../camera.hpp"
+#include "../denoiser.hpp"
+#include "../hittable_list.hpp"
+#include "../material.hpp"
+#include "../sphere.hpp"
+
+namespace {
+
+constexpr int width = 64, height = 48;
+
+//two surfaces side by side, left dark and right bright, with the same noise on both.
+struct NoisyImage {
+	std::vector<Vec3> colors, albedo, normal;
+	std::vector<Real> depth, variance;
+
+	NoisyImage() {
+		std::mt19937_64 rng(3);
+		std::normal_distribution<double> noise(0.0, 0.15);
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				const bool right = x >= width / 2;
+				const double base = right ? 0.8 : 0.2;
+				colors.push_back(Vec3(base + noise(rng), base + noise(rng), base + noise(rng)));
+				albedo.push_back(right ? Vec3(0.8, 0.8, 0.8) : Vec3(0.2, 0.2, 0.2));
+				normal.push_back(Vec3(0, 0, 1));
+				depth.push_back(5);
+				variance.push_back(0.15 * 0.15);
+			}
+		}
+	}
+
+	//RMS difference from the noise free image.
+	double error() const {
+		double sum = 0;
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+				sum += (colors[y * width + x] - Vec3(1, 1, 1) * (x >= width / 2 ? 0.8 : 0.2)).length_squared();
+		return std::sqrt(sum / (width * height));
+	}
+};
+
+std::vector<int> render(const Hittable& world, int samples, bool denoise) {
+	Camera camera;
+	camera.image_width = 96;
+	camera.samples_per_pixel = samples;
+	camera.max_depth = 8;
+	camera.lookfrom = Point3D(0, 1, 3);
+	camera.lookat = Point3D(0, 0.3, 0);
+	camera.output_format = ImageFormat::ppm_ascii;
+	camera.denoise = denoise;
+
+	std::stringstream out;
+	camera.render(out, world);
+
+	std::string magic;
+	int w, h, max_value;
+	out >> magic >> w >> h >> max_value;
+	std::vector<int> values(static_cast<size_t>(w) * h * 3);
+	for (auto& v : values) out >> v;
+	return values;
+}
+
+//RMS difference to the reference over the pixels away from silhouettes. Edge pixels keep
+//their antialiasing noise, the guides differ across them.
+double rms(const std::vector<int>& image, const std::vector<int>& reference, int w) {
+	const int h = static_cast<int>(reference.size()) / (3 * w);
+	double sum = 0;
+	int count = 0;
+	for (int y = 1; y < h - 1; y++) {
+		for (int x = 1; x < w - 1; x++) {
+			const int i = (y * w + x) * 3;
+			bool flat = true;
+			for (int n : { i - 3, i + 3, i - 3 * w, i + 3 * w })
+				for (int c = 0; c < 3; c++) flat = flat && std::abs(reference[n + c] - reference[i + c]) < 8;
+			if (!flat) continue;
+			for (int c = 0; c < 3; c++) sum += static_cast<double>(image[i + c] - reference[i + c]) * (image[i + c] - reference[i + c]);
+			count += 3;
+		}
+	}
+	return std::sqrt(sum / count);
+}
+
+}
+
+TEST_CASE("denoiser removes noise but keeps the albedo edge") {
+	NoisyImage image;
+	const double before = image.error();
+
+	ThreadPool pool(2);
+	Denoiser().run(pool, width, height, image.colors.data(), DenoiseGuides{ image.albedo.data(), image.normal.data(), image.depth.data(), image.variance.data() });
+	REQUIRE(image.error() < before / 3);
+
+	//no bright light leaks over the edge into the dark side.
+	for (int y = 0; y < height; y++) {
+		REQUIRE(image.colors[y * width + width / 2 - 1].x() < 0.3);
+		REQUIRE(image.colors[y * width + width / 2].x() > 0.7);
+	}
+}
+
+TEST_CASE("denoised low sample render is closer to the reference") {
+	MaterialRegistry materials;
+	HittableList list;
+	list.add(std::make_shared<Sphere>(Point3D(0, -100.5, 0), 100, materials.add<Lambertian>(Vec3(0.5, 0.6, 0.3))));
+	list.add(std::make_shared<Sphere>(Point3D(0, 0, 0), 0.5, materials.add<Lambertian>(Vec3(0.7, 0.2, 0.2))));
+	list.add(std::make_shared<Sphere>(Point3D(-1, 0, 0), 0.5, materials.add<Metal>(Vec3(0.8, 0.8, 0.8), 0.2)));
+	const Bvh world(list);
+
+	const auto reference = render(world, 256, false);
+	const double noisy = rms(render(world, 4, false), reference, 96);
+	const double denoised = rms(render(world, 4, true), reference, 96);
+	REQUIRE(denoised < noisy / 2);
+}
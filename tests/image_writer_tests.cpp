@@ -0,0 +1,89 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../image_writer.hpp"
+
+TEST_CASE("quantize_gamma matches Color") {
+	std::vector<Vec3> pixels;
+	for (int i = 0; i < 1001; i++)
+		pixels.push_back(Vec3(random_double(-0.5, 1.5), random_double(0, 1), random_double(-1, 2)));
+	pixels.push_back(Vec3(0.0, 1.0, 0.25));
+
+	std::vector<uint8_t> bytes(pixels.size() * 3);
+	quantize_gamma(pixels.data(), pixels.size(), bytes.data());
+
+	for (size_t i = 0; i < pixels.size(); i++) {
+		Color c(pixels[i]);
+		REQUIRE(bytes[3 * i] == c.r);
+		REQUIRE(bytes[3 * i + 1] == c.g);
+		REQUIRE(bytes[3 * i + 2] == c.b);
+	}
+}
+
+TEST_CASE("png checksums") {
+	const char* check = "123456789";
+	REQUIRE(png::crc32(0, reinterpret_cast<const uint8_t*>(check), 9) == 0xCBF43926u);
+
+	const char* wiki = "Wikipedia";
+	REQUIRE(png::adler32(1, reinterpret_cast<const uint8_t*>(wiki), 9) == 0x11E60398u);
+
+	//split updates give the same result
+	uint32_t crc = png::crc32(0, reinterpret_cast<const uint8_t*>(check), 4);
+	crc = png::crc32(crc, reinterpret_cast<const uint8_t*>(check) + 4, 5);
+	REQUIRE(crc == 0xCBF43926u);
+}
+
+TEST_CASE("pfm stores the bottom row first") {
+	const int width = 3, height = 2;
+	std::vector<Vec3> pixels(width * height);
+	for (int i = 0; i < width * height; i++) pixels[i] = Vec3(i, i + 0.5, -i);
+
+	//rows are placed with seekp past the end of the data, which needs a real file.
+	const auto path = std::filesystem::temp_directory_path() / "image_writer_test.pfm";
+	{
+		std::ofstream out(path, std::ios::trunc | std::ios::binary);
+		auto writer = make_image_writer(ImageFormat::pfm);
+		writer->begin(out, width, height);
+		writer->write_rows(out, 0, 1, pixels.data());
+		writer->write_rows(out, 1, 1, pixels.data() + width);
+		writer->end(out);
+	}
+	std::ifstream in(path, std::ios::binary);
+	const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	std::filesystem::remove(path);
+
+	const std::string header = "PF\n3 2\n-1.0\n";
+	REQUIRE(data.size() == header.size() + width * height * 3 * sizeof(float));
+	REQUIRE(data.compare(0, header.size(), header) == 0);
+
+	float first[3];
+	std::memcpy(first, data.data() + header.size(), sizeof(first));
+	REQUIRE(first[0] == 3.0f);
+	REQUIRE(first[1] == 3.5f);
+	REQUIRE(first[2] == -3.0f);
+}
+
+TEST_CASE("png splits rows over stored deflate blocks") {
+	//one row is larger than a deflate block, so blocks end mid row.
+	const int width = 30000, height = 3;
+	std::vector<Vec3> pixels(width * height, Vec3(0.25, 0.5, 1.0));
+
+	std::stringstream out;
+	auto writer = make_image_writer(ImageFormat::png);
+	writer->begin(out, width, height);
+	writer->write_rows(out, 0, height, pixels.data());
+	writer->end(out);
+
+	const std::string data = out.str();
+	const size_t raw = height * (1 + width * 3);
+	const size_t blocks = (raw + 65534) / 65535;
+	const size_t chunks = 8 + 25 + blocks * 12 + 12;
+	REQUIRE(data.size() == chunks + 2 + blocks * 5 + raw + 4);
+	REQUIRE(data.compare(data.size() - 8, 4, "IEND") == 0);
+}
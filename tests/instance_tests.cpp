@@ -0,0 +1,107 @@
+#include <cmath>
+#include <limits>
+#include <random>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../bvh.hpp"
+#include "../hittable_list.hpp"
+#include "../instance.hpp"
+#include "../object.hpp"
+#include "../sphere.hpp"
+
+//an instance intersects in object space, so its results differ from the world space ones by
+//the rounding of the transforms; grazing sphere hits lose half the digits on top of that.
+static const double epsilon = 1e3 * std::numeric_limits<Real>::epsilon();
+static const double grazing_epsilon = std::sqrt(std::numeric_limits<Real>::epsilon());
+
+TEST_CASE("transform inverse undoes the transform") {
+	const Transform t = Transform::translate(Vec3(1, -2, 3)) * Transform::rotate(Vec3(1, 1, 0), 37) * Transform::scale(Vec3(2, 0.5, 3));
+	const Transform inv = t.inverse();
+	const Point3D p(0.3, -1.7, 4.2);
+	const Point3D back = inv.point(t.point(p));
+	for (int axis = 0; axis < 3; axis++) REQUIRE(back.e[axis] == Catch::Approx(p.e[axis]).margin(1e-9));
+
+	//composition applies the right hand side first.
+	const Point3D moved = (Transform::translate(Vec3(1, 0, 0)) * Transform::scale(2)).point(Point3D(1, 1, 1));
+	REQUIRE(moved.x() == Catch::Approx(3));
+	REQUIRE(moved.y() == Catch::Approx(2));
+}
+
+//a unit sphere scaled, rotated and moved by an instance is the same sphere placed directly.
+TEST_CASE("instanced sphere matches a sphere placed in world space") {
+	std::mt19937_64 rng(8);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+	const Sphere placed(Point3D(2, -1, 0.5), 1.5, nullptr);
+	const Instance instance(std::make_shared<Sphere>(Point3D(0, 0, 0), 1.0, nullptr),
+		Transform::translate(Vec3(2, -1, 0.5)) * Transform::rotate(Vec3(0, 1, 0), 60) * Transform::scale(1.5));
+	REQUIRE(instance.bounding_box().x.low <= 0.5 + 1e-9);
+	REQUIRE(instance.bounding_box().y.high >= 0.5 - 1e-9);
+
+	int hits = 0;
+	for (int i = 0; i < 2000; i++) {
+		const Ray r(Point3D(dist(rng) * 5, dist(rng) * 5, 6), Vec3(dist(rng) * 0.5, dist(rng) * 0.5, -1));
+		HitRecord a, b;
+		const bool hit_placed = placed.hit(r, Interval(0.001, infinity), a);
+		REQUIRE(instance.hit(r, Interval(0.001, infinity), b) == hit_placed);
+		REQUIRE(instance.occluded(r, Interval(0.001, infinity)) == hit_placed);
+		if (!hit_placed) continue;
+
+		hits++;
+		REQUIRE(b.object == &instance);
+		REQUIRE(b.t == Catch::Approx(a.t).epsilon(grazing_epsilon));
+		a.finalize(r);
+		b.finalize(r);
+		REQUIRE(b.front_face == a.front_face);
+		for (int axis = 0; axis < 3; axis++) {
+			REQUIRE(b.p.e[axis] == Catch::Approx(a.p.e[axis]).margin(grazing_epsilon * a.t));
+			REQUIRE(b.normal.e[axis] == Catch::Approx(a.normal.e[axis]).margin(grazing_epsilon));
+		}
+	}
+	REQUIRE(hits > 100);
+}
+
+TEST_CASE("instances share one mesh under a top level BVH") {
+	std::mt19937_64 rng(21);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+	ThreadPool pool;
+	auto teapot = std::make_shared<Object>(load_obj("objs/teapot.obj", pool), nullptr);
+	HittableList list;
+	for (int i = 0; i < 9; i++) {
+		const Transform place = Transform::translate(Vec3((i % 3 - 1) * 8.0, (i / 3 - 1) * 6.0, 0)) * Transform::rotate(Vec3(0, 1, 0), 40.0 * i);
+		list.add(std::make_shared<Instance>(teapot, place));
+	}
+	const Bvh bvh(list);
+	REQUIRE(teapot.use_count() == 10);
+
+	int hits = 0;
+	for (int i = 0; i < 300; i++) {
+		RayPacket packet;
+		PacketHit hits_packet;
+		const Point3D origin(dist(rng) * 12, dist(rng) * 9, 30.0);
+		for (int lane = 0; lane < packet_width; lane++) {
+			packet.set(lane, Ray(origin, Vec3(dist(rng) * 0.3, dist(rng) * 0.3, -1.0)));
+			hits_packet.t_max[lane] = infinity;
+		}
+		bvh.hit_packet(packet, 0xFFu, hits_packet);
+
+		for (int lane = 0; lane < packet_width; lane++) {
+			HitRecord rec;
+			const Ray& r = packet.rays[lane];
+			const bool expected = bvh.hit(r, Interval(packet.t_min, infinity), rec);
+			REQUIRE(static_cast<bool>(hits_packet.mask >> lane & 1) == expected);
+			REQUIRE(bvh.occluded(r, Interval(packet.t_min, infinity)) == expected);
+			if (!expected) continue;
+
+			hits++;
+			REQUIRE(hits_packet.rec[lane].t == Catch::Approx(rec.t).epsilon(epsilon));
+			REQUIRE(hits_packet.rec[lane].object == rec.object);
+			rec.finalize(r);
+			REQUIRE((rec.p - r.at(rec.t)).length() <= epsilon * rec.t);
+			REQUIRE(rec.normal.length() == Catch::Approx(1.0));
+		}
+	}
+	REQUIRE(hits > 0);
+}
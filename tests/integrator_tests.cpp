@@ -0,0 +1,86 @@
+#include <sstream>
+#include <vector>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../bvh.hpp"
+#include "../camera.hpp"
+#include "../hittable_list.hpp"
+#include "../material.hpp"
+#include "../sphere.hpp"
+
+namespace {
+
+//renders the scene to P3 and returns the 8 bit channel values.
+std::vector<int> render(const Hittable& world, Integrator integrator, int tile_size = 0, int rr_min_depth = 3) {
+	Camera camera;
+	camera.image_width = 96;
+	camera.samples_per_pixel = 64;
+	camera.max_depth = 8;
+	camera.lookfrom = Point3D(0, 1, 3);
+	camera.lookat = Point3D(0, 0.3, 0);
+	camera.output_format = ImageFormat::ppm_ascii;
+	camera.integrator = integrator;
+	camera.tile_size = tile_size;
+	camera.rr_min_depth = rr_min_depth;
+	camera.adaptive_threshold = 0.01;
+
+	std::stringstream out;
+	camera.render(out, world);
+
+	std::string magic;
+	int width, height, max_value;
+	out >> magic >> width >> height >> max_value;
+	std::vector<int> values(static_cast<size_t>(width) * height * 3);
+	for (auto& v : values) out >> v;
+	return values;
+}
+
+void make_scene(MaterialRegistry& materials, HittableList& list) {
+	list.add(std::make_shared<Sphere>(Point3D(0, -100.5, 0), 100, materials.add<Lambertian>(Vec3(0.5, 0.6, 0.3))));
+	list.add(std::make_shared<Sphere>(Point3D(0, 0, 0), 0.5, materials.add<Lambertian>(Vec3(0.7, 0.2, 0.2))));
+	list.add(std::make_shared<Sphere>(Point3D(-1, 0, 0), 0.5, materials.add<Metal>(Vec3(0.8, 0.8, 0.8), 0.2)));
+	list.add(std::make_shared<Sphere>(Point3D(1, 0, 0), 0.5, materials.add<Dielectric>(1.5)));
+}
+
+}
+
+//every path seeds its random stream from (pixel, sample, bounce), so the integrators trace
+//the very same paths.
+TEST_CASE("wavefront and recursive integrators agree") {
+	MaterialRegistry materials;
+	HittableList list;
+	make_scene(materials, list);
+	const Bvh world(list);
+
+	const auto recursive = render(world, Integrator::recursive);
+	const auto wavefront = render(world, Integrator::wavefront);
+	REQUIRE(recursive.size() == wavefront.size());
+	REQUIRE(recursive == wavefront);
+}
+
+TEST_CASE("renders do not depend on the tiling") {
+	MaterialRegistry materials;
+	HittableList list;
+	make_scene(materials, list);
+	const Bvh world(list);
+
+	REQUIRE(render(world, Integrator::recursive, 16) == render(world, Integrator::recursive, 40));
+}
+
+//roulette trades noise for speed, the image must come out as bright as without it.
+TEST_CASE("Russian roulette keeps the image brightness") {
+	MaterialRegistry materials;
+	HittableList list;
+	make_scene(materials, list);
+	const Bvh world(list);
+
+	auto mean = [](const std::vector<int>& values) {
+		double sum = 0;
+		for (int v : values) sum += v;
+		return sum / values.size();
+	};
+	const double full = mean(render(world, Integrator::recursive, 0, 8));
+	const double roulette = mean(render(world, Integrator::recursive, 0, 0));
+	REQUIRE(roulette == Catch::Approx(full).epsilon(0.01));
+}
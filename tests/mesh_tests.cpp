@@ -0,0 +1,450 @@
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../bvh.hpp"
+#include "../hittable_list.hpp"
+#include "../object.hpp"
+
+//the wide BVH and the brute force list round differently, which shows in a float build.
+static const double epsilon = 1e3 * std::numeric_limits<Real>::epsilon();
+
+TEST_CASE("Wide BVH mesh matches brute force triangles") {
+	std::mt19937_64 rng(99);
+	std::uniform_real_distribution<double> pos(-5.0, 5.0);
+	std::uniform_real_distribution<double> off(-0.4, 0.4);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+	std::vector<Triangle> faces;
+	HittableList brute;
+	for (int i = 0; i < 3000; i++) {
+		Vec3 a(pos(rng), pos(rng), pos(rng));
+		Vec3 b = a + Vec3(off(rng), off(rng), off(rng));
+		Vec3 c = a + Vec3(off(rng), off(rng), off(rng));
+		faces.emplace_back(a, b, c);
+		brute.add(std::make_shared<Triangle>(a, b, c));
+	}
+	Object mesh(faces, nullptr);
+
+	int hits = 0;
+	for (int i = 0; i < 5000; i++) {
+		Ray r(Point3D(dist(rng) * 8, dist(rng) * 8, 12.0), Vec3(dist(rng) * 0.5, dist(rng) * 0.5, -1.0));
+		HitRecord a, b;
+		bool hit_brute = brute.hit(r, Interval(0.001, infinity), a);
+		bool hit_mesh = mesh.hit(r, Interval(0.001, infinity), b);
+		REQUIRE(hit_brute == hit_mesh);
+		if (hit_brute) {
+			REQUIRE(a.t == Catch::Approx(b.t).epsilon(epsilon));
+			//the mesh finalizes through the face index it recorded.
+			a.finalize(r);
+			b.finalize(r);
+			REQUIRE(b.mat == nullptr);
+			REQUIRE(dot(a.normal, b.normal) == Catch::Approx(1.0));
+			REQUIRE((a.p - b.p).length() <= epsilon * a.t);
+			hits++;
+		}
+	}
+	REQUIRE(hits > 0);
+}
+
+TEST_CASE("Wide BVH nodes never report an empty slot") {
+	std::vector<AABB> boxes;
+	for (int i = 0; i < 3; i++) boxes.emplace_back(Point3D(i, 0, 0), Point3D(i + 0.5, 1, 1));
+	std::vector<uint32_t> order;
+	const WideBvh bvh = WideBvh::build(boxes, order, 1);
+	REQUIRE(bvh.nodes.size() == 1);
+
+	WideNode node = bvh.nodes[0];
+	REQUIRE(node.occupied == 0b111);
+	//an empty slot whose box would pass, as a NaN slab can make it, is still left out.
+	for (int row = 0; row < 3; row++) {
+		node.quantized[row][5] = 0;
+		node.quantized[3 + row][5] = 255;
+	}
+	const WideRay ray(Ray(Point3D(-1, 0.5, 0.5), Vec3(1, 0, 0)));
+	alignas(32) float t_near[wide_bvh_width];
+	REQUIRE(WideBvh::intersect_node(node, ray, 0.0f, 100.0f, t_near) == 0b111u);
+}
+
+TEST_CASE("Wide BVH node test keeps rays grazing a box far from the origin") {
+	//a hand built node without the builder's slack: the box x in [1e5 + 1, 1e5 + 2],
+	//y and z in [0, 1], on whose low y face rays pass ever closer to the high x edge.
+	WideNode node{};
+	for (int axis = 0; axis < 3; axis++) {
+		node.origin[axis] = axis == 0 ? 100001.0f : 0.0f;
+		node.scale[axis] = 1.0f / 128.0f;
+		node.quantized[axis][0] = 0;
+		node.quantized[3 + axis][0] = 128;
+	}
+	node.count[0] = 1;
+	node.occupied = 1;
+	const AABB box(Point3D(100001, 0, 0), Point3D(100002, 1, 1));
+
+	int hits = 0;
+	for (int i = 0; i < 1000; i++) {
+		const Ray r(Point3D(100002 - 0.3 - i * 1e-5, -1, 0.5), Vec3(0.3, 1, 0));
+		if (!box.hit(r, Interval(0, 100))) continue;
+		alignas(32) float t_near[wide_bvh_width];
+		REQUIRE(WideBvh::intersect_node(node, WideRay(r), 0.0f, 100.0f, t_near) == 1u);
+		hits++;
+	}
+	REQUIRE(hits > 0);
+}
+
+TEST_CASE("Wide BVH keeps grazed children of a mesh far from the origin") {
+	//at 1e5 a float ulp is about 0.008, so slab distances carry rounding far above a few
+	//ulps of the distance itself.
+	std::mt19937_64 rng(314);
+	std::uniform_real_distribution<double> pos(-5.0, 5.0);
+	std::uniform_real_distribution<double> off(-0.4, 0.4);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	const double offset = 1e5;
+	//offset in double and rounded once, or fast-math folds (a + d) - a back to d and the
+	//triangles keep edges the mesh's stored vertices cannot represent.
+	auto point = [&](double x, double y, double z) { return Point3D(offset + x, -offset + y, offset + z); };
+
+	std::vector<Triangle> faces;
+	HittableList list;
+	for (int i = 0; i < 3000; i++) {
+		const double x = pos(rng), y = pos(rng), z = pos(rng);
+		const Point3D a = point(x, y, z);
+		const Point3D b = point(x + off(rng), y + off(rng), z + off(rng));
+		const Point3D c = point(x + off(rng), y + off(rng), z + off(rng));
+		faces.emplace_back(a, b, c);
+		list.add(std::make_shared<Triangle>(a, b, c));
+	}
+	const Object mesh(faces, nullptr);
+	const Bvh bvh(list);
+
+	int hits = 0;
+	for (int i = 0; i < 20000; i++) {
+		const Ray r(point(dist(rng) * 8, dist(rng) * 8, 12.0), Vec3(dist(rng) * 0.5, dist(rng) * 0.5, -1.0));
+		HitRecord a{}, b{};
+		const bool hit_bvh = bvh.hit(r, Interval(0.001, infinity), a);
+		REQUIRE(mesh.hit(r, Interval(0.001, infinity), b) == hit_bvh);
+		REQUIRE(mesh.occluded(r, Interval(0.001, infinity)) == hit_bvh);
+		if (!hit_bvh) continue;
+		REQUIRE(b.t == Catch::Approx(a.t).epsilon(epsilon));
+		hits++;
+	}
+	REQUIRE(hits > 0);
+}
+
+//the plane + edge-function test Triangle::hit used before the precomputed edges.
+static bool legacy_triangle_hit(const Vec3 (&f)[3], const Ray& r, Interval ray_t, double& t_out) {
+	Vec3 n = cross(f[1] - f[0], f[2] - f[0]);
+	auto denom = dot(r.direction(), n);
+	if (std::abs(denom) < 1e-12) return false;
+
+	auto t = dot(f[0] - r.origin(), n) / denom;
+	if (!ray_t.contains(t)) return false;
+
+	auto world_pos = r.at(t);
+	if (dot(cross(f[1] - f[0], world_pos - f[0]), n) < 0) return false;
+	if (dot(cross(f[2] - f[1], world_pos - f[1]), n) < 0) return false;
+	if (dot(cross(f[0] - f[2], world_pos - f[2]), n) < 0) return false;
+
+	t_out = t;
+	return true;
+}
+
+TEST_CASE("Triangle intersection on the teapot") {
+	ThreadPool pool;
+	auto faces = load_obj_triangles("objs/teapot.obj", Point3D(0, 0, 0), pool);
+	REQUIRE(!faces.empty());
+
+	std::vector<std::array<Vec3, 3>> legacy;
+	for (const auto& face : faces) {
+		const auto& v0 = face.vertex0();
+		legacy.push_back({ v0, v0 + face.edge1(), v0 + face.edge2() });
+	}
+
+	std::mt19937_64 rng(3);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	std::vector<Ray> rays;
+	for (int i = 0; i < 64; i++) {
+		Point3D target(dist(rng) * 3.0, 1.5 + dist(rng) * 1.5, dist(rng) * 2.0);
+		Point3D origin(0, 2, 10);
+		rays.emplace_back(origin, target - origin);
+	}
+
+	auto closest_legacy = [&](const Ray& r, double& closest) {
+		bool hit = false;
+		closest = infinity;
+		for (const auto& f : legacy) {
+			Vec3 v[3] = { f[0], f[1], f[2] };
+			double t;
+			if (legacy_triangle_hit(v, r, Interval(0.001, closest), t)) {
+				closest = t;
+				hit = true;
+			}
+		}
+		return hit;
+	};
+
+	auto closest_precomputed = [&](const Ray& r, double& closest) {
+		bool hit = false;
+		closest = infinity;
+		HitRecord rec;
+		for (const auto& face : faces) {
+			if (face.hit(r, Interval(0.001, closest), rec)) {
+				closest = rec.t;
+				hit = true;
+			}
+		}
+		return hit;
+	};
+
+	int hits = 0;
+	for (const auto& r : rays) {
+		double a, b;
+		bool hit_legacy = closest_legacy(r, a);
+		bool hit_precomputed = closest_precomputed(r, b);
+		REQUIRE(hit_legacy == hit_precomputed);
+		if (hit_legacy) {
+			REQUIRE(a == Catch::Approx(b));
+			hits++;
+		}
+	}
+	REQUIRE(hits > 0);
+
+	HitRecord rec;
+	REQUIRE(faces[0].hit(Ray(faces[0].vertex0() + (faces[0].edge1() + faces[0].edge2()) / 3.0 + faces[0].normal(), -faces[0].normal()), Interval(0.001, infinity), rec));
+	REQUIRE(rec.uv.x() == Catch::Approx(1.0 / 3.0));
+	REQUIRE(rec.uv.y() == Catch::Approx(1.0 / 3.0));
+
+	BENCHMARK("legacy plane + edge test") {
+		double sum = 0.0;
+		for (const auto& r : rays) {
+			double t;
+			if (closest_legacy(r, t)) sum += t;
+		}
+		return sum;
+	};
+
+	BENCHMARK("precomputed Moller-Trumbore") {
+		double sum = 0.0;
+		for (const auto& r : rays) {
+			double t;
+			if (closest_precomputed(r, t)) sum += t;
+		}
+		return sum;
+	};
+}
+
+namespace {
+
+std::filesystem::path write_obj(const char* name, const std::string& text) {
+	const auto path = std::filesystem::temp_directory_path() / name;
+	std::ofstream(path, std::ios::trunc | std::ios::binary) << text;
+	return path;
+}
+
+}
+
+TEST_CASE("OBJ loader reads indexed polygons") {
+	ThreadPool pool;
+	//a quad with texcoords and normals, then a triangle by negative indices, CRLF endings.
+	const auto path = write_obj("mesh_test.obj",
+		"# square\r\n"
+		"o square\r\n"
+		"v 0 0 0\r\nv 1 0 0\r\nv 1 1 0\r\nv 0 1 0 1.0\r\n"
+		"vt 0 0\r\nvt 1 0\r\nvt 1 1\r\nvt 0 1\r\n"
+		"vn 0 0 1\r\n"
+		"f 1/1/1 2/2/1 3/3/1 4/4/1\r\n"
+		"v 2 0 0\r\n"
+		"f -2//1 -4//1 -1//1 # tail\r\n");
+	const ObjMesh mesh = load_obj(path.string(), pool);
+
+	REQUIRE(mesh.positions.size() == 5);
+	REQUIRE(mesh.texcoords.size() == 4);
+	REQUIRE(mesh.normals.size() == 1);
+	REQUIRE(mesh.triangle_count() == 3);
+	REQUIRE(mesh.position_indices == std::vector<uint32_t>{ 0, 1, 2, 0, 2, 3, 3, 1, 4 });
+	REQUIRE(mesh.texcoord_indices == std::vector<uint32_t>{ 0, 1, 2, 0, 2, 3, ObjMesh::no_index, ObjMesh::no_index, ObjMesh::no_index });
+	REQUIRE(mesh.normal_indices == std::vector<uint32_t>(9, 0));
+	REQUIRE(mesh.positions[4].x() == 2.0);
+	REQUIRE(mesh.texcoords[2].y() == 1.0);
+
+	REQUIRE_THROWS_AS(load_obj(write_obj("mesh_test_bad.obj", "v 0 0 0\nf 1 2 3\n").string(), pool), std::runtime_error);
+}
+
+TEST_CASE("OBJ loader splits large files into chunks") {
+	//a strip of quads well past one chunk, with indices relative to each line.
+	std::string text;
+	const int quads = 40000;
+	for (int i = 0; i <= quads; i++) text += std::format("v {} 0 0\nv {} 1 0\n", i * 0.5, i * 0.5);
+	for (int i = 0; i < quads; i++) text += std::format("f {} {} {} {}\n", 2 * i + 1, 2 * i + 3, 2 * i + 4, 2 * i + 2);
+	for (int i = 0; i < 10; i++) text += "v 0 0 1\nf -1 1 2\n";
+	REQUIRE(text.size() > (size_t(1) << 20));
+
+	ThreadPool pool;
+	const ObjMesh mesh = load_obj(write_obj("mesh_test_large.obj", text).string(), pool);
+	REQUIRE(mesh.positions.size() == 2 * (quads + 1) + 10);
+	REQUIRE(mesh.triangle_count() == 2 * quads + 10);
+	REQUIRE(mesh.position_indices[6 * (quads - 1) + 1] == 2 * quads);
+	for (int i = 0; i < 10; i++) REQUIRE(mesh.position_indices[3 * (2 * quads + i)] == 2u * (quads + 1) + i);
+	REQUIRE(mesh.texcoord_indices.empty());
+	REQUIRE(mesh.normal_indices.empty());
+}
+
+TEST_CASE("mesh cache maps the same mesh back") {
+	const auto path = std::filesystem::temp_directory_path() / "mesh_cache_test.obj";
+	std::filesystem::copy_file("objs/teapot.obj", path, std::filesystem::copy_options::overwrite_existing);
+	const std::string cache = mesh_cache::path_for(path.string());
+	std::filesystem::remove(cache);
+
+	const Point3D origin(0.5, 0, -1);
+	ThreadPool pool;
+	const auto built = parse_obj(path.string(), nullptr, origin, pool);
+	REQUIRE(std::filesystem::exists(cache));
+
+	//the size and time stamp find the cache without reading the OBJ, the hash when asked.
+	const mesh_cache::Source stamp = mesh_cache::Source::of(path.string());
+	mesh_cache::Source hashed = stamp;
+	{
+		const MappedFile obj(path.string());
+		hashed.content_hash = mesh_cache::content_hash(obj.data(), obj.size());
+	}
+	const auto mapped = load_mesh_cache(cache, stamp, origin, VertexFormat::full, nullptr);
+	REQUIRE(mapped != nullptr);
+	REQUIRE(mapped->face_count() == built->face_count());
+	REQUIRE(mapped->bvh().nodes.empty());
+	REQUIRE(load_mesh_cache(cache, hashed, origin, VertexFormat::full, nullptr) != nullptr);
+	REQUIRE(load_mesh_cache(cache, hashed, Point3D(0, 0, 0), VertexFormat::full, nullptr) == nullptr);
+	mesh_cache::Source other = hashed;
+	*other.content_hash += 1;
+	REQUIRE(load_mesh_cache(cache, other, origin, VertexFormat::full, nullptr) == nullptr);
+	other = stamp;
+	other.mtime += 1;
+	REQUIRE(load_mesh_cache(cache, other, origin, VertexFormat::full, nullptr) == nullptr);
+	REQUIRE(load_mesh_cache(cache, hashed, origin, VertexFormat::quantized, nullptr) == nullptr);
+
+	//a touched but unchanged OBJ is matched by its hash, and the cache takes the new stamp.
+	std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds(5));
+	const mesh_cache::Source touched = mesh_cache::Source::of(path.string());
+	REQUIRE(load_mesh_cache(cache, touched, origin, VertexFormat::full, nullptr) == nullptr);
+	REQUIRE(parse_obj(path.string(), nullptr, origin, pool)->face_count() == built->face_count());
+	REQUIRE(load_mesh_cache(cache, touched, origin, VertexFormat::full, nullptr) != nullptr);
+
+	//writers get their own temporary file, and none is left behind.
+	REQUIRE(mesh_cache::temp_path_for(cache) != mesh_cache::temp_path_for(cache));
+	for (const auto& entry : std::filesystem::directory_iterator(path.parent_path()))
+		REQUIRE(entry.path().string().rfind(cache + ".", 0) != 0);
+	REQUIRE(mesh_cache::content_hash(nullptr, 0) == mesh_cache::content_hash("", 0));
+
+	//copies with an index or a node child out of range are rejected, not read.
+	auto corrupt = [&](auto&& edit) {
+		const std::string copy = cache + ".corrupt";
+		std::filesystem::copy_file(cache, copy, std::filesystem::copy_options::overwrite_existing);
+		std::fstream file(copy, std::ios::in | std::ios::out | std::ios::binary);
+		mesh_cache::Header header;
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		edit(file, header, mesh_cache::Layout(header));
+		file.close();
+		const auto loaded = load_mesh_cache(copy, touched, origin, VertexFormat::full, nullptr);
+		std::filesystem::remove(copy);
+		return loaded;
+	};
+	const auto write_u32 = [](std::fstream& file, size_t offset, uint32_t value) {
+		file.seekp(static_cast<std::streamoff>(offset));
+		file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	};
+	REQUIRE(corrupt([](std::fstream&, const mesh_cache::Header&, const mesh_cache::Layout&) {}) != nullptr);
+	REQUIRE(corrupt([&](std::fstream& file, const mesh_cache::Header& header, const mesh_cache::Layout& layout) {
+		write_u32(file, layout.indices + 4 * (3 * header.face_count - 1), static_cast<uint32_t>(header.vertex_count));
+	}) == nullptr);
+	REQUIRE(corrupt([&](std::fstream& file, const mesh_cache::Header&, const mesh_cache::Layout& layout) {
+		const WideNode& root = mapped->bvh().node_span()[0];
+		int slot = 0;
+		while (root.count[slot] > 0) slot++;
+		write_u32(file, layout.nodes + offsetof(WideNode, child) + 4 * slot, 0);
+	}) == nullptr);
+
+	std::mt19937_64 rng(5);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	int hits = 0;
+	for (int i = 0; i < 2000; i++) {
+		const Ray r(Point3D(0.5, 2, 9), Vec3(dist(rng) * 0.4, dist(rng) * 0.3 - 0.2, -1.0));
+		HitRecord a, b;
+		const bool hit_built = built->hit(r, Interval(0.001, infinity), a);
+		REQUIRE(hit_built == mapped->hit(r, Interval(0.001, infinity), b));
+		if (hit_built) {
+			REQUIRE(a.t == b.t);
+			REQUIRE(a.prim == b.prim);
+			hits++;
+		}
+	}
+	REQUIRE(hits > 0);
+}
+
+TEST_CASE("float and quantized vertices trace the same surface") {
+	ThreadPool pool;
+	const ObjMesh obj = load_obj("objs/teapot.obj", pool);
+	const Object full(obj, nullptr);
+	const Object single(obj, nullptr, VertexFormat::single);
+	const Object quantized(obj, nullptr, VertexFormat::quantized);
+	REQUIRE(full.vertices().size() == obj.positions.size());
+	REQUIRE(full.face_count() == obj.triangle_count());
+	REQUIRE(quantized.vertices().bytes().size() == 6 * obj.positions.size());
+
+	//a quantized coordinate is off by at most half a step, plus the rounding of decoding it.
+	for (uint32_t i = 0; i < obj.positions.size(); i++)
+		for (int axis = 0; axis < 3; axis++) {
+			const double position = obj.positions[i].e[axis];
+			const double bound = 0.5001 * quantized.vertices().step()[axis] + 4 * std::numeric_limits<Real>::epsilon() * std::fabs(position);
+			REQUIRE(std::fabs(quantized.vertices()[i].e[axis] - position) <= bound);
+		}
+
+	std::mt19937_64 rng(17);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	int hits = 0, agree = 0;
+	for (int i = 0; i < 4000; i++) {
+		const Ray r(Point3D(0, 2, 10), Vec3(dist(rng) * 0.35, dist(rng) * 0.2 - 0.05, -1.0));
+		HitRecord a, b, c;
+		const bool hit_full = full.hit(r, Interval(0.001, infinity), a);
+		const bool hit_single = single.hit(r, Interval(0.001, infinity), b);
+		const bool hit_quantized = quantized.hit(r, Interval(0.001, infinity), c);
+		if (!hit_full) continue;
+		hits++;
+		if (hit_single && hit_quantized && std::fabs(a.t - b.t) < 1e-4 && std::fabs(a.t - c.t) < 1e-3) agree++;
+	}
+	REQUIRE(hits > 1000);
+	//only rays grazing a silhouette may see the moved vertices.
+	REQUIRE(agree >= hits * 99 / 100);
+}
+
+TEST_CASE("meshes with per vertex normals share the vertex indices") {
+	//a unit quad whose normals lean outwards, indexed like the positions.
+	ObjMesh obj;
+	obj.positions = { Point3D(0, 0, 0), Point3D(1, 0, 0), Point3D(1, 1, 0), Point3D(0, 1, 0) };
+	obj.normals = { Vec3(-1, -1, 1), Vec3(1, -1, 1), Vec3(1, 1, 1), Vec3(-1, 1, 1) };
+	obj.position_indices = { 0, 1, 2, 0, 2, 3 };
+	obj.normal_indices = obj.position_indices;
+	const Object quad(obj, nullptr);
+	REQUIRE(quad.normal_indices().empty());
+	REQUIRE(quad.normals().size() == 12);
+
+	//the center gets the average of the corner normals, a hit near a corner leans its way.
+	HitRecord rec;
+	const Ray center(Point3D(0.5, 0.5, 1), Vec3(0, 0, -1));
+	REQUIRE(quad.hit(center, Interval(0.001, infinity), rec));
+	rec.finalize(center);
+	REQUIRE(rec.front_face);
+	REQUIRE(rec.normal.z() == Catch::Approx(1.0));
+
+	const Ray corner(Point3D(0.95, 0.95, -1), Vec3(0, 0, 1));
+	REQUIRE(quad.hit(corner, Interval(0.001, infinity), rec));
+	rec.finalize(corner);
+	REQUIRE(!rec.front_face);
+	REQUIRE(rec.normal.x() < -0.5);
+	REQUIRE(rec.normal.z() < 0);
+}
@@ -0,0 +1,69 @@
+#include <random>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../bvh.hpp"
+#include "../hittable_list.hpp"
+#include "../object.hpp"
+#include "../plane.hpp"
+#include "../sphere.hpp"
+#include "../sphere_set.hpp"
+
+//occluded() must answer exactly what hit() does, only without finding the closest hit.
+TEST_CASE("occluded agrees with hit for every primitive") {
+	std::mt19937_64 rng(5);
+	std::uniform_real_distribution<double> pos(-4.0, 4.0);
+	std::uniform_real_distribution<double> off(-0.6, 0.6);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+	std::vector<Triangle> faces;
+	SphereSet set;
+	for (int i = 0; i < 200; i++) {
+		Vec3 a(pos(rng), pos(rng), pos(rng));
+		faces.emplace_back(a, a + Vec3(off(rng), off(rng), off(rng)), a + Vec3(off(rng), off(rng), off(rng)));
+		set.add(Point3D(pos(rng), pos(rng), pos(rng)), 0.2, nullptr);
+	}
+	set.build();
+
+	HittableList list;
+	list.add(std::make_shared<Sphere>(Point3D(0, 0, 0), 1.5, nullptr));
+	list.add(std::make_shared<Plane>(Point3D(0, -3, 0), Vec3(0, 1, 0), nullptr));
+	list.add(std::make_shared<Triangle>(Vec3(-2, 2, -2), Vec3(2, 2, -2), Vec3(0, 2, 2)));
+	list.add(std::make_shared<Object>(faces, nullptr));
+	list.add(std::make_shared<SphereSet>(std::move(set)));
+	const Bvh bvh(list);
+
+	int blocked = 0;
+	for (int i = 0; i < 4000; i++) {
+		const Ray r(Point3D(dist(rng) * 6, dist(rng) * 6, dist(rng) * 6), Vec3(dist(rng), dist(rng), dist(rng)));
+		const Interval ray_t(0.001, 2.0 + 6.0 * (dist(rng) + 1.0));
+		HitRecord rec;
+		for (const auto& object : list.objects)
+			REQUIRE(object->occluded(r, ray_t) == object->hit(r, ray_t, rec));
+		const bool any = list.hit(r, ray_t, rec);
+		REQUIRE(list.occluded(r, ray_t) == any);
+		REQUIRE(bvh.occluded(r, ray_t) == any);
+		blocked += any;
+	}
+	REQUIRE(blocked > 500);
+	REQUIRE(blocked < 3500);
+}
+
+TEST_CASE("OccluderCache remembers the last blocker per light") {
+	HittableList list;
+	auto near = std::make_shared<Sphere>(Point3D(0, 0, -2), 0.5, nullptr);
+	list.add(near);
+	list.add(std::make_shared<Sphere>(Point3D(0, 0, 2), 0.5, nullptr));
+	const Bvh world(list);
+
+	OccluderCache cache;
+	cache.reset(2);
+	const Ray forward(Point3D(0, 0, 0), Vec3(0, 0, -1));
+	REQUIRE(cache.occluded(world, forward, Interval(0.001, 10), 0));
+	REQUIRE(cache.last[0] == near.get());
+	REQUIRE(cache.last[1] == nullptr);
+
+	//stopping short of the sphere, the light is in front of it.
+	REQUIRE_FALSE(cache.occluded(world, forward, Interval(0.001, 1.0), 0));
+	REQUIRE(cache.last[0] == nullptr);
+}
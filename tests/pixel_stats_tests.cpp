@@ -0,0 +1,38 @@
+#include <cmath>
+#include <vector>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../pixel_stats.hpp"
+
+TEST_CASE("PixelStats matches the two pass variance") {
+	std::vector<double> values;
+	for (int i = 0; i < 500; i++) values.push_back(random_double(0.0, 2.0));
+
+	PixelStats stats;
+	for (double v : values) stats.add(v);
+
+	double mean = 0.0;
+	for (double v : values) mean += v;
+	mean /= values.size();
+	double m2 = 0.0;
+	for (double v : values) m2 += (v - mean) * (v - mean);
+
+	REQUIRE(stats.count == 500);
+	REQUIRE(stats.mean == Catch::Approx(mean));
+	REQUIRE(stats.m2 == Catch::Approx(m2));
+}
+
+TEST_CASE("PixelStats converges on constant and not on noisy samples") {
+	PixelStats flat;
+	for (int i = 0; i < 16; i++) flat.add(0.3);
+	REQUIRE(flat.converged(0.001));
+
+	PixelStats noisy;
+	for (int i = 0; i < 16; i++) noisy.add(i % 2 ? 1.0 : 0.0);
+	REQUIRE_FALSE(noisy.converged(0.01));
+
+	PixelStats single;
+	single.add(0.5);
+	REQUIRE_FALSE(single.converged(1.0));
+}
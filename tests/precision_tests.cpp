@@ -0,0 +1,134 @@
+#include <array>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../bvh.hpp"
+#include "../hittable_list.hpp"
+#include "../object.hpp"
+#include "../plane.hpp"
+#include "../simd_pack.hpp"
+#include "../sphere.hpp"
+
+//`make bench-precision` builds this file with Real = double and Real = float and runs both.
+static const std::string real_name = std::is_same_v<Real, float> ? "float" : "double";
+
+#if HAVE_AVX2
+namespace {
+
+template<typename T>
+struct SlabPacket {
+	alignas(32) T origin[3][packet_width];
+	alignas(32) T inv_dir[3][packet_width];
+};
+
+//slab test of every box against an 8 ray packet, SimdPack<T>::width lanes per step.
+template<typename T>
+int count_box_hits(const SlabPacket<T>& packet, const std::vector<std::array<T, 6>>& boxes) {
+	using Pack = SimdPack<T>;
+	int hits = 0;
+	for (const auto& box : boxes) {
+		for (int base = 0; base < packet_width; base += Pack::width) {
+			Pack t_near = Pack::zero();
+			Pack t_far = Pack::broadcast(1e30);
+			for (int axis = 0; axis < 3; axis++) {
+				const Pack origin = Pack::load(&packet.origin[axis][base]);
+				const Pack inv_dir = Pack::load(&packet.inv_dir[axis][base]);
+				const Pack t0 = (Pack::broadcast(box[axis]) - origin) * inv_dir;
+				const Pack t1 = (Pack::broadcast(box[3 + axis]) - origin) * inv_dir;
+				t_near = max(min(t0, t1), t_near);
+				t_far = min(max(t0, t1), t_far);
+			}
+			hits += std::popcount((t_near <= t_far).movemask());
+		}
+	}
+	return hits;
+}
+
+template<typename T>
+SlabPacket<T> make_packet(std::mt19937_64& rng) {
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	SlabPacket<T> packet;
+	for (int lane = 0; lane < packet_width; lane++) {
+		const Vec3T<double> dir(dist(rng) * 0.4, dist(rng) * 0.4, -1.0);
+		for (int axis = 0; axis < 3; axis++) {
+			packet.origin[axis][lane] = static_cast<T>(axis == 2 ? 30.0 : 0.0);
+			packet.inv_dir[axis][lane] = static_cast<T>(1.0 / dir.e[axis]);
+		}
+	}
+	return packet;
+}
+
+template<typename T>
+std::vector<std::array<T, 6>> make_boxes(std::mt19937_64& rng, int count) {
+	std::uniform_real_distribution<double> pos(-10.0, 10.0);
+	std::vector<std::array<T, 6>> boxes;
+	for (int i = 0; i < count; i++) {
+		const double x = pos(rng), y = pos(rng), z = pos(rng);
+		boxes.push_back({ static_cast<T>(x), static_cast<T>(y), static_cast<T>(z), static_cast<T>(x + 1.5), static_cast<T>(y + 1.5), static_cast<T>(z + 1.5) });
+	}
+	return boxes;
+}
+
+}
+
+TEST_CASE("float and double packs agree on box hits") {
+	std::mt19937_64 rng_f(3), rng_d(3);
+	const auto packet_f = make_packet<float>(rng_f);
+	const auto packet_d = make_packet<double>(rng_d);
+	const auto boxes_f = make_boxes<float>(rng_f, 4096);
+	const auto boxes_d = make_boxes<double>(rng_d, 4096);
+
+	const int hits_f = count_box_hits(packet_f, boxes_f);
+	const int hits_d = count_box_hits(packet_d, boxes_d);
+	REQUIRE(hits_d > 0);
+	REQUIRE(std::abs(hits_f - hits_d) <= hits_d / 1000 + 1);
+}
+
+TEST_CASE("Precision benchmark: slab test lane width") {
+	std::mt19937_64 rng_f(5), rng_d(5);
+	const auto packet_f = make_packet<float>(rng_f);
+	const auto packet_d = make_packet<double>(rng_d);
+	const auto boxes_f = make_boxes<float>(rng_f, 4096);
+	const auto boxes_d = make_boxes<double>(rng_d, 4096);
+
+	BENCHMARK("slab test, 8 floats per register") { return count_box_hits(packet_f, boxes_f); };
+	BENCHMARK("slab test, 4 doubles per register") { return count_box_hits(packet_d, boxes_d); };
+}
+#endif
+
+TEST_CASE("Precision benchmark: packet traversal") {
+	std::mt19937_64 rng(19);
+	std::uniform_real_distribution<double> pos(-20.0, 20.0);
+	std::uniform_real_distribution<double> rad(0.05, 0.8);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+	HittableList list;
+	for (int i = 0; i < 5000; i++)
+		list.add(std::make_shared<Sphere>(Point3D(pos(rng), pos(rng), pos(rng)), rad(rng), nullptr));
+	list.add(std::make_shared<Plane>(Point3D(0, -25, 0), Vec3(0, 1, 0), nullptr));
+	ThreadPool pool;
+	list.add(std::make_shared<Object>(load_obj("objs/teapot.obj", pool), nullptr));
+	Bvh bvh(list);
+
+	std::vector<RayPacket> packets(256);
+	for (auto& packet : packets) {
+		Point3D origin(dist(rng) * 5, dist(rng) * 5, 40.0);
+		for (int lane = 0; lane < packet_width; lane++)
+			packet.set(lane, Ray(origin, Vec3(dist(rng) * 0.3, dist(rng) * 0.3, -1.0)));
+	}
+
+	BENCHMARK("packet traversal, Real = " + real_name) {
+		int hits = 0;
+		for (const auto& packet : packets) {
+			PacketHit result;
+			for (int lane = 0; lane < packet_width; lane++) result.t_max[lane] = infinity;
+			bvh.hit_packet(packet, 0xFFu, result);
+			hits += std::popcount(result.mask);
+		}
+		return hits;
+	};
+}
@@ -0,0 +1,63 @@
+#include <vector>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../constants.hpp"
+#include "../random.hpp"
+
+TEST_CASE("uniform_batch matches the scalar hash") {
+	std::vector<uint32_t> keys;
+	for (uint32_t pixel = 0; pixel < 1000; pixel++) keys.push_back(rng::sample_key(pixel, 7));
+
+	//odd count to cover the scalar tail
+	std::vector<float> batch(keys.size() - 3);
+	rng::uniform_batch(keys.data(), batch.size(), 1, batch.data());
+
+	double sum = 0;
+	for (size_t i = 0; i < batch.size(); i++) {
+		REQUIRE(batch[i] == rng::uniform(keys[i], 1));
+		REQUIRE(batch[i] >= 0.0f);
+		REQUIRE(batch[i] < 1.0f);
+		sum += batch[i];
+	}
+	REQUIRE(sum / batch.size() == Catch::Approx(0.5).margin(0.03));
+}
+
+TEST_CASE("path streams are reproducible and distinct") {
+	Rng a(rng::path_seed(42, 3, 0));
+	Rng b(rng::path_seed(42, 3, 0));
+	Rng c(rng::path_seed(42, 3, 1));
+	Rng d(rng::path_seed(43, 3, 0));
+
+	int same_c = 0, same_d = 0;
+	for (int i = 0; i < 100; i++) {
+		const uint64_t x = a.next();
+		REQUIRE(x == b.next());
+		same_c += x == c.next();
+		same_d += x == d.next();
+	}
+	REQUIRE(same_c == 0);
+	REQUIRE(same_d == 0);
+
+	thread_rng().seed(5);
+	const double first = random_double();
+	thread_rng().seed(5);
+	REQUIRE(random_double() == first);
+}
+
+TEST_CASE("random benchmark") {
+	BENCHMARK("Rng::next_double") {
+		Rng r(1);
+		double sum = 0;
+		for (int i = 0; i < 4096; i++) sum += r.next_double();
+		return sum;
+	};
+
+	std::vector<uint32_t> keys(4096);
+	for (uint32_t i = 0; i < keys.size(); i++) keys[i] = rng::sample_key(i, 0);
+	std::vector<float> out(keys.size());
+	BENCHMARK("uniform_batch") {
+		rng::uniform_batch(keys.data(), keys.size(), 0, out.data());
+		return out[17];
+	};
+}
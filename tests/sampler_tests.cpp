@@ -0,0 +1,69 @@
+#include <cmath>
+#include <vector>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../constants.hpp"
+#include "../sampler.hpp"
+
+TEST_CASE("scrambled Sobol points are stratified") {
+	for (uint32_t pixel : {0u, 17u, 9001u}) {
+		std::vector<int> cells(16, 0), rows(16, 0), columns(16, 0);
+		for (uint32_t sample = 0; sample < 16; sample++) {
+			const Vec2 p = sample_pair(SamplerType::sobol, pixel, 0, 0, sample, 3);
+			REQUIRE(p.x() >= 0.0);
+			REQUIRE(p.x() < 1.0);
+			REQUIRE(p.y() >= 0.0);
+			REQUIRE(p.y() < 1.0);
+			cells[static_cast<int>(p.y() * 4) * 4 + static_cast<int>(p.x() * 4)]++;
+			columns[static_cast<int>(p.x() * 16)]++;
+			rows[static_cast<int>(p.y() * 16)]++;
+		}
+		for (int i = 0; i < 16; i++) {
+			REQUIRE(cells[i] == 1);
+			REQUIRE(columns[i] == 1);
+			REQUIRE(rows[i] == 1);
+		}
+	}
+}
+
+TEST_CASE("blue noise mask holds every rank once") {
+	const auto& mask = blue_noise::mask();
+	REQUIRE(mask.size() == blue_noise::mask_size * blue_noise::mask_size);
+	std::vector<bool> seen(mask.size(), false);
+	for (uint16_t rank : mask) {
+		REQUIRE(rank < mask.size());
+		REQUIRE_FALSE(seen[rank]);
+		seen[rank] = true;
+	}
+}
+
+TEST_CASE("warps land on the sphere and in the disk") {
+	for (uint32_t sample = 0; sample < 64; sample++) {
+		const Vec2 u = sample_pair(SamplerType::sobol, 5, 0, 0, sample, 0);
+		REQUIRE(square_to_unit_sphere(u).length() == Catch::Approx(1.0));
+		const Vec3 d = square_to_unit_disk(u);
+		REQUIRE(d.z() == 0.0);
+		REQUIRE(d.length() <= 1.0);
+	}
+}
+
+//integral of a smooth function over the unit square, estimated per pixel with 64 samples.
+TEST_CASE("Sobol converges faster than random") {
+	auto f = [](const Vec2& p) { return std::sin(3 * p.x()) * p.y() * p.y(); };
+	const double exact = (1 - std::cos(3.0)) / 3 / 3;
+
+	double sobol_error = 0, random_error = 0;
+	const int pixels = 200, samples = 64;
+	for (uint32_t pixel = 0; pixel < pixels; pixel++) {
+		double sobol_sum = 0, random_sum = 0;
+		thread_rng().seed(rng::path_seed(pixel, 0, 0));
+		for (uint32_t sample = 0; sample < samples; sample++) {
+			sobol_sum += f(sample_pair(SamplerType::sobol, pixel, 0, 0, sample, 2));
+			random_sum += f(Vec2(random_double(), random_double()));
+		}
+		sobol_error += std::pow(sobol_sum / samples - exact, 2);
+		random_error += std::pow(random_sum / samples - exact, 2);
+	}
+	REQUIRE(std::sqrt(sobol_error / pixels) * 4 < std::sqrt(random_error / pixels));
+}
@@ -0,0 +1,130 @@
+#include <cmath>
+#include <limits>
+#include <random>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../bvh.hpp"
+#include "../hittable_list.hpp"
+#include "../material.hpp"
+#include "../sphere.hpp"
+#include "../sphere_set.hpp"
+
+namespace {
+
+//near the silhouette the root of the quadratic loses half the digits, so the batched and
+//single sphere tests only agree to about the square root of the precision.
+const double t_epsilon = std::sqrt(std::numeric_limits<Real>::epsilon());
+
+//a gen_world style field: small spheres scattered over a grid.
+void make_field(MaterialRegistry& materials, HittableList& spheres, SphereSet& set, int extent) {
+	std::mt19937_64 rng(11);
+	std::uniform_real_distribution<double> jitter(0.0, 0.9);
+	std::uniform_real_distribution<double> rad(0.1, 0.3);
+	const Material* palette[3] = { materials.add<Lambertian>(Vec3(0.5, 0.5, 0.5)), materials.add<Metal>(Vec3(0.7, 0.6, 0.5), 0.1), materials.add<Dielectric>(1.5) };
+
+	int i = 0;
+	for (int a = -extent; a < extent; a++) {
+		for (int b = -extent; b < extent; b++, i++) {
+			const Point3D center(a + jitter(rng), rad(rng), b + jitter(rng));
+			const Real radius = center.y();
+			spheres.add(std::make_shared<Sphere>(center, radius, palette[i % 3]));
+			set.add(center, radius, palette[i % 3]);
+		}
+	}
+	set.build();
+}
+
+Ray random_ray(std::mt19937_64& rng) {
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	return Ray(Point3D(13.0, 2.0, 3.0), Point3D(dist(rng) * 8, dist(rng), dist(rng) * 8) - Point3D(13.0, 2.0, 3.0));
+}
+
+}
+
+TEST_CASE("SphereSet matches individual spheres") {
+	MaterialRegistry materials;
+	HittableList spheres;
+	SphereSet set;
+	make_field(materials, spheres, set, 11);
+	REQUIRE(set.size() == spheres.objects.size());
+
+	std::mt19937_64 rng(5);
+	int hits = 0;
+	for (int i = 0; i < 4000; i++) {
+		const Ray r = random_ray(rng);
+		HitRecord a, b;
+		const bool hit_spheres = spheres.hit(r, Interval(0.001, infinity), a);
+		const bool hit_set = set.hit(r, Interval(0.001, infinity), b);
+		if (hit_spheres != hit_set) {
+			//rounding may only decide a ray differently that touches a sphere's silhouette.
+			HitRecord& rec = hit_spheres ? a : b;
+			rec.finalize(r);
+			REQUIRE(std::fabs(dot(unit_vector(r.direction()), rec.normal)) <= 10 * t_epsilon * rec.t * r.direction().length());
+			continue;
+		}
+		if (!hit_spheres) continue;
+
+		REQUIRE(a.t == Catch::Approx(b.t).epsilon(t_epsilon));
+		a.finalize(r);
+		b.finalize(r);
+		REQUIRE(a.mat == b.mat);
+		//the normal is (p - center) / radius, and no radius of the field is below 0.1.
+		const double p_error = t_epsilon * a.t * r.direction().length();
+		REQUIRE((a.p - b.p).length() <= p_error);
+		REQUIRE((a.normal - b.normal).length() <= 10 * p_error);
+		REQUIRE(a.uv.x() == Catch::Approx(b.uv.x()).margin(10 * p_error));
+		hits++;
+	}
+	REQUIRE(hits > 0);
+}
+
+TEST_CASE("SphereSet packets match single rays") {
+	MaterialRegistry materials;
+	HittableList spheres;
+	SphereSet set;
+	make_field(materials, spheres, set, 6);
+
+	std::mt19937_64 rng(8);
+	for (int i = 0; i < 300; i++) {
+		RayPacket packet;
+		PacketHit hits;
+		for (int lane = 0; lane < packet_width; lane++) {
+			packet.set(lane, random_ray(rng));
+			hits.t_max[lane] = infinity;
+		}
+		const unsigned lanes = (i % 2) ? 0xFFu : 0xA7u;
+		set.hit_packet(packet, lanes, hits);
+
+		for (int lane = 0; lane < packet_width; lane++) {
+			HitRecord rec;
+			const bool expected = (lanes >> lane & 1) && set.hit(packet.rays[lane], Interval(packet.t_min, infinity), rec);
+			REQUIRE(static_cast<bool>(hits.mask >> lane & 1) == expected);
+			if (expected) REQUIRE(hits.rec[lane].prim == rec.prim);
+		}
+	}
+}
+
+TEST_CASE("SphereSet benchmark") {
+	MaterialRegistry materials;
+	HittableList spheres;
+	SphereSet set;
+	make_field(materials, spheres, set, 11);
+	const Bvh sphere_bvh(spheres);
+
+	std::mt19937_64 rng(13);
+	std::vector<Ray> rays;
+	for (int i = 0; i < 4096; i++) rays.push_back(random_ray(rng));
+
+	auto trace = [&](const Hittable& world) {
+		int hits = 0;
+		for (const auto& r : rays) {
+			HitRecord rec;
+			hits += world.hit(r, Interval(0.001, infinity), rec);
+		}
+		return hits;
+	};
+
+	BENCHMARK("Bvh over Sphere objects") { return trace(sphere_bvh); };
+	BENCHMARK("SphereSet") { return trace(set); };
+}
@@ -0,0 +1,42 @@
+#include <atomic>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../thread_pool.hpp"
+
+TEST_CASE("parallel_for visits every index once") {
+	ThreadPool pool(4);
+	std::vector<std::atomic<int>> visits(10000);
+
+	pool.parallel_for(0, visits.size(), 64, [&](size_t i) { visits[i].fetch_add(1); });
+
+	for (const auto& v : visits) REQUIRE(v.load() == 1);
+}
+
+TEST_CASE("TaskGroup joins nested work") {
+	ThreadPool pool(3);
+	std::atomic<int> done = 0;
+
+	TaskGroup outer(pool);
+	for (int i = 0; i < 16; i++) {
+		outer.run([&] {
+			TaskGroup inner(pool);
+			for (int j = 0; j < 16; j++) inner.run([&] { done.fetch_add(1); });
+			inner.wait();
+		});
+	}
+	outer.wait();
+
+	REQUIRE(done.load() == 256);
+}
+
+TEST_CASE("pool can be reused after a batch") {
+	ThreadPool pool(2);
+	for (int round = 0; round < 3; round++) {
+		std::atomic<int> count = 0;
+		TaskGroup group(pool);
+		for (int i = 0; i < 100; i++) group.run([&] { count.fetch_add(1); });
+		group.wait();
+		REQUIRE(count.load() == 100);
+	}
+}
@@ -0,0 +1,103 @@
+#include <vector>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../tile_scheduler.hpp"
+
+namespace {
+
+void cover(std::vector<int>& counts, int width, const Tile& tile) {
+	for (int y = tile.y0; y < tile.y1; y++)
+		for (int x = tile.x0; x < tile.x1; x++)
+			counts[y * width + x]++;
+}
+
+}
+
+TEST_CASE("morton codes round trip") {
+	for (uint32_t y = 0; y < 64; y++) {
+		for (uint32_t x = 0; x < 64; x++) {
+			uint32_t dx, dy;
+			morton_decode(morton_encode(x, y), dx, dy);
+			REQUIRE(dx == x);
+			REQUIRE(dy == y);
+		}
+	}
+	REQUIRE(morton_encode(1, 0) == 1);
+	REQUIRE(morton_encode(0, 1) == 2);
+	REQUIRE(morton_encode(1, 1) == 3);
+}
+
+TEST_CASE("tiles and their splits cover the image once") {
+	const int width = 203, height = 117;
+	TileScheduler scheduler(width, height, 32, 4);
+
+	std::vector<int> counts(width * height, 0);
+	for (const Tile& tile : scheduler.tiles()) cover(counts, width, tile);
+	for (int c : counts) REQUIRE(c == 1);
+
+	std::vector<int> split_counts(width * height, 0);
+	for (const Tile& tile : scheduler.tiles()) {
+		if (tile.width() < 2 * TileScheduler::min_tile_size || tile.height() < 2 * TileScheduler::min_tile_size) {
+			cover(split_counts, width, tile);
+			continue;
+		}
+		for (const Tile& sub : TileScheduler::split(tile)) {
+			REQUIRE(sub.width() > 0);
+			REQUIRE(sub.height() > 0);
+			cover(split_counts, width, sub);
+		}
+	}
+	for (int c : split_counts) REQUIRE(c == 1);
+}
+
+TEST_CASE("expensive tiles are split near the end of the frame") {
+	const int size = 32;
+	TileScheduler scheduler(4 * size, 4 * size, size, 1);
+	const auto& tiles = scheduler.tiles();
+
+	//without telemetry nothing is split
+	REQUIRE_FALSE(scheduler.should_split(tiles[0]));
+	scheduler.record(tiles[0], 0.001);
+
+	//cheap everywhere except next to the last tile
+	for (size_t i = 1; i + 1 < tiles.size(); i++) {
+		if (scheduler.should_split(tiles[i])) continue;
+		scheduler.record(tiles[i], i + 2 == tiles.size() ? 1.0 : 0.001);
+	}
+
+	REQUIRE(scheduler.should_split(tiles.back()));
+}
+
+TEST_CASE("tail tiles of average cost stay whole") {
+	const int size = 32;
+	TileScheduler scheduler(4 * size, 4 * size, size, 4);
+	const auto& tiles = scheduler.tiles();
+
+	//the last 8 tiles are the tail, their costs vary by 20% around the mean.
+	for (size_t i = 0; i < tiles.size(); i++) {
+		REQUIRE_FALSE(scheduler.should_split(tiles[i]));
+		scheduler.record(tiles[i], 0.001 * (1.0 + 0.2 * (static_cast<int>(i % 3) - 1)));
+	}
+}
+
+TEST_CASE("bands hold consecutive rows of tiles") {
+	const int width = 150, height = 100, size = 16;
+	TileScheduler scheduler(width, height, size, 2, 1);
+	REQUIRE(scheduler.band_count() == (height + size - 1) / size);
+	REQUIRE(scheduler.band_height() == size);
+
+	size_t total = 0;
+	for (int b = 0; b < scheduler.band_count(); b++) {
+		for (const Tile& tile : scheduler.band(b)) {
+			REQUIRE(scheduler.band_of(tile) == b);
+			for (const Tile& sub : TileScheduler::split(tile)) REQUIRE(scheduler.band_of(sub) == b);
+		}
+		total += scheduler.band(b).size();
+	}
+	REQUIRE(total == scheduler.tiles().size());
+
+	TileScheduler whole(width, height, size, 2);
+	REQUIRE(whole.band_count() == 1);
+	REQUIRE(whole.band(0).size() == whole.tiles().size());
+}
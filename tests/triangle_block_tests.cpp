@@ -0,0 +1,109 @@
+#include <random>
+#define CATCH_CONFIG_MAIN
+
+#include "../third_party/catch2/catch_amalgamated.hpp"
+#include "../object.hpp"
+#include "../triangle_block.hpp"
+
+namespace {
+
+//Blocks of eight random triangles under rays built to sit on the edge of the exact test:
+//aimed at barycentrics a hair inside or outside an edge, skimming the triangle's plane,
+//with t bounds just around the hit, and from small triangles far from the world origin.
+struct Case {
+	std::vector<Triangle> faces;
+	TriangleBlock block{};
+	Ray ray;
+	Interval ray_t;
+};
+
+Case make_case(std::mt19937_64& rng) {
+	std::uniform_real_distribution<double> unit(-1.0, 1.0);
+	std::uniform_real_distribution<double> zero_one(0.0, 1.0);
+	std::uniform_int_distribution<int> kind(0, 5);
+	const double scales[] = { 1e-3, 1e-2, 1.0, 50.0 };
+	const double offsets[] = { 0.0, 5.0, 200.0 };
+
+	Case c;
+	const double scale = scales[rng() % 4];
+	const Vec3 center = offsets[rng() % 3] * Vec3(unit(rng), unit(rng), unit(rng));
+	for (int lane = 0; lane < triangle_block_width; lane++) {
+		const Point3D a = center + scale * Vec3(unit(rng), unit(rng), unit(rng));
+		c.faces.emplace_back(a, a + scale * Vec3(unit(rng), unit(rng), unit(rng)), a + scale * Vec3(unit(rng), unit(rng), unit(rng)));
+		c.block.set(lane, c.faces.back().vertex0(), c.faces.back().edge1(), c.faces.back().edge2());
+	}
+
+	//the ray targets one face of the block.
+	const Triangle& face = c.faces[rng() % triangle_block_width];
+	double b1 = zero_one(rng), b2 = zero_one(rng) * (1.0 - b1);
+	const double nudge = 1e-7 * unit(rng);
+	switch (kind(rng)) {
+	case 0: b1 = nudge; break;
+	case 1: b2 = nudge; break;
+	case 2: b2 = 1.0 - b1 + nudge; break;
+	default: break;
+	}
+	const Point3D target = face.vertex0() + b1 * face.edge1() + b2 * face.edge2();
+
+	Vec3 dir(unit(rng), unit(rng), unit(rng));
+	if (rng() % 3 == 0) {
+		//skim the plane: keep only a sliver of the direction along the normal.
+		dir = dir - dot(dir, face.normal()) * face.normal() + 1e-5 * unit(rng) * face.normal();
+	}
+	const double distance = std::pow(10.0, 3.0 * zero_one(rng) - 1.0);
+	c.ray = Ray(target - distance * dir, dir);
+
+	c.ray_t = Interval(0.001, infinity);
+	if (rng() % 3 == 0) {
+		//bound t just before or after the hit.
+		c.ray_t.high = distance * (1.0 + 1e-7 * unit(rng));
+		if (rng() % 2) c.ray_t = Interval(distance * (1.0 + 1e-7 * unit(rng)), infinity);
+	}
+	return c;
+}
+
+}
+
+TEST_CASE("triangle block filter keeps every exact hit") {
+	std::mt19937_64 rng(404);
+	int hits = 0, differ = 0;
+	const int cases = 200000;
+	for (int i = 0; i < cases; i++) {
+		const Case c = make_case(rng);
+		const BlockRay block_ray(c.ray);
+		const float t_min = static_cast<float>(c.ray_t.low), t_max = static_cast<float>(c.ray_t.high);
+		const unsigned scalar = intersect_block_scalar(c.block, block_ray, t_min, t_max);
+		const unsigned vector = intersect_block(c.block, block_ray, t_min, t_max);
+		differ += scalar != vector;
+
+		for (int lane = 0; lane < triangle_block_width; lane++) {
+			HitRecord rec;
+			if (!c.faces[lane].hit(c.ray, c.ray_t, rec)) continue;
+			hits++;
+			INFO("case " << i << " lane " << lane << " t " << rec.t << " b " << rec.uv.x() << " " << rec.uv.y());
+			REQUIRE((scalar >> lane & 1));
+			REQUIRE((vector >> lane & 1));
+		}
+	}
+	REQUIRE(hits > cases / 4);
+	//both builds run the same arithmetic, only instruction selection (fused multiply-adds)
+	//may move a lane right at a tolerance bound.
+	REQUIRE(differ <= cases / 1000);
+}
+
+TEST_CASE("triangle block filter rejects clear misses") {
+	TriangleBlock block{};
+	const Triangle face(Vec3(0, 0, 0), Vec3(1, 0, 0), Vec3(0, 1, 0));
+	block.set(0, face.vertex0(), face.edge1(), face.edge2());
+
+	const BlockRay inside(Ray(Point3D(0.25, 0.25, 1), Vec3(0, 0, -1)));
+	const BlockRay outside(Ray(Point3D(0.75, 0.75, 1), Vec3(0, 0, -1)));
+	const BlockRay away(Ray(Point3D(0.25, 0.25, 1), Vec3(0, 0, 1)));
+	for (auto test : { intersect_block_scalar, intersect_block }) {
+		//lanes 1 to 7 are empty and never report a hit.
+		REQUIRE(test(block, inside, 0.001f, 10.0f) == 1u);
+		REQUIRE(test(block, inside, 0.001f, 0.5f) == 0u);
+		REQUIRE(test(block, outside, 0.001f, 10.0f) == 0u);
+		REQUIRE(test(block, away, 0.001f, 10.0f) == 0u);
+	}
+}
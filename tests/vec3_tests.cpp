@@ -6,8 +6,8 @@
 
 TEST_CASE("SSE Vec result") {
 
-	Vec3 v_A(5.0, 2.0, 1.0); 
-	Vec3 v_B(1.0, 1.0, 0.0);
+	Vec3T<double> v_A(5.0, 2.0, 1.0); 
+	Vec3T<double> v_B(1.0, 1.0, 0.0);
 
 	double example = dot(v_A, v_B);
 	double sse_example = dot_sse(v_A, v_B);
@@ -16,13 +16,13 @@ TEST_CASE("SSE Vec result") {
 }
 
 
-static double sum_dot_scalar(const std::vector<Vec3>& A, const std::vector<Vec3>& B) {
+static double sum_dot_scalar(const std::vector<Vec3T<double>>& A, const std::vector<Vec3T<double>>& B) {
 	double acc = 0.0;
 	for(size_t i = 0; i < A.size(); ++i) acc += dot(A[i], B[i]);
 	return acc;
 }
 
-static double sum_dot_avx(const std::vector<Vec3>& A, const std::vector<Vec3>& B) {
+static double sum_dot_avx(const std::vector<Vec3T<double>>& A, const std::vector<Vec3T<double>>& B) {
 	double acc = 0.0;
 	for(size_t i = 0; i < A.size(); ++i) acc += dot_sse(A[i], B[i]);
 	return acc;
@@ -33,14 +33,14 @@ TEST_CASE("Vec Dot Benchmarks") {
 
 	
 	constexpr size_t N = 1 << 20;
-	std::vector<Vec3> A(N), B(N);
+	std::vector<Vec3T<double>> A(N), B(N);
 
 	std::mt19937_64 rng(12345);
 	std::uniform_real_distribution<double> dist(-1.0, 1.0);
 
 	for(size_t i = 0; i < N; ++i) {
-		A[i] = Vec3(dist(rng), dist(rng), dist(rng));
-		B[i] = Vec3(dist(rng), dist(rng), dist(rng));
+		A[i] = Vec3T<double>(dist(rng), dist(rng), dist(rng));
+		B[i] = Vec3T<double>(dist(rng), dist(rng), dist(rng));
 	}
 
 
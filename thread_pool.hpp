@@ -1,78 +1,277 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
-#include <functional>
+#include <cstddef>
+#include <deque>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
 #include <stdexcept>
 #include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+//Move-only callable with inline storage, so queuing a job never touches the heap.
+class Job {
+public:
+	static constexpr size_t capacity = 64;
+
+	Job() = default;
+
+	template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Job>>>
+	Job(F&& f) {
+		using T = std::decay_t<F>;
+		static_assert(sizeof(T) <= capacity, "job captures too much state for the inline buffer");
+		static_assert(alignof(T) <= alignof(std::max_align_t), "job is over-aligned");
+		static_assert(std::is_nothrow_move_constructible_v<T>, "job must be nothrow movable");
+		new (_storage) T(std::forward<F>(f));
+		_ops = &ops_for<T>;
+	}
+
+	Job(Job&& other) noexcept { take(other); }
+
+	Job& operator=(Job&& other) noexcept {
+		if (this != &other) {
+			reset();
+			take(other);
+		}
+		return *this;
+	}
+
+	~Job() { reset(); }
+
+	explicit operator bool() const { return _ops != nullptr; }
+
+	void operator()() { _ops->invoke(_storage); }
+
+private:
+	struct Ops {
+		void (*invoke)(void*);
+		void (*move)(void* dst, void* src);
+		void (*destroy)(void*);
+	};
+
+	template<typename T>
+	static constexpr Ops ops_for = {
+		[](void* p) { (*static_cast<T*>(p))(); },
+		[](void* dst, void* src) {
+			new (dst) T(std::move(*static_cast<T*>(src)));
+			static_cast<T*>(src)->~T();
+		},
+		[](void* p) { static_cast<T*>(p)->~T(); },
+	};
+
+	alignas(std::max_align_t) unsigned char _storage[capacity];
+	const Ops* _ops = nullptr;
+
+	void take(Job& other) {
+		if (other._ops) {
+			other._ops->move(_storage, other._storage);
+			_ops = std::exchange(other._ops, nullptr);
+		}
+	}
+
+	void reset() {
+		if (_ops) {
+			_ops->destroy(_storage);
+			_ops = nullptr;
+		}
+	}
+};
+
+//Work stealing pool: every worker owns a deque, pops its own work from the back and steals
+//from the front of the others when it runs dry. Workers only share a lock to go to sleep.
 class ThreadPool {
-	using Job = std::function<void()>;
 public:
 
-	explicit ThreadPool(size_t n = std::max(1u, std::thread::hardware_concurrency())) {
+	explicit ThreadPool(size_t n = std::max(1u, std::thread::hardware_concurrency())) : _worker_count(n), _workers(std::make_unique<Worker[]>(n)) {
 		for(size_t i = 0; i < n; i++)
 		{
-			_threads.emplace_back([this](std::stop_token st) {
-				for(;;)
-				{
-					Job job;
-					{
-						std::unique_lock lk(_mutex);
-						_cv.wait(lk, [this, st]{ return stop || !_queue.empty() || st.stop_requested(); });
-						if (stop && _queue.empty()) break;
-						if (st.stop_requested()) break;
-
-						job = std::move(_queue.front());
-						_queue.pop();
-					}
-
-					//Job begin
-					job();
-					{
-						std::lock_guard lk(_mutex);
-						if (stop && _queue.empty()) {
-							_cv.notify_all();
-							break;
-						}
-					}
-				}	
-			});
-		
+			_threads.emplace_back([this, i](std::stop_token st) { worker_loop(st, i); });
 		}
 	}
 
 	~ThreadPool() {
+		//queued work still runs to completion before the workers exit.
+		wait_idle();
 		{
-			std::lock_guard lk(_mutex);
+			std::lock_guard lk(_sleep_mutex);
 			stop = true;
 		}
-
 		_cv.notify_all();
-
-		{
-			std::unique_lock lk(_mutex);
-			_cv.wait(lk, [this] {
-				return _queue.empty();
-			});
-		}
-
 	}
 
+	size_t size() const { return _worker_count; }
+
 	void execute(Job&& new_job) {
-		std::unique_lock lk(_mutex);
 		if (stop) {
 			throw std::runtime_error("ThreadPool stopped!");
 		}
-		_queue.push(std::move(new_job));
-		_cv.notify_one();
+
+		//workers keep their own spawns local, other threads spread jobs round robin.
+		size_t target = (tl_pool == this) ? tl_index : _next.fetch_add(1, std::memory_order_relaxed) % _worker_count;
+		_unfinished.fetch_add(1);
+		_queued.fetch_add(1);
+		{
+			std::lock_guard lk(_workers[target].mutex);
+			_workers[target].jobs.push_back(std::move(new_job));
+		}
+
+		if (_sleepers.load() > 0) {
+			std::lock_guard lk(_sleep_mutex);
+			_cv.notify_one();
+		}
 	};
 
+	//Runs one queued job on the calling thread, if there is one. Lets a thread that waits
+	//on a batch help with it instead of blocking.
+	bool try_run_one() {
+		Job job;
+		size_t start = (tl_pool == this) ? tl_index : 0;
+		if (!grab(start, job)) return false;
+		run(job);
+		return true;
+	}
+
+	//Blocks until every job submitted so far has finished.
+	void wait_idle() {
+		wait_until([this] { return _unfinished.load() == 0; });
+	}
+
+	//Helps with queued work until done() holds. Sleeps on job completions when there is
+	//nothing left to take, so done() must only change when a job of this pool finishes.
+	template<typename Pred>
+	void wait_until(Pred&& done) {
+		while (!done()) {
+			if (try_run_one()) continue;
+			size_t n = _unfinished.load();
+			if (done()) break;
+			_unfinished.wait(n);
+		}
+	}
+
+	//Calls body(i) for every i in [begin, end), split into chunks of grain indices,
+	//and returns once all of them are done.
+	template<typename F>
+	void parallel_for(size_t begin, size_t end, size_t grain, F&& body);
+
 private:
-	std::mutex _mutex;
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	size_t _worker_count;
+	std::unique_ptr<Worker[]> _workers;
+	std::atomic<size_t> _next = 0;
+	std::atomic<size_t> _queued = 0;
+	std::atomic<size_t> _unfinished = 0;
+	std::atomic<int> _sleepers = 0;
+
+	std::mutex _sleep_mutex;
 	std::condition_variable _cv;
-	std::queue<Job> _queue;
-	bool stop = false;
+	std::atomic<bool> stop = false;
 	std::vector<std::jthread> _threads;
+
+	static inline thread_local ThreadPool* tl_pool = nullptr;
+	static inline thread_local size_t tl_index = 0;
+
+	void worker_loop(std::stop_token st, size_t index) {
+		tl_pool = this;
+		tl_index = index;
+
+		while (!st.stop_requested()) {
+			Job job;
+			if (grab(index, job)) {
+				run(job);
+				continue;
+			}
+
+			std::unique_lock lk(_sleep_mutex);
+			_sleepers.fetch_add(1);
+			_cv.wait(lk, [this, &st] { return stop || _queued.load() > 0 || st.stop_requested(); });
+			_sleepers.fetch_sub(1);
+			if (stop && _queued.load() == 0) break;
+		}
+	}
+
+	//own deque first (newest job, still warm in cache), then the oldest job of a victim.
+	bool grab(size_t index, Job& job) {
+		if (_queued.load() == 0) return false;
+
+		{
+			Worker& self = _workers[index];
+			std::lock_guard lk(self.mutex);
+			if (!self.jobs.empty()) {
+				job = std::move(self.jobs.back());
+				self.jobs.pop_back();
+				_queued.fetch_sub(1);
+				return true;
+			}
+		}
+
+		for (size_t k = 1; k < _worker_count; k++) {
+			Worker& victim = _workers[(index + k) % _worker_count];
+			std::lock_guard lk(victim.mutex);
+			if (!victim.jobs.empty()) {
+				job = std::move(victim.jobs.front());
+				victim.jobs.pop_front();
+				_queued.fetch_sub(1);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void run(Job& job) {
+		job();
+		_unfinished.fetch_sub(1);
+		_unfinished.notify_all();
+	}
+};
+
+//A batch of jobs that can be joined on its own, independent of other work in the pool.
+class TaskGroup {
+public:
+	explicit TaskGroup(ThreadPool& pool) : _pool(pool) {}
+
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator=(const TaskGroup&) = delete;
+
+	~TaskGroup() { wait(); }
+
+	template<typename F>
+	void run(F&& f) {
+		_pending.fetch_add(1);
+		//the job must not touch the group after the decrement, the joiner may return right away.
+		_pool.execute([this, f = std::forward<F>(f)]() mutable {
+			f();
+			_pending.fetch_sub(1);
+		});
+	}
+
+	//Joins the group. The waiting thread runs queued jobs while it waits.
+	void wait() {
+		_pool.wait_until([this] { return _pending.load() == 0; });
+	}
+
+private:
+	ThreadPool& _pool;
+	std::atomic<size_t> _pending = 0;
 };
+
+template<typename F>
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain, F&& body) {
+	grain = std::max<size_t>(1, grain);
+	TaskGroup group(*this);
+	for (size_t lo = begin; lo < end; lo += grain) {
+		size_t hi = std::min(end, lo + grain);
+		group.run([&body, lo, hi] {
+			for (size_t i = lo; i < hi; i++) body(i);
+		});
+	}
+	group.wait();
+}
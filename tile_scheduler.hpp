@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <vector>
+
+struct Tile {
+	int x0, y0, x1, y1; //pixel bounds, x1 and y1 exclusive
+
+	int width() const { return x1 - x0; }
+	int height() const { return y1 - y0; }
+	long area() const { return static_cast<long>(width()) * height(); }
+};
+
+//Z-order curve: interleaves the bits of x and y, so nearby codes are nearby in 2D.
+inline uint32_t morton_encode(uint32_t x, uint32_t y) {
+	auto spread = [](uint32_t v) {
+		v &= 0x0000FFFF;
+		v = (v | (v << 8)) & 0x00FF00FF;
+		v = (v | (v << 4)) & 0x0F0F0F0F;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	};
+	return spread(x) | (spread(y) << 1);
+}
+
+inline void morton_decode(uint32_t code, uint32_t& x, uint32_t& y) {
+	auto compact = [](uint32_t v) {
+		v &= 0x55555555;
+		v = (v | (v >> 1)) & 0x33333333;
+		v = (v | (v >> 2)) & 0x0F0F0F0F;
+		v = (v | (v >> 4)) & 0x00FF00FF;
+		v = (v | (v >> 8)) & 0x0000FFFF;
+		return v;
+	};
+	x = compact(code);
+	y = compact(code >> 1);
+}
+
+//Hands out the tiles of a frame in Morton order and collects how long every tile took.
+//Near the end of the frame, tiles that the cost map predicts to be expensive are split
+//in four so the last few workers do not wait on one slow tile.
+class TileScheduler {
+public:
+	static constexpr int min_tile_size = 8; //one packet block, tiles are never split below it
+
+	//band_rows groups the tiles into horizontal bands of that many tile rows, which are
+	//handed out one after another; 0 puts the whole image in a single band.
+	TileScheduler(int width, int height, int tile_size, size_t workers, int band_rows = 0)
+		: width_(width), height_(height), tile_size_(std::max(min_tile_size, tile_size)), workers_(std::max<size_t>(1, workers)) {
+		cells_x_ = (width_ + min_tile_size - 1) / min_tile_size;
+		cells_y_ = (height_ + min_tile_size - 1) / min_tile_size;
+		cell_cost_.assign(static_cast<size_t>(cells_x_) * cells_y_, -1.0);
+		unstarted_pixels_ = static_cast<long>(width_) * height_;
+
+		const int tiles_x = (width_ + tile_size_ - 1) / tile_size_;
+		const int tiles_y = (height_ + tile_size_ - 1) / tile_size_;
+		band_rows_ = band_rows > 0 ? band_rows : std::max(1, tiles_y);
+
+		//sorted by band first, then along the Morton curve inside the band.
+		std::vector<std::pair<uint64_t, Tile>> ordered;
+		for (int ty = 0; ty < tiles_y; ty++) {
+			for (int tx = 0; tx < tiles_x; tx++) {
+				Tile tile{ tx * tile_size_, ty * tile_size_, std::min((tx + 1) * tile_size_, width_), std::min((ty + 1) * tile_size_, height_) };
+				const uint64_t band = static_cast<uint64_t>(ty / band_rows_);
+				ordered.emplace_back((band << 32) | morton_encode(tx, ty % band_rows_), tile);
+			}
+		}
+		std::sort(ordered.begin(), ordered.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+		band_offsets_.push_back(0);
+		for (const auto& [key, tile] : ordered) {
+			while (static_cast<uint64_t>(band_offsets_.size() - 1) < (key >> 32)) band_offsets_.push_back(tiles_.size());
+			tiles_.push_back(tile);
+		}
+		band_offsets_.push_back(tiles_.size());
+	}
+
+	//Aims for a few tiles per worker so stealing can balance the frame, rounded to whole
+	//packet blocks.
+	static int auto_tile_size(int width, int height, size_t workers) {
+		const double target_tiles = 16.0 * std::max<size_t>(1, workers);
+		int size = static_cast<int>(std::sqrt(static_cast<double>(width) * height / target_tiles));
+		size = (size / min_tile_size) * min_tile_size;
+		return std::clamp(size, 2 * min_tile_size, 128);
+	}
+
+	const std::vector<Tile>& tiles() const { return tiles_; }
+	int tile_size() const { return tile_size_; }
+
+	int band_count() const { return static_cast<int>(band_offsets_.size()) - 1; }
+	int band_height() const { return band_rows_ * tile_size_; }
+	int band_of(const Tile& tile) const { return tile.y0 / band_height(); }
+	std::span<const Tile> band(int index) const {
+		return std::span<const Tile>(tiles_).subspan(band_offsets_[index], band_offsets_[index + 1] - band_offsets_[index]);
+	}
+
+	//Called when a worker picks up a tile. Returns true if the tile should be split instead
+	//of rendered, otherwise the tile counts as started.
+	bool should_split(const Tile& tile) {
+		std::lock_guard lk(mutex_);
+		const bool splittable = tile.width() >= 2 * min_tile_size && tile.height() >= 2 * min_tile_size;
+		const bool tail = unstarted_pixels_ <= 2 * static_cast<long>(workers_) * tile_size_ * tile_size_;
+
+		if (splittable && tail && finished_pixels_ > 0) {
+			const double mean_pixel_cost = finished_seconds_ / finished_pixels_;
+			const double tile_budget = mean_pixel_cost * tile_size_ * tile_size_;
+			if (predict_pixel_cost(tile, mean_pixel_cost) * tile.area() > split_factor * tile_budget)
+				return true;
+		}
+
+		unstarted_pixels_ -= tile.area();
+		return false;
+	}
+
+	static std::vector<Tile> split(const Tile& tile) {
+		//keep the halves on block boundaries so packets stay full.
+		auto half = [](int lo, int hi) { return lo + std::max(min_tile_size, ((hi - lo) / 2 / min_tile_size) * min_tile_size); };
+		const int mx = half(tile.x0, tile.x1);
+		const int my = half(tile.y0, tile.y1);
+		return {
+			Tile{ tile.x0, tile.y0, mx, my },
+			Tile{ mx, tile.y0, tile.x1, my },
+			Tile{ tile.x0, my, mx, tile.y1 },
+			Tile{ mx, my, tile.x1, tile.y1 },
+		};
+	}
+
+	//Telemetry: stores the per-pixel cost of a finished tile in the cost map.
+	void record(const Tile& tile, double seconds) {
+		std::lock_guard lk(mutex_);
+		const double pixel_cost = seconds / std::max(1L, tile.area());
+		for_cells(tile, [&](size_t cell) { cell_cost_[cell] = pixel_cost; });
+		finished_seconds_ += seconds;
+		finished_pixels_ += tile.area();
+	}
+
+private:
+	//a tile is split when it is expected to cost more than this many average tiles. Above
+	//1 so that a tail of ordinary tiles is rendered whole and only the outliers split.
+	static constexpr double split_factor = 2.0;
+
+	int width_, height_;
+	int tile_size_;
+	size_t workers_;
+	int band_rows_;
+	std::vector<Tile> tiles_;
+	std::vector<size_t> band_offsets_; //tiles_ index where each band starts, plus the end
+
+	std::mutex mutex_;
+	int cells_x_, cells_y_;
+	std::vector<double> cell_cost_; //seconds per pixel on a min_tile_size grid, negative when unknown
+	double finished_seconds_ = 0.0;
+	long finished_pixels_ = 0;
+	long unstarted_pixels_ = 0;
+
+	template<typename F>
+	void for_cells(const Tile& tile, F&& f) const {
+		const int cx1 = std::min(cells_x_, (tile.x1 + min_tile_size - 1) / min_tile_size);
+		const int cy1 = std::min(cells_y_, (tile.y1 + min_tile_size - 1) / min_tile_size);
+		for (int cy = std::max(0, tile.y0 / min_tile_size); cy < cy1; cy++)
+			for (int cx = std::max(0, tile.x0 / min_tile_size); cx < cx1; cx++)
+				f(static_cast<size_t>(cy) * cells_x_ + cx);
+	}
+
+	//Average cost of the measured cells around the tile. Expensive regions (glass, dense
+	//geometry) are spatially coherent, so the finished neighbours are a good predictor.
+	double predict_pixel_cost(const Tile& tile, double fallback) const {
+		const int margin = tile_size_;
+		Tile area{ tile.x0 - margin, tile.y0 - margin, tile.x1 + margin, tile.y1 + margin };
+		double sum = 0.0;
+		int known = 0;
+		for_cells(area, [&](size_t cell) {
+			if (cell_cost_[cell] >= 0.0) {
+				sum += cell_cost_[cell];
+				known++;
+			}
+		});
+		return known > 0 ? sum / known : fallback;
+	}
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cmath>
+#include "constants.hpp"
+#include "vec.hpp"
+
+//Affine transform stored as the top three rows of a 4x4 matrix: a 3x3 linear part in the
+//first three columns and the translation in the last. Composes right to left, so
+//(a * b).point(p) == a.point(b.point(p)).
+class Transform {
+public:
+	Real m[3][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } };
+
+	static Transform translate(const Vec3& offset) {
+		Transform t;
+		for (int row = 0; row < 3; row++) t.m[row][3] = offset.e[row];
+		return t;
+	}
+
+	static Transform scale(const Vec3& factors) {
+		Transform t;
+		for (int row = 0; row < 3; row++) t.m[row][row] = factors.e[row];
+		return t;
+	}
+
+	static Transform scale(Real factor) { return scale(Vec3(factor, factor, factor)); }
+
+	//counter clockwise rotation about axis (through the origin), looking down the axis.
+	static Transform rotate(const Vec3& axis, double degrees) {
+		const Vec3 a = unit_vector(axis);
+		const Real c = std::cos(degrees_to_radians(degrees)), s = std::sin(degrees_to_radians(degrees));
+		const Real k = 1 - c;
+		Transform t;
+		t.m[0][0] = c + a.x() * a.x() * k;
+		t.m[0][1] = a.x() * a.y() * k - a.z() * s;
+		t.m[0][2] = a.x() * a.z() * k + a.y() * s;
+		t.m[1][0] = a.y() * a.x() * k + a.z() * s;
+		t.m[1][1] = c + a.y() * a.y() * k;
+		t.m[1][2] = a.y() * a.z() * k - a.x() * s;
+		t.m[2][0] = a.z() * a.x() * k - a.y() * s;
+		t.m[2][1] = a.z() * a.y() * k + a.x() * s;
+		t.m[2][2] = c + a.z() * a.z() * k;
+		return t;
+	}
+
+	Point3D point(const Point3D& p) const {
+		return Point3D(row(0, p) + m[0][3], row(1, p) + m[1][3], row(2, p) + m[2][3]);
+	}
+
+	//directions ignore the translation.
+	Vec3 vector(const Vec3& v) const {
+		return Vec3(row(0, v), row(1, v), row(2, v));
+	}
+
+	//multiplies by the transposed linear part. On the inverse transform this carries normals
+	//across, since they have to stay perpendicular to the transformed surface.
+	Vec3 transposed_vector(const Vec3& v) const {
+		return Vec3(column(0, v), column(1, v), column(2, v));
+	}
+
+	Transform inverse() const {
+		Transform inv;
+		const Real det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+			- m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+			+ m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+		const Real inv_det = 1 / det;
+		//the inverse of the linear part is its adjugate over the determinant.
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 3; col++) {
+				const int r0 = (col + 1) % 3, r1 = (col + 2) % 3, c0 = (row + 1) % 3, c1 = (row + 2) % 3;
+				inv.m[row][col] = (m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0]) * inv_det;
+			}
+		}
+		const Vec3 offset = inv.vector(Vec3(m[0][3], m[1][3], m[2][3]));
+		for (int row = 0; row < 3; row++) inv.m[row][3] = -offset.e[row];
+		return inv;
+	}
+
+	friend Transform operator*(const Transform& a, const Transform& b) {
+		Transform t;
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 4; col++)
+				t.m[row][col] = a.m[row][0] * b.m[0][col] + a.m[row][1] * b.m[1][col] + a.m[row][2] * b.m[2][col];
+			t.m[row][3] += a.m[row][3];
+		}
+		return t;
+	}
+
+private:
+	Real row(int r, const Vec3& v) const { return m[r][0] * v.x() + m[r][1] * v.y() + m[r][2] * v.z(); }
+	Real column(int c, const Vec3& v) const { return m[0][c] * v.x() + m[1][c] * v.y() + m[2][c] * v.z(); }
+};
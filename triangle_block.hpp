@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include "ray.hpp"
+#include "simd_config.hpp"
+
+constexpr int triangle_block_width = 8;
+
+//Eight triangles in structure-of-arrays form, one float lane per triangle. Unused lanes
+//keep zero edges, which gives a zero determinant and never reports a hit.
+struct alignas(32) TriangleBlock {
+	float v0[3][triangle_block_width];
+	float e1[3][triangle_block_width];
+	float e2[3][triangle_block_width];
+
+	void set(int lane, const Point3D& vertex0, const Vec3& edge1, const Vec3& edge2) {
+		for (int axis = 0; axis < 3; axis++) {
+			v0[axis][lane] = static_cast<float>(vertex0.e[axis]);
+			e1[axis][lane] = static_cast<float>(edge1.e[axis]);
+			e2[axis][lane] = static_cast<float>(edge2.e[axis]);
+		}
+	}
+};
+
+struct BlockRay {
+	float origin[3];
+	float dir[3];
+	float origin_max; //largest origin coordinate, by magnitude
+	float dir_sum; //sum of the direction's coordinate magnitudes
+
+	BlockRay() = default;
+	explicit BlockRay(const Ray& r) {
+		origin_max = dir_sum = 0.0f;
+		for (int axis = 0; axis < 3; axis++) {
+			origin[axis] = static_cast<float>(r.origin().e[axis]);
+			dir[axis] = static_cast<float>(r.direction().e[axis]);
+			origin_max = std::max(origin_max, std::fabs(origin[axis]));
+			dir_sum += std::fabs(dir[axis]);
+		}
+	}
+};
+
+//The block test is a conservative filter for the exact test in Real: it must never drop a
+//hit that one would find. Float rounding grows with the distance of ray and triangle from
+//the world origin relative to the triangle's size, and with how grazing the ray is (a
+//small determinant), so on top of a fixed slack the barycentric and t bounds are widened
+//by a bound on that error, computed per lane.
+constexpr float block_slack = 1e-4f;
+constexpr float block_error = 8.0f * std::numeric_limits<float>::epsilon();
+
+//Moller-Trumbore against the eight lanes one at a time. The fallback without AVX2, and a
+//reference for the vector version. Returns the mask of candidate lanes.
+inline unsigned intersect_block_scalar(const TriangleBlock& block, const BlockRay& ray, float t_min, float t_max) {
+	const float t_lo = t_min - block_slack * std::fabs(t_min);
+	const float t_hi = t_max + block_slack * std::fabs(t_max);
+
+	unsigned mask = 0;
+	for (int i = 0; i < triangle_block_width; i++) {
+		const float v0[3] = { block.v0[0][i], block.v0[1][i], block.v0[2][i] };
+		const float e1[3] = { block.e1[0][i], block.e1[1][i], block.e1[2][i] };
+		const float e2[3] = { block.e2[0][i], block.e2[1][i], block.e2[2][i] };
+		const float* d = ray.dir;
+
+		const float p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+		const float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+		const float size = std::max(std::fabs(e1[0]) + std::fabs(e1[1]) + std::fabs(e1[2]), std::fabs(e2[0]) + std::fabs(e2[1]) + std::fabs(e2[2]));
+		if (det == 0.0f) {
+			//the error bound is unlimited, leave the call to the exact test. Empty lanes have
+			//no size and stay out.
+			if (size > 0.0f) mask |= 1u << i;
+			continue;
+		}
+		const float inv_det = 1.0f / det;
+
+		const float tv[3] = { ray.origin[0] - v0[0], ray.origin[1] - v0[1], ray.origin[2] - v0[2] };
+		const float b1 = (tv[0] * p[0] + tv[1] * p[1] + tv[2] * p[2]) * inv_det;
+		const float q[3] = { tv[1] * e1[2] - tv[2] * e1[1], tv[2] * e1[0] - tv[0] * e1[2], tv[0] * e1[1] - tv[1] * e1[0] };
+		const float b2 = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv_det;
+		const float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+
+		const float reach = ray.origin_max + std::max({ std::fabs(v0[0]), std::fabs(v0[1]), std::fabs(v0[2]) });
+		const float error = block_error * size * std::fabs(inv_det);
+		const float bary_tol = block_slack + error * ray.dir_sum * (2.0f * reach + size);
+		const float t_tol = block_slack * std::fabs(t) + error * size * (reach + std::fabs(t) * ray.dir_sum);
+
+		if (b1 >= -bary_tol && b2 >= -bary_tol && b1 + b2 <= 1.0f + bary_tol && t + t_tol >= t_lo && t - t_tol <= t_hi)
+			mask |= 1u << i;
+	}
+	return mask;
+}
+
+//All eight lanes at once, the same arithmetic as intersect_block_scalar().
+inline unsigned intersect_block(const TriangleBlock& block, const BlockRay& ray, float t_min, float t_max) {
+#if HAVE_AVX2
+	const float t_lo = t_min - block_slack * std::fabs(t_min);
+	const float t_hi = t_max + block_slack * std::fabs(t_max);
+
+	const __m256 ox = _mm256_set1_ps(ray.origin[0]), oy = _mm256_set1_ps(ray.origin[1]), oz = _mm256_set1_ps(ray.origin[2]);
+	const __m256 dx = _mm256_set1_ps(ray.dir[0]), dy = _mm256_set1_ps(ray.dir[1]), dz = _mm256_set1_ps(ray.dir[2]);
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	auto abs = [sign](__m256 v) { return _mm256_andnot_ps(sign, v); };
+
+	const __m256 v0x = _mm256_load_ps(block.v0[0]), v0y = _mm256_load_ps(block.v0[1]), v0z = _mm256_load_ps(block.v0[2]);
+	const __m256 e1x = _mm256_load_ps(block.e1[0]), e1y = _mm256_load_ps(block.e1[1]), e1z = _mm256_load_ps(block.e1[2]);
+	const __m256 e2x = _mm256_load_ps(block.e2[0]), e2y = _mm256_load_ps(block.e2[1]), e2z = _mm256_load_ps(block.e2[2]);
+
+	//pvec = d x e2
+	const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+	const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+	const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+	const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+	const __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+	//tvec = o - v0
+	const __m256 tx = _mm256_sub_ps(ox, v0x);
+	const __m256 ty = _mm256_sub_ps(oy, v0y);
+	const __m256 tz = _mm256_sub_ps(oz, v0z);
+	const __m256 b1 = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), inv_det);
+
+	//qvec = tvec x e1
+	const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+	const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+	const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+	const __m256 b2 = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inv_det);
+	const __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv_det);
+
+	//error bounds, see block_error.
+	const __m256 dir_sum = _mm256_set1_ps(ray.dir_sum);
+	const __m256 slack = _mm256_set1_ps(block_slack);
+	const __m256 size = _mm256_max_ps(_mm256_add_ps(_mm256_add_ps(abs(e1x), abs(e1y)), abs(e1z)), _mm256_add_ps(_mm256_add_ps(abs(e2x), abs(e2y)), abs(e2z)));
+	const __m256 reach = _mm256_add_ps(_mm256_set1_ps(ray.origin_max), _mm256_max_ps(_mm256_max_ps(abs(v0x), abs(v0y)), abs(v0z)));
+	const __m256 error = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(block_error), size), abs(inv_det));
+	const __m256 bary_tol = _mm256_add_ps(slack, _mm256_mul_ps(_mm256_mul_ps(error, dir_sum), _mm256_add_ps(_mm256_add_ps(reach, reach), size)));
+	const __m256 abs_t = abs(t);
+	const __m256 t_tol = _mm256_add_ps(_mm256_mul_ps(slack, abs_t), _mm256_mul_ps(_mm256_mul_ps(error, size), _mm256_add_ps(reach, _mm256_mul_ps(abs_t, dir_sum))));
+
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 neg_tol = _mm256_sub_ps(zero, bary_tol);
+	__m256 mask = _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ);
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(b1, neg_tol, _CMP_GE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(b2, neg_tol, _CMP_GE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(b1, b2), _mm256_add_ps(_mm256_set1_ps(1.0f), bary_tol), _CMP_LE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(t, t_tol), _mm256_set1_ps(t_lo), _CMP_GE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_sub_ps(t, t_tol), _mm256_set1_ps(t_hi), _CMP_LE_OQ));
+	//a zero determinant passes when the lane holds a triangle, as in the scalar version.
+	mask = _mm256_or_ps(mask, _mm256_and_ps(_mm256_cmp_ps(det, zero, _CMP_EQ_OQ), _mm256_cmp_ps(size, zero, _CMP_GT_OQ)));
+	return static_cast<unsigned>(_mm256_movemask_ps(mask));
+#else
+	return intersect_block_scalar(block, ray, t_min, t_max);
+#endif
+}
@@ -4,6 +4,8 @@
 #include <cmath>
 #include <iostream>
 #include <format>
+#include <type_traits>
+#include "real.hpp"
 #include "simd_config.hpp"
 
 #if HAVE_X86_SIMD
@@ -11,40 +13,45 @@
 #include <xmmintrin.h>
 #endif
 
-class Vec2 {
+//The vector types are templates on their scalar so float and double kernels can live side
+//by side (see the precision benchmark); the renderer itself uses the Real aliases below.
+//Scalar parameters are T so plain double literals still convert.
+
+template<typename T>
+class Vec2T {
 public:
-	double e[2];
+	T e[2];
 
-	Vec2() {}
+	Vec2T() {}
 
-	Vec2(double x, double y) : e{x, y} {}
+	Vec2T(T x, T y) : e{x, y} {}
 
-	inline double x() const noexcept { return e[0]; }
-	inline double y() const noexcept { return e[1]; }
+	inline T x() const noexcept { return e[0]; }
+	inline T y() const noexcept { return e[1]; }
 
-	Vec2 operator-() const { return Vec2(-e[0], -e[1]); }
+	Vec2T operator-() const { return Vec2T(-e[0], -e[1]); }
 
-	Vec2& operator+=(const Vec2& v) {
+	Vec2T& operator+=(const Vec2T& v) {
 		e[0] += v.x();
 		e[1] += v.y();
 		return *this;
 	}
 
-	Vec2& operator *=(double t) {
+	Vec2T& operator *=(T t) {
 		e[0] *= t;
 		e[1] *= t;
 		return *this;
 	}
 
-	Vec2& operator/=(double t) {
+	Vec2T& operator/=(T t) {
 		return *this *= 1/t;
 	}
 
-	double length() const {
+	T length() const {
 		return std::sqrt(length_squared());
 	}
 
-	double length_squared() const {
+	T length_squared() const {
 		return x() * x() + y() * y();
 	}
 
@@ -53,91 +60,101 @@ public:
 		return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s); 
 	}
 
-	static Vec2 random() {
-		return Vec2(random_double(), random_double());
+	static Vec2T random() {
+		return Vec2T(random_double(), random_double());
 	}
 
-	static Vec2 random(double min, double max) {
-		return Vec2(random_double(min,max), random_double(min,max));
+	static Vec2T random(double min, double max) {
+		return Vec2T(random_double(min,max), random_double(min,max));
 	}
 };
 
-inline std::ostream& operator<<(std::ostream& out, const Vec2& v) {
+template<typename T>
+inline std::ostream& operator<<(std::ostream& out, const Vec2T<T>& v) {
 	return out << v.x() << ' ' << v.y();
 }
 
 
-inline Vec2 operator+(const Vec2& u, const Vec2& v) {
-	return Vec2(u.x() + v.x(), u.y() + v.y());
+template<typename T>
+inline Vec2T<T> operator+(const Vec2T<T>& u, const Vec2T<T>& v) {
+	return Vec2T<T>(u.x() + v.x(), u.y() + v.y());
 }
 
-inline Vec2 operator-(const Vec2& u, const Vec2& v) {
-	return Vec2(u.x() - v.x(), u.y() - v.y());
+template<typename T>
+inline Vec2T<T> operator-(const Vec2T<T>& u, const Vec2T<T>& v) {
+	return Vec2T<T>(u.x() - v.x(), u.y() - v.y());
 }
 
-inline Vec2 operator*(const Vec2& u, const Vec2& v) {
-	return Vec2(u.x() * v.x(), u.y() * v.y());
+template<typename T>
+inline Vec2T<T> operator*(const Vec2T<T>& u, const Vec2T<T>& v) {
+	return Vec2T<T>(u.x() * v.x(), u.y() * v.y());
 }
 
-inline Vec2 operator*(double t, const Vec2& v) {
-	return Vec2(t*v.x(), t*v.y());
+template<typename T>
+inline Vec2T<T> operator*(std::type_identity_t<T> t, const Vec2T<T>& v) {
+	return Vec2T<T>(t*v.x(), t*v.y());
 }
 
-inline Vec2 operator*(const Vec2& v, double t) {
+template<typename T>
+inline Vec2T<T> operator*(const Vec2T<T>& v, std::type_identity_t<T> t) {
 	return t * v;
 }
 
-inline Vec2 operator/(const Vec2& v, double t) {
+template<typename T>
+inline Vec2T<T> operator/(const Vec2T<T>& v, std::type_identity_t<T> t) {
 	return (1/t) * v;
 }
 
-inline double dot(const Vec2& u, const Vec2& v) {
+template<typename T>
+inline T dot(const Vec2T<T>& u, const Vec2T<T>& v) {
 	return u.x() * v.x()
 		+ u.y() * v.y();
 }
 
 //The perp dot is what the z-component of what would be the 3D cross product.
-inline double perp_dot(const Vec2& u, const Vec2& v) {
+template<typename T>
+inline T perp_dot(const Vec2T<T>& u, const Vec2T<T>& v) {
 	return u.x() * v.y() - u.y() * v.x();
 }
 
-class Vec3 {
+template<typename T>
+class Vec3T {
 public:
-	double e[3];
+	T e[3];
 	
-	Vec3() {}
+	Vec3T() {}
 
-	Vec3(double x, double y, double z) : e{x, y, z} {} 
+	Vec3T(T x, T y, T z) : e{x, y, z} {} 
 
-        inline double x() const noexcept { return e[0]; }
-	inline double y() const noexcept { return e[1]; }
-	inline double z() const noexcept { return e[2]; }
+	inline T x() const noexcept { return e[0]; }
+	inline T y() const noexcept { return e[1]; }
+	inline T z() const noexcept { return e[2]; }
 
-	Vec3 operator-() const { return Vec3(-e[0], -e[1], -e[2]); }
+	Vec3T operator-() const { return Vec3T(-e[0], -e[1], -e[2]); }
 	
-	Vec3& operator+=(const Vec3& v) {
+	Vec3T& operator+=(const Vec3T& v) {
 		e[0] += v.x();
 		e[1] += v.y();
 		e[2] += v.z();
 		return *this;
 	}
 
-	Vec3& operator*=(double t) {
+	Vec3T& operator*=(T t) {
 		e[0] *= t; 
 		e[1] *= t; 
 		e[2] *= t;
 		return *this;
 	}
 
-	Vec3& operator/=(double t) {
+	Vec3T& operator/=(T t) {
 		return *this *= 1/t;
 	}
 
-	double length() const {
+	T length() const {
 		return std::sqrt(length_squared());
 	}
 
-	double length_squared() const {
+	T length_squared() const {
 		return x()*x() + y()*y() + z()*z();
 	}
 
@@ -146,85 +163,116 @@ public:
 		return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
 	}
 
-	static Vec3 random() {
-		return Vec3(random_double(), random_double(), random_double());
+	static Vec3T random() {
+		return Vec3T(random_double(), random_double(), random_double());
 	}
 
-	static Vec3 random(double min, double max) {
-		return Vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+	static Vec3T random(double min, double max) {
+		return Vec3T(random_double(min, max), random_double(min, max), random_double(min, max));
 	}
 };
 
+using Vec2 = Vec2T<Real>;
+using Vec3 = Vec3T<Real>;
 using Point2D = Vec2;
 using Point3D = Vec3;
 
-inline std::ostream& operator<<(std::ostream& out, const Vec3& v) {
+template<typename T>
+inline std::ostream& operator<<(std::ostream& out, const Vec3T<T>& v) {
 	return out << v.x() << ' ' << v.y() << ' ' << v.z();
 }
 
 
-inline Vec3 operator+(const Vec3& u, const Vec3& v) {
-	return Vec3(u.x() + v.x(), u.y() + v.y(), u.z() + v.z());
+template<typename T>
+inline Vec3T<T> operator+(const Vec3T<T>& u, const Vec3T<T>& v) {
+	return Vec3T<T>(u.x() + v.x(), u.y() + v.y(), u.z() + v.z());
 }
 
-inline Vec3 operator-(const Vec3& u, const Vec3& v) {
-	return Vec3(u.x() - v.x(), u.y() - v.y(), u.z() - v.z());
+template<typename T>
+inline Vec3T<T> operator-(const Vec3T<T>& u, const Vec3T<T>& v) {
+	return Vec3T<T>(u.x() - v.x(), u.y() - v.y(), u.z() - v.z());
 }
 
-inline Vec3 operator*(const Vec3& u, const Vec3& v) {
-	return Vec3(u.x() * v.x(), u.y() * v.y(), u.z() * v.z());
+template<typename T>
+inline Vec3T<T> operator*(const Vec3T<T>& u, const Vec3T<T>& v) {
+	return Vec3T<T>(u.x() * v.x(), u.y() * v.y(), u.z() * v.z());
 }
 
-inline Vec3 operator*(double t, const Vec3& v) {
-	return Vec3(t*v.x(), t*v.y(), t*v.z());
+template<typename T>
+inline Vec3T<T> operator*(std::type_identity_t<T> t, const Vec3T<T>& v) {
+	return Vec3T<T>(t*v.x(), t*v.y(), t*v.z());
 }
 
-inline Vec3 operator*(const Vec3& v, double t) {
+template<typename T>
+inline Vec3T<T> operator*(const Vec3T<T>& v, std::type_identity_t<T> t) {
 	return t * v;
 }
 
-inline Vec3 operator/(const Vec3& v, double t) {
+template<typename T>
+inline Vec3T<T> operator/(const Vec3T<T>& v, std::type_identity_t<T> t) {
 	return (1/t) * v;
 }
 
-inline double dot(const Vec3& u, const Vec3& v) {
+template<typename T>
+inline T dot(const Vec3T<T>& u, const Vec3T<T>& v) {
 	return u.x() * v.x()
 		+ u.y() * v.y()
 		+ u.z() * v.z();
 }
 
-inline Vec3 cross(const Vec3& u, const Vec3& v) {
-	return Vec3(
+template<typename T>
+inline Vec3T<T> cross(const Vec3T<T>& u, const Vec3T<T>& v) {
+	return Vec3T<T>(
 		u.y() * v.z() - u.z() * v.y(),
 		u.z() * v.x() - u.x() * v.z(),
 		u.x() * v.y() - u.y() * v.x()
 	     );
 }
 
-inline Vec3 unit_vector(const Vec3& v) {
+template<typename T>
+inline Vec3T<T> unit_vector(const Vec3T<T>& v) {
 	return v / v.length();
 }
 
-inline Vec2 unit_vector(const Vec2& v) {
+template<typename T>
+inline Vec2T<T> unit_vector(const Vec2T<T>& v) {
 	return v / v.length();
 }
 
-inline Vec3 random_unit_vector() {
-	while (true)
-	{
-		auto p = Vec3::random(-1, 1);
-		auto lensq = p.length_squared();
-		if (1e-160 < lensq && lensq <= 1)
-			return p / std::sqrt(lensq);
+//Inverse mappings of the unit square. Unlike rejection sampling they use exactly one 2D
+//sample per call, so stratified and low discrepancy points stay well distributed.
+
+//uniform on the unit sphere: z is uniform in [-1, 1], the angle around z in [0, 2pi).
+inline Vec3 square_to_unit_sphere(const Vec2& u) {
+	const double z = 1.0 - 2.0 * u.x();
+	const double r = std::sqrt(std::fmax(0.0, 1.0 - z * z));
+	const double phi = 2.0 * pi * u.y();
+	return Vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+//Shirley and Chiu's concentric map onto the unit disk in the xy plane.
+inline Vec3 square_to_unit_disk(const Vec2& u) {
+	const double a = 2.0 * u.x() - 1.0;
+	const double b = 2.0 * u.y() - 1.0;
+	if (a == 0.0 && b == 0.0) return Vec3(0, 0, 0);
+
+	double r, phi;
+	if (a * a > b * b) {
+		r = a;
+		phi = (pi / 4) * (b / a);
+	} else {
+		r = b;
+		phi = (pi / 2) - (pi / 4) * (a / b);
 	}
+	return Vec3(r * std::cos(phi), r * std::sin(phi), 0);
+}
+
+inline Vec3 random_unit_vector() {
+	return square_to_unit_sphere(Vec2(random_double(), random_double()));
 }
 
 inline Vec3 random_in_unit_disk() {
-	while(true) {
-		auto p = Vec3(random_double(-1, 1), random_double(-1, 1), 0);
-		if (p.length_squared() < 1)
-			return p;
-	}
+	return square_to_unit_disk(Vec2(random_double(), random_double()));
 }
 
 inline Vec3 random_on_hemisphere(const Vec3& normal) {
@@ -265,15 +313,15 @@ inline Vec3 reflect(const Vec3& v, const Vec3& n) {
 	return v - 2*dot(v,n)*n;
 }
 
-inline Vec3 refract(const Vec3& uv, const Vec3& n, double etai_over_etat) {
-	auto cos_theta = std::fmin(dot(-uv, n), 1.0);
+inline Vec3 refract(const Vec3& uv, const Vec3& n, Real etai_over_etat) {
+	Real cos_theta = std::fmin(dot(-uv, n), Real(1));
 	Vec3 r_out_perp = etai_over_etat * (uv + cos_theta*n);
-	Vec3 r_out_parallel = -std::sqrt(std::fabs(1.0 - r_out_perp.length_squared())) * n;
+	Vec3 r_out_parallel = -std::sqrt(std::fabs(Real(1) - r_out_perp.length_squared())) * n;
 	return r_out_perp + r_out_parallel;
 }
 
 #if HAVE_X86_SIMD
-inline double dot_sse(const Vec3& u, const Vec3& v) {
+inline double dot_sse(const Vec3T<double>& u, const Vec3T<double>& v) {
 	__m256d m_u = _mm256_setr_pd(u.x(), u.y(), u.z(), 0.0);
 	__m256d m_v = _mm256_setr_pd(v.x(), v.y(), v.z(), 0.0);
 	__m256d prod = _mm256_mul_pd(m_u, m_v); 				
@@ -288,28 +336,28 @@ inline double dot_sse(const Vec3& u, const Vec3& v) {
 #endif
 
 
-template<>
-struct std::formatter<Vec3> {
+template<typename T>
+struct std::formatter<Vec3T<T>> {
 	
 	constexpr auto parse(std::format_parse_context& ctx) {
  		
 		return ctx.begin();
 	}
 
-	auto format(const Vec3& obj, std::format_context& ctx) const {
+	auto format(const Vec3T<T>& obj, std::format_context& ctx) const {
 		return std::format_to(ctx.out(), "Vec3({}, {}, {})", obj.x(), obj.y(), obj.z());
 	}
 };
 	
-template<>
-struct std::formatter<Vec2> {
+template<typename T>
+struct std::formatter<Vec2T<T>> {
 	
 	constexpr auto parse(std::format_parse_context& ctx) {
  		
 		return ctx.begin();
 	}
 
-	auto format(const Vec2& obj, std::format_context& ctx) const {
+	auto format(const Vec2T<T>& obj, std::format_context& ctx) const {
 		return std::format_to(ctx.out(), "Vec2({}, {})", obj.x(), obj.y());
 	}
 };
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "vec.hpp"
+
+//How a mesh stores its vertex positions: full Real precision, floats, or 16 bits per
+//coordinate quantized over the mesh bounds (an error of at most 1/131070 of the extent).
+enum class VertexFormat : uint32_t {
+	full,
+	single,
+	quantized
+};
+
+inline std::optional<VertexFormat> parse_vertex_format(std::string_view name) {
+	if (name == "full") return VertexFormat::full;
+	if (name == "float") return VertexFormat::single;
+	if (name == "quantized") return VertexFormat::quantized;
+	return std::nullopt;
+}
+
+//Typed views of the three encodings. Kernels get one from VertexBuffer::visit(), which
+//switches on the format once for a whole batch of vertices instead of for every vertex.
+namespace vertices {
+
+struct Full {
+	const Real* data;
+	Point3D operator[](uint32_t i) const {
+		const Real* p = data + 3 * static_cast<size_t>(i);
+		return Point3D(p[0], p[1], p[2]);
+	}
+};
+
+struct Single {
+	const float* data;
+	Point3D operator[](uint32_t i) const {
+		const float* p = data + 3 * static_cast<size_t>(i);
+		return Point3D(p[0], p[1], p[2]);
+	}
+};
+
+struct Quantized {
+	const uint16_t* data;
+	const double* low;
+	const double* step;
+	Point3D operator[](uint32_t i) const {
+		const uint16_t* q = data + 3 * static_cast<size_t>(i);
+		return Point3D(low[0] + q[0] * step[0], low[1] + q[1] * step[1], low[2] + q[2] * step[2]);
+	}
+};
+
+}
+
+//Shared positions of an indexed mesh, decoded to Point3D on access.
+class VertexBuffer {
+public:
+	static constexpr double quantized_steps = 65535.0;
+
+	VertexBuffer() = default;
+
+	VertexBuffer(std::span<const Point3D> positions, VertexFormat format) : format_(format), count_(positions.size()) {
+		if (format == VertexFormat::quantized && !positions.empty()) {
+			for (int axis = 0; axis < 3; axis++) {
+				const auto [low, high] = std::minmax_element(positions.begin(), positions.end(),
+					[axis](const Point3D& a, const Point3D& b) { return a.e[axis] < b.e[axis]; });
+				low_[axis] = low->e[axis];
+				step_[axis] = (high->e[axis] - low_[axis]) / quantized_steps;
+			}
+		}
+
+		owned_.resize(count_ * stride(format));
+		for (size_t i = 0; i < count_; i++) {
+			std::byte* out = owned_.data() + i * stride(format);
+			switch (format) {
+			case VertexFormat::single: {
+				const float p[3] = { static_cast<float>(positions[i].x()), static_cast<float>(positions[i].y()), static_cast<float>(positions[i].z()) };
+				std::memcpy(out, p, sizeof(p));
+				break;
+			}
+			case VertexFormat::quantized: {
+				uint16_t q[3];
+				for (int axis = 0; axis < 3; axis++) {
+					const double steps = step_[axis] > 0 ? (positions[i].e[axis] - low_[axis]) / step_[axis] : 0.0;
+					q[axis] = static_cast<uint16_t>(std::clamp(std::lround(steps), 0l, 65535l));
+				}
+				std::memcpy(out, q, sizeof(q));
+				break;
+			}
+			case VertexFormat::full:
+				std::memcpy(out, positions[i].e, 3 * sizeof(Real));
+				break;
+			}
+		}
+		data_ = owned_.data();
+	}
+
+	//A buffer stored elsewhere, e.g. in a mapped cache file.
+	static VertexBuffer view(VertexFormat format, size_t count, const double* low, const double* step, const std::byte* data) {
+		VertexBuffer buffer;
+		buffer.format_ = format;
+		buffer.count_ = count;
+		std::copy(low, low + 3, buffer.low_);
+		std::copy(step, step + 3, buffer.step_);
+		buffer.data_ = data;
+		return buffer;
+	}
+
+	//data_ may point into owned_, whose buffer survives a move but not a copy.
+	VertexBuffer(VertexBuffer&&) = default;
+	VertexBuffer& operator=(VertexBuffer&&) = default;
+	VertexBuffer(const VertexBuffer&) = delete;
+	VertexBuffer& operator=(const VertexBuffer&) = delete;
+
+	//calls fn with the typed view of the buffer's format.
+	template<typename Fn>
+	decltype(auto) visit(Fn&& fn) const {
+		switch (format_) {
+		case VertexFormat::single: return fn(vertices::Single{ reinterpret_cast<const float*>(data_) });
+		case VertexFormat::quantized: return fn(vertices::Quantized{ reinterpret_cast<const uint16_t*>(data_), low_, step_ });
+		case VertexFormat::full: break;
+		}
+		return fn(vertices::Full{ reinterpret_cast<const Real*>(data_) });
+	}
+
+	//a single vertex; loops over many should visit() instead.
+	Point3D operator[](uint32_t i) const {
+		return visit([i](const auto& view) { return view[i]; });
+	}
+
+	static size_t stride(VertexFormat format) {
+		switch (format) {
+		case VertexFormat::single: return 3 * sizeof(float);
+		case VertexFormat::quantized: return 3 * sizeof(uint16_t);
+		case VertexFormat::full: break;
+		}
+		return 3 * sizeof(Real);
+	}
+
+	VertexFormat format() const { return format_; }
+	size_t size() const { return count_; }
+	std::span<const std::byte> bytes() const { return { data_, count_ * stride(format_) }; }
+	const double* low() const { return low_; }
+	const double* step() const { return step_; }
+
+private:
+	VertexFormat format_ = VertexFormat::full;
+	size_t count_ = 0;
+	double low_[3] = {}; //quantized only: the bounds' low corner
+	double step_[3] = {}; //and the size of one quantization step per axis
+	std::vector<std::byte> owned_;
+	const std::byte* data_ = nullptr;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include "aov.hpp"
+#include "hittable.hpp"
+#include "pixel_stats.hpp"
+#include "ray.hpp"
+
+//How the camera turns camera rays into colors. recursive follows one path at a time
+//depth first, wavefront advances every path of a tile one bounce per stage.
+enum class Integrator {
+	recursive,
+	wavefront
+};
+
+inline std::optional<Integrator> parse_integrator(std::string_view name) {
+	if (name == "recursive") return Integrator::recursive;
+	if (name == "wavefront") return Integrator::wavefront;
+	return std::nullopt;
+}
+
+//Paths of one wavefront in structure-of-arrays form. pixel is the index of the pixel the
+//path contributes to, within the tile.
+struct PathQueue {
+	std::vector<Real> origin[3];
+	std::vector<Real> dir[3];
+	std::vector<Vec3> throughput;
+	std::vector<uint32_t> pixel;
+
+	size_t size() const { return pixel.size(); }
+
+	void clear() {
+		for (int axis = 0; axis < 3; axis++) {
+			origin[axis].clear();
+			dir[axis].clear();
+		}
+		throughput.clear();
+		pixel.clear();
+	}
+
+	void push(const Ray& r, const Vec3& weight, uint32_t index) {
+		for (int axis = 0; axis < 3; axis++) {
+			origin[axis].push_back(r.origin().e[axis]);
+			dir[axis].push_back(r.direction().e[axis]);
+		}
+		throughput.push_back(weight);
+		pixel.push_back(index);
+	}
+
+	Ray ray(size_t i) const {
+		return Ray(Point3D(origin[0][i], origin[1][i], origin[2][i]), Vec3(dir[0][i], dir[1][i], dir[2][i]));
+	}
+};
+
+//A path waiting for the shade stage. The material is copied next to the index so the
+//sort runs over this small array instead of the hit records.
+struct ShadeItem {
+	const Material* mat;
+	uint32_t path;
+};
+
+//Buffers of the wavefront integrator for one tile. Each worker keeps one and reuses it
+//for every tile it renders, so the queues only grow to the largest tile once.
+struct WavefrontState {
+	PathQueue paths; //paths entering the current bounce
+	PathQueue next; //survivors of the shade stage
+	std::vector<Point3D> vertices; //hit point each path in next leaves from
+	std::vector<HitRecord> hits; //per path in paths, valid where listed in hit_paths
+	std::vector<ShadeItem> hit_paths; //paths that hit something, sorted by material to shade
+
+	std::vector<uint32_t> pixel_ids; //per pixel, its index in the image
+	std::vector<Vec3> radiance; //per pixel, the sample being traced
+	std::vector<Vec3> pixel_color; //per pixel, the sum over samples
+	std::vector<PixelStats> stats;
+	std::vector<uint32_t> active; //pixels still taking samples
+	std::vector<uint32_t> sample_pixels; //per active pixel, its index in the image
+	std::vector<Vec2> jitter, lens; //per active pixel, camera samples of the current pass
+	OccluderCache occluders;
+	std::vector<AovSum> aovs; //per pixel, only when the AOVs or the denoiser need them
+};
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <vector>
+#include "aabb.hpp"
+#include "bvh.hpp"
+#include "ray.hpp"
+#include "ray_packet.hpp"
+#include "ray_stats.hpp"
+#include "simd_config.hpp"
+
+constexpr int wide_bvh_width = 8;
+
+//8-wide BVH node with child boxes quantized to 8 bits per plane relative to the node
+//bounds. A child is an inner node when count is 0, otherwise a leaf of count primitives
+//starting at child. Unused slots are left out of occupied; they also hold an inverted box,
+//but a NaN slab could still let one pass, and its zeroed child would point at the root.
+struct WideNode {
+	float origin[3];
+	float scale[3];
+	uint32_t child[wide_bvh_width];
+	uint8_t quantized[6][wide_bvh_width]; //lo x, lo y, lo z, hi x, hi y, hi z
+	uint8_t count[wide_bvh_width];
+	uint8_t occupied; //bit i is set when slot i holds a child
+};
+
+//A traversal pops one node and pushes at most all of its children, and the tree is no
+//deeper than the binary one it was collapsed from, so the stacks never hold more than this.
+constexpr int wide_bvh_stack_size = (wide_bvh_width - 1) * bvh::max_depth + 1;
+
+//The node test rounds the ray to float and evaluates (plane - origin) * inv_dir in float,
+//which is off by a few ulps of the coordinates involved, not of the distance: far from
+//the world origin that outgrows any relative widening. As in the triangle block filter,
+//both slab distances are moved out by an absolute bound, wide_bvh_error times the
+//magnitude of ray origin, node origin and node extent (255 quantization steps), per unit
+//of inverse direction.
+constexpr float wide_bvh_error = 8.0f * std::numeric_limits<float>::epsilon();
+
+//Ray data shared by every node test of one traversal.
+struct WideRay {
+	float origin[3];
+	float inv_dir[3];
+	float error[3]; //wide_bvh_error * |inv_dir|, 0 along an axis the ray does not move on
+	int near_plane[3]; //which quantized row holds the entry plane for each axis
+	int far_plane[3];
+
+	WideRay() = default;
+	explicit WideRay(const Ray& r) {
+		for (int axis = 0; axis < 3; axis++) {
+			origin[axis] = static_cast<float>(r.origin().e[axis]);
+			inv_dir[axis] = 1.0f / static_cast<float>(r.direction().e[axis]);
+			//a zero component gives infinite distances, which no bound widens.
+			error[axis] = r.direction().e[axis] == 0 ? 0.0f : wide_bvh_error * std::fabs(inv_dir[axis]);
+			bool negative = r.direction().e[axis] < 0;
+			near_plane[axis] = negative ? 3 + axis : axis;
+			far_plane[axis] = negative ? axis : 3 + axis;
+		}
+	}
+};
+
+class WideBvh {
+public:
+	std::vector<WideNode> nodes; //empty when the tree views nodes stored elsewhere
+
+	//Tree over count nodes stored outside of it, e.g. in a mapped cache file, which has to
+	//outlive the tree.
+	static WideBvh view(const WideNode* nodes, size_t count) {
+		WideBvh result;
+		result.view_ = nodes;
+		result.view_size_ = count;
+		return result;
+	}
+
+	std::span<const WideNode> node_span() const {
+		return nodes.empty() ? std::span<const WideNode>(view_, view_size_) : std::span<const WideNode>(nodes);
+	}
+
+	//Builds a binary SAH tree over the boxes and collapses it into 8-wide nodes.
+	//As with bvh::build, order returns the primitive permutation expected by the leaves.
+	static WideBvh build(const std::vector<AABB>& boxes, std::vector<uint32_t>& order, int max_leaf_size) {
+		WideBvh result;
+		auto binary = bvh::build(boxes, order, max_leaf_size);
+		if (binary.empty()) return result;
+
+		result.nodes.reserve(binary.size() / 4 + 1);
+		result.collapse(binary, 0);
+		return result;
+	}
+
+	//Tests the ray against all children of a node at once. Returns a bit mask of the
+	//children that were hit and writes their entry distances.
+	static unsigned intersect_node(const WideNode& node, const WideRay& ray, float t_min, float t_max, float* t_near) {
+#if HAVE_AVX2
+		__m256 tn = _mm256_set1_ps(t_min);
+		__m256 tf = _mm256_set1_ps(t_max);
+		for (int axis = 0; axis < 3; axis++) {
+			const __m256 origin = _mm256_set1_ps(node.origin[axis]);
+			const __m256 scale = _mm256_set1_ps(node.scale[axis]);
+			const __m256 ray_origin = _mm256_set1_ps(ray.origin[axis]);
+			const __m256 inv_dir = _mm256_set1_ps(ray.inv_dir[axis]);
+			const __m256 error = _mm256_set1_ps(plane_error(node, ray, axis));
+
+			auto plane = [&](int row) {
+				__m128i q = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(node.quantized[row]));
+				__m256 p = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(q)), scale), origin);
+				return _mm256_mul_ps(_mm256_sub_ps(p, ray_origin), inv_dir);
+			};
+			//operand order matters: max/min return the second operand when the first is NaN (0 * inf).
+			tn = _mm256_max_ps(_mm256_sub_ps(plane(ray.near_plane[axis]), error), tn);
+			tf = _mm256_min_ps(_mm256_add_ps(plane(ray.far_plane[axis]), error), tf);
+		}
+		//t_max itself was rounded to float, widen the exit distance by a few ulps of it.
+		tf = _mm256_mul_ps(tf, _mm256_set1_ps(1.0f + 4.0f * std::numeric_limits<float>::epsilon()));
+		_mm256_storeu_ps(t_near, tn);
+		return static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ))) & node.occupied;
+#else
+		unsigned mask = 0;
+		for (int i = 0; i < wide_bvh_width; i++) {
+			float tn = t_min;
+			float tf = t_max;
+			for (int axis = 0; axis < 3; axis++) {
+				float near = node.quantized[ray.near_plane[axis]][i] * node.scale[axis] + node.origin[axis];
+				float far = node.quantized[ray.far_plane[axis]][i] * node.scale[axis] + node.origin[axis];
+				const float error = plane_error(node, ray, axis);
+				tn = std::max(tn, (near - ray.origin[axis]) * ray.inv_dir[axis] - error);
+				tf = std::min(tf, (far - ray.origin[axis]) * ray.inv_dir[axis] + error);
+			}
+			tf *= 1.0f + 4.0f * std::numeric_limits<float>::epsilon();
+			t_near[i] = tn;
+			if (tn <= tf) mask |= 1u << i;
+		}
+		return mask & node.occupied;
+#endif
+	}
+
+	//Bound on the rounding error of a slab distance of node along axis, see wide_bvh_error.
+	static float plane_error(const WideNode& node, const WideRay& ray, int axis) {
+		return ray.error[axis] * (std::fabs(ray.origin[axis]) + std::fabs(node.origin[axis]) + 256.0f * node.scale[axis]);
+	}
+
+	//Closest hit traversal. leaf(first, count, ray_t) tests the primitives of a leaf and
+	//shrinks ray_t.high when it finds a closer hit; children are visited front to back.
+	template<typename LeafFn>
+	void traverse(const Ray& r, Interval& ray_t, LeafFn&& leaf) const {
+		const std::span<const WideNode> tree = node_span();
+		if (tree.empty()) return;
+
+		struct Entry {
+			uint32_t child;
+			uint32_t count;
+			float t_near;
+		};
+
+		const WideRay ray(r);
+		Entry stack[wide_bvh_stack_size];
+		int stack_size = 0;
+		stack[stack_size++] = Entry{ 0, 0, static_cast<float>(ray_t.low) };
+
+		while (stack_size > 0) {
+			const Entry entry = stack[--stack_size];
+			if (entry.t_near > ray_t.high) continue;
+
+			if (entry.count > 0) {
+				leaf(entry.child, entry.count, ray_t);
+				continue;
+			}
+
+			const WideNode& node = tree[entry.child];
+			alignas(32) float t_near[wide_bvh_width];
+			ray_stats::count_tests(1);
+			unsigned mask = intersect_node(node, ray, static_cast<float>(ray_t.low), static_cast<float>(ray_t.high), t_near);
+
+			//push hit children farthest first so the nearest one is popped next.
+			const int first = stack_size;
+			while (mask) {
+				int i = std::countr_zero(mask);
+				mask &= mask - 1;
+
+				Entry e{ node.child[i], node.count[i], t_near[i] };
+				int j = stack_size++;
+				while (j > first && stack[j - 1].t_near < e.t_near) {
+					stack[j] = stack[j - 1];
+					j--;
+				}
+				stack[j] = e;
+			}
+		}
+	}
+
+	//Any hit traversal for shadow rays. leaf(first, count, ray_t) returns true when one of
+	//its primitives is hit, which ends the search; children are visited in node order.
+	template<typename LeafFn>
+	bool traverse_any(const Ray& r, Interval ray_t, LeafFn&& leaf) const {
+		const std::span<const WideNode> tree = node_span();
+		if (tree.empty()) return false;
+
+		struct Entry {
+			uint32_t child;
+			uint32_t count;
+		};
+
+		const WideRay ray(r);
+		Entry stack[wide_bvh_stack_size];
+		int stack_size = 0;
+		stack[stack_size++] = Entry{ 0, 0 };
+
+		while (stack_size > 0) {
+			const Entry entry = stack[--stack_size];
+			if (entry.count > 0) {
+				if (leaf(entry.child, entry.count, ray_t)) return true;
+				continue;
+			}
+
+			const WideNode& node = tree[entry.child];
+			alignas(32) float t_near[wide_bvh_width];
+			ray_stats::count_tests(1);
+			unsigned mask = intersect_node(node, ray, static_cast<float>(ray_t.low), static_cast<float>(ray_t.high), t_near);
+			while (mask) {
+				int i = std::countr_zero(mask);
+				mask &= mask - 1;
+				stack[stack_size++] = Entry{ node.child[i], node.count[i] };
+			}
+		}
+		return false;
+	}
+
+	//Packet version of traverse(). A node is opened when any lane of the packet hits it and
+	//its children inherit the subset of lanes that hit them; leaf(first, count, lanes) then
+	//tests only those lanes. Lane bounds are read from t_max, which the leaf callback updates.
+	template<typename LeafFn>
+	void traverse_packet(const RayPacket& packet, unsigned lanes, const Real* t_max, LeafFn&& leaf) const {
+		const std::span<const WideNode> tree = node_span();
+		if (tree.empty() || lanes == 0) return;
+
+		struct Entry {
+			uint32_t child;
+			uint32_t count;
+			unsigned lanes;
+		};
+
+		WideRay rays[packet_width];
+		for (unsigned m = lanes; m; m &= m - 1) {
+			int lane = std::countr_zero(m);
+			rays[lane] = WideRay(packet.rays[lane]);
+		}
+
+		const float t_min = static_cast<float>(packet.t_min);
+		Entry stack[wide_bvh_stack_size];
+		int stack_size = 0;
+		stack[stack_size++] = Entry{ 0, 0, lanes };
+
+		while (stack_size > 0) {
+			const Entry entry = stack[--stack_size];
+			if (entry.count > 0) {
+				leaf(entry.child, entry.count, entry.lanes);
+				continue;
+			}
+
+			const WideNode& node = tree[entry.child];
+			unsigned child_lanes[wide_bvh_width] = {};
+			float child_near[wide_bvh_width];
+			std::fill(std::begin(child_near), std::end(child_near), std::numeric_limits<float>::max());
+			ray_stats::count_tests(std::popcount(entry.lanes));
+
+			for (unsigned m = entry.lanes; m; m &= m - 1) {
+				int lane = std::countr_zero(m);
+				alignas(32) float t_near[wide_bvh_width];
+				unsigned hit = intersect_node(node, rays[lane], t_min, static_cast<float>(t_max[lane]), t_near);
+				while (hit) {
+					int i = std::countr_zero(hit);
+					hit &= hit - 1;
+					child_lanes[i] |= 1u << lane;
+					child_near[i] = std::min(child_near[i], t_near[i]);
+				}
+			}
+
+			//push farthest first, using the nearest entry over the lanes as the sort key.
+			int order[wide_bvh_width];
+			int hit_count = 0;
+			for (int i = 0; i < wide_bvh_width; i++) {
+				if (child_lanes[i] == 0) continue;
+
+				int j = hit_count++;
+				while (j > 0 && child_near[order[j - 1]] < child_near[i]) {
+					order[j] = order[j - 1];
+					j--;
+				}
+				order[j] = i;
+			}
+			for (int k = 0; k < hit_count; k++) {
+				int i = order[k];
+				stack[stack_size++] = Entry{ node.child[i], node.count[i], child_lanes[i] };
+			}
+		}
+	}
+
+private:
+	const WideNode* view_ = nullptr;
+	size_t view_size_ = 0;
+
+	uint32_t collapse(const std::vector<BvhNode>& binary, uint32_t root) {
+		const uint32_t index = static_cast<uint32_t>(nodes.size());
+		nodes.push_back(WideNode{});
+
+		//open up the largest inner children until the node is full.
+		std::vector<uint32_t> children;
+		if (binary[root].count > 0) {
+			children.push_back(root);
+		} else {
+			children.push_back(root + 1);
+			children.push_back(binary[root].offset);
+		}
+
+		while (children.size() < wide_bvh_width) {
+			int best = -1;
+			double best_area = -1.0;
+			for (size_t i = 0; i < children.size(); i++) {
+				const BvhNode& c = binary[children[i]];
+				if (c.count == 0 && c.bbox.surface_area() > best_area) {
+					best_area = c.bbox.surface_area();
+					best = static_cast<int>(i);
+				}
+			}
+			if (best < 0) break;
+
+			uint32_t opened = children[best];
+			children[best] = opened + 1;
+			children.push_back(binary[opened].offset);
+		}
+
+		WideNode node{};
+		AABB child_boxes[wide_bvh_width];
+		for (size_t i = 0; i < children.size(); i++) {
+			const BvhNode& c = binary[children[i]];
+			child_boxes[i] = c.bbox;
+			node.count[i] = static_cast<uint8_t>(c.count);
+			node.child[i] = c.count > 0 ? c.offset : collapse(binary, children[i]);
+		}
+		node.occupied = static_cast<uint8_t>((1u << children.size()) - 1);
+		quantize(node, binary[root].bbox, child_boxes, static_cast<int>(children.size()));
+
+		nodes[index] = node;
+		return index;
+	}
+
+	//Stores each child box conservatively: lower planes round down, upper planes round up.
+	static void quantize(WideNode& node, const AABB& bounds, const AABB* boxes, int count) {
+		for (int axis = 0; axis < 3; axis++) {
+			const Interval& extent = bounds.axis_interval(axis);
+			float origin = static_cast<float>(extent.low);
+			if (origin > extent.low) origin = std::nextafter(origin, -std::numeric_limits<float>::infinity());
+			float scale = static_cast<float>((extent.high - origin) / 255.0);
+			scale = std::nextafter(scale, std::numeric_limits<float>::infinity());
+
+			node.origin[axis] = origin;
+			node.scale[axis] = scale;
+
+			auto dequantize = [&](int q) { return static_cast<double>(origin) + static_cast<double>(q) * scale; };
+			for (int i = 0; i < wide_bvh_width; i++) {
+				if (i >= count) {
+					node.quantized[axis][i] = 255;
+					node.quantized[3 + axis][i] = 0;
+					continue;
+				}
+
+				const Interval& child = boxes[i].axis_interval(axis);
+				const double slack = 1e-6 * (std::fabs(child.low) + std::fabs(child.high));
+				int lo = std::clamp(static_cast<int>(std::floor((child.low - origin) / scale)), 0, 255);
+				while (lo > 0 && dequantize(lo) > child.low - slack) lo--;
+				int hi = std::clamp(static_cast<int>(std::ceil((child.high - origin) / scale)), 0, 255);
+				while (hi < 255 && dequantize(hi) < child.high + slack) hi++;
+
+				node.quantized[axis][i] = static_cast<uint8_t>(lo);
+				node.quantized[3 + axis][i] = static_cast<uint8_t>(hi);
+			}
+		}
+	}
+};